@@ -0,0 +1,93 @@
+#pragma once
+
+#include <limits>
+#include <algorithm>
+
+#include <miquella/core/ray.h>
+
+namespace miquella {
+
+namespace core {
+
+// Axis aligned bounding box used by the acceleration structures.
+// A default constructed box is empty (min = +inf, max = -inf) so that
+// extending it with any point or box gives the expected result.
+class AABB
+{
+public:
+    AABB() :
+        m_min(std::numeric_limits<float>::max()),
+        m_max(-std::numeric_limits<float>::max()){}
+
+    AABB(const glm::vec3& a, const glm::vec3& b) :
+        m_min(std::min(a.x, b.x), std::min(a.y, b.y), std::min(a.z, b.z)),
+        m_max(std::max(a.x, b.x), std::max(a.y, b.y), std::max(a.z, b.z)){}
+
+    void extend(const glm::vec3& p)
+    {
+        m_min = glm::vec3(std::min(m_min.x, p.x), std::min(m_min.y, p.y), std::min(m_min.z, p.z));
+        m_max = glm::vec3(std::max(m_max.x, p.x), std::max(m_max.y, p.y), std::max(m_max.z, p.z));
+    }
+
+    void extend(const AABB& box)
+    {
+        extend(box.m_min);
+        extend(box.m_max);
+    }
+
+    bool isEmpty() const
+    {
+        return m_min.x > m_max.x || m_min.y > m_max.y || m_min.z > m_max.z;
+    }
+
+    glm::vec3 centroid() const
+    {
+        return 0.5f * (m_min + m_max);
+    }
+
+    glm::vec3 extent() const
+    {
+        return m_max - m_min;
+    }
+
+    float surfaceArea() const
+    {
+        if(isEmpty())
+            return 0.f;
+        auto d = extent();
+        return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    int longestAxis() const
+    {
+        auto d = extent();
+        if(d.x > d.y && d.x > d.z)
+            return 0;
+        return d.y > d.z ? 1 : 2;
+    }
+
+    // Slab test. invDir is 1/direction, precomputed once per ray by the caller.
+    bool intersect(const Ray& r, const glm::vec3& invDir, float tmin, float tmax) const
+    {
+        for(int a = 0; a < 3; ++a)
+        {
+            auto t0 = (m_min[a] - r.m_orig[a]) * invDir[a];
+            auto t1 = (m_max[a] - r.m_orig[a]) * invDir[a];
+            if(invDir[a] < 0.f)
+                std::swap(t0, t1);
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+            if(tmax < tmin)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    glm::vec3 m_min;
+    glm::vec3 m_max;
+};
+
+} // core
+
+} // miquella
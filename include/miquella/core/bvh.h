@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include <miquella/core/aabb.h>
+
+namespace miquella {
+
+namespace core {
+
+// Node of the binary BVH. Nodes are stored depth first: the first child of an
+// interior node is always the next node in the array, the second child is
+// stored at m_offset. For leaves, m_offset is the index of the first primitive
+// in BVH::m_primitiveIndices and m_count the number of primitives.
+struct BVHNode
+{
+    AABB m_box;
+    uint32_t m_offset = 0;
+    uint16_t m_count = 0;
+    uint8_t m_axis = 0;
+
+    bool isLeaf() const { return m_count > 0; }
+};
+
+// Bounding volume hierarchy built with the surface area heuristic (binned).
+// The BVH only knows about bounding boxes, the primitives themselves are
+// accessed through the callback given to intersect(). This allows the same
+// structure to be used over any primitive storage.
+class BVH
+{
+public:
+    // Maximum depth of the tree, bounds the traversal stack
+    static constexpr uint32_t MAX_DEPTH = 64;
+
+    BVH(){}
+
+    void build(const std::vector<AABB>& boxes, uint32_t maxLeafSize = 4);
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_primitiveIndices.clear();
+    }
+
+    bool isEmpty() const { return m_nodes.empty(); }
+
+    // Traverse the hierarchy front to back. intersectPrimitive is called as
+    // intersectPrimitive(uint32_t primitiveIndex, float& tmax) and must return
+    // true and shrink tmax when the primitive is hit closer than tmax.
+    template<typename IntersectFunc>
+    bool intersect(const Ray& r, float tmin, float tmax, IntersectFunc&& intersectPrimitive) const
+    {
+        return traverse(r, tmin, tmax, [&](uint32_t first, uint32_t count, float& currentMax)
+        {
+            bool hitFound = false;
+            for(uint32_t i = first; i < first + count; ++i)
+            {
+                if(intersectPrimitive(m_primitiveIndices[i], currentMax))
+                    hitFound = true;
+            }
+            return hitFound;
+        });
+    }
+
+    // Same as intersect(), but intersectLeaf is called once per leaf as
+    // intersectLeaf(uint32_t first, uint32_t count, float& tmax) where
+    // [first, first + count) is a range of m_primitiveIndices. Lets the caller
+    // test the primitives of a leaf in a batch.
+    template<typename LeafFunc>
+    bool traverse(const Ray& r, float tmin, float tmax, LeafFunc&& intersectLeaf) const
+    {
+        if(m_nodes.empty())
+            return false;
+
+        const glm::vec3 invDir = glm::vec3(1.f / r.m_dir.x, 1.f / r.m_dir.y, 1.f / r.m_dir.z);
+        const bool dirIsNeg[3] = { invDir.x < 0.f, invDir.y < 0.f, invDir.z < 0.f };
+
+        uint32_t stack[MAX_DEPTH];
+        uint32_t stackSize = 0;
+        uint32_t current = 0;
+        bool hitFound = false;
+
+        while(true)
+        {
+            const BVHNode& node = m_nodes[current];
+            if(node.m_box.intersect(r, invDir, tmin, tmax))
+            {
+                if(node.isLeaf())
+                {
+                    if(intersectLeaf(node.m_offset, static_cast<uint32_t>(node.m_count), tmax))
+                        hitFound = true;
+                    if(stackSize == 0)
+                        break;
+                    current = stack[--stackSize];
+                }
+                else
+                {
+                    // Visit the child closest to the ray origin first
+                    if(dirIsNeg[node.m_axis])
+                    {
+                        stack[stackSize++] = current + 1;
+                        current = node.m_offset;
+                    }
+                    else
+                    {
+                        stack[stackSize++] = node.m_offset;
+                        current = current + 1;
+                    }
+                }
+            }
+            else
+            {
+                if(stackSize == 0)
+                    break;
+                current = stack[--stackSize];
+            }
+        }
+
+        return hitFound;
+    }
+
+private:
+    uint32_t _buildRecursive(const std::vector<AABB>& boxes, const std::vector<glm::vec3>& centroids, uint32_t begin, uint32_t end, uint32_t depth, uint32_t maxLeafSize);
+
+public:
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_primitiveIndices;
+};
+
+} // core
+
+} // miquella
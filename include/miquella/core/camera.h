@@ -2,6 +2,8 @@
 
 #include <miquella/core/ray.h>
 
+#include <algorithm>
+
 
 namespace miquella
 {
@@ -28,10 +30,35 @@ class Camera {
         int getImageWidth() const { return m_imageWidth; }
         int getImageHeight() const { return m_imageHeight; }
 
+        // Rectangle of the image to render, in pixels from the top left
+        // corner, clamped to the image. The rays of its pixels are the ones
+        // of the same pixels in the whole image, so that crops rendered
+        // separately stitch into the whole image. A width or height of 0
+        // renders the whole image.
+        void setCropWindow(int x, int y, int width, int height)
+        {
+            m_cropX = x;
+            m_cropY = y;
+            m_cropWidth = width;
+            m_cropHeight = height;
+        }
+        void resetCropWindow(){ setCropWindow(0, 0, 0, 0); }
+        bool hasCropWindow() const { return m_cropWidth > 0 && m_cropHeight > 0; }
+
+        int getCropX() const { return hasCropWindow() ? std::clamp(m_cropX, 0, m_imageWidth) : 0; }
+        int getCropY() const { return hasCropWindow() ? std::clamp(m_cropY, 0, m_imageHeight) : 0; }
+        int getCropWidth() const { return hasCropWindow() ? std::clamp(m_cropWidth, 0, m_imageWidth - getCropX()) : m_imageWidth; }
+        int getCropHeight() const { return hasCropWindow() ? std::clamp(m_cropHeight, 0, m_imageHeight - getCropY()) : m_imageHeight; }
+
 public:
         int m_imageWidth = 800;
         int m_imageHeight = 600;
 
+        int m_cropX = 0;
+        int m_cropY = 0;
+        int m_cropWidth = 0;
+        int m_cropHeight = 0;
+
 };
 
 } // core
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+#include <miquella/core/object.h>
+#include <miquella/core/bvh.h>
+#include <miquella/core/wideBvh.h>
+#include <miquella/core/sphereKernels.h>
+#include <miquella/core/lightTree.h>
+
+namespace miquella {
+
+namespace core {
+
+class Scene;
+
+enum class PrimitiveType : uint8_t
+{
+    SPHERE = 0,
+    XY_RECTANGLE = 1,
+    XZ_RECTANGLE = 2,
+    YZ_RECTANGLE = 3,
+    OBJECT = 4          // Object of an unknown type, intersected through its virtual interface
+};
+
+// Reference to a primitive: its type and its index in the array of that type
+struct PrimitiveRef
+{
+    PrimitiveType m_type;
+    uint32_t m_index;
+};
+
+struct SphereArray
+{
+    size_t size() const { return m_radius.size(); }
+
+    std::vector<float> m_centerX;
+    std::vector<float> m_centerY;
+    std::vector<float> m_centerZ;
+    std::vector<float> m_radius;
+    std::vector<uint32_t> m_material;
+};
+
+// Axis aligned rectangles. The rectangle lies in the plane axis == m_k and
+// spans [m_a0, m_a1] x [m_b0, m_b1] over the two other axes.
+struct RectangleArray
+{
+    size_t size() const { return m_k.size(); }
+
+    std::vector<float> m_a0;
+    std::vector<float> m_a1;
+    std::vector<float> m_b0;
+    std::vector<float> m_b1;
+    std::vector<float> m_k;
+    std::vector<uint32_t> m_material;
+};
+
+// Flattened, read only version of a Scene used by the renderers.
+// Primitives are stored per type as structure of arrays, in the order of the
+// BVH leaves, and intersected without virtual calls. Hit records refer to
+// the material table of the scene by index.
+// A compiled scene is not modified after construction: the renderers share a
+// single instance between all their threads.
+class CompiledScene
+{
+public:
+    CompiledScene(){}
+    CompiledScene(const Scene& scene);
+
+    bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const;
+
+    const Material& getMaterial(uint32_t materialID) const { return *m_materials[materialID]; }
+
+    size_t getNbPrimitives() const { return m_primitives.size(); }
+
+    uint32_t getNbLights() const { return static_cast<uint32_t>(m_lights.size()); }
+    const Object& getLight(uint32_t lightID) const { return *m_lights[lightID]; }
+    const LightTree& getLightTree() const { return m_lightTree; }
+
+private:
+    bool _intersectPrimitive(const PrimitiveRef& primitive, const Ray & r, float tmin, float tmax, float& t) const;
+
+    // Closest hit among the primitives [first, first + count), consecutive
+    // spheres are tested in batches with the sphere kernel.
+    bool _intersectRange(uint32_t first, uint32_t count, const Ray & r, float tmin, float& tmax, uint32_t& closest) const;
+
+    void _fillRecord(const PrimitiveRef& primitive, const Ray & r, float t, hitRecord& record) const;
+
+public:
+    std::vector<PrimitiveRef> m_primitives;
+    SphereArray m_spheres;
+    RectangleArray m_xyRectangles;
+    RectangleArray m_xzRectangles;
+    RectangleArray m_yzRectangles;
+    std::vector<std::shared_ptr<const Object>> m_objects;
+
+    std::vector<std::shared_ptr<Material>> m_materials;
+
+    // Emitting objects of the scene (Scene::m_lights), and for each primitive its
+    // index in m_lights or NO_LIGHT
+    std::vector<std::shared_ptr<const Object>> m_lights;
+    std::vector<uint32_t> m_primitiveLights;
+
+    // Index of each primitive in Scene::m_objects
+    std::vector<uint32_t> m_primitiveObjects;
+
+    // Built over m_lights, the power of a light is its emitted luminance times its area
+    LightTree m_lightTree;
+
+    BVH m_bvh;
+    WideBVH m_wideBvh;
+    bool m_useLinear = false;
+
+    SphereKernel m_sphereKernel = intersectSpheresScalar;
+};
+
+} // core
+
+} // miquella
@@ -0,0 +1,72 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define MQ_ARCH_X86_64 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+// Kernels compiled for a specific instruction set are tagged with MQ_TARGET
+// so that the rest of the project can be built for the baseline architecture.
+// They must only be called after checking cpuFeatures().
+#if defined(__GNUC__) || defined(__clang__)
+#define MQ_TARGET(isa) __attribute__((target(isa)))
+#else
+#define MQ_TARGET(isa)
+#endif
+
+namespace miquella {
+
+namespace core {
+
+struct CPUFeatures
+{
+    bool sse41 = false;
+    bool avx2 = false;
+    bool fma = false;
+    bool avx512f = false;
+};
+
+inline CPUFeatures detectCPUFeatures()
+{
+    CPUFeatures features;
+#if defined(MQ_ARCH_X86_64) && (defined(__GNUC__) || defined(__clang__))
+    __builtin_cpu_init();
+    features.sse41 = __builtin_cpu_supports("sse4.1");
+    features.avx2 = __builtin_cpu_supports("avx2");
+    features.fma = __builtin_cpu_supports("fma");
+    features.avx512f = __builtin_cpu_supports("avx512f");
+#elif defined(MQ_ARCH_X86_64) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    features.sse41 = (info[2] & (1 << 19)) != 0;
+    features.fma = (info[2] & (1 << 12)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    // The OS must save the AVX (and AVX-512) registers on context switches
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool osAVX = (xcr0 & 0x6) == 0x6;
+    bool osAVX512 = (xcr0 & 0xe6) == 0xe6;
+    features.fma = features.fma && osAVX;
+    if(maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        features.avx2 = osAVX && (info[1] & (1 << 5)) != 0;
+        features.avx512f = osAVX512 && (info[1] & (1 << 16)) != 0;
+    }
+#endif
+    return features;
+}
+
+// Features of the host CPU, detected once.
+inline const CPUFeatures& cpuFeatures()
+{
+    static const CPUFeatures features = detectCPUFeatures();
+    return features;
+}
+
+} // core
+
+} // miquella
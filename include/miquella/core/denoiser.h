@@ -0,0 +1,112 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace miquella {
+
+namespace core {
+
+enum class DenoiseMode : uint8_t
+{
+    OFF = 0,
+    EVERY_RENDER = 1,   // After each call to render(), before the tonemapping
+    ON_WRITE = 2,       // Only when the image is written to a file
+    MAX_NB_DENOISE_MODE = 3
+};
+
+std::string to_string(DenoiseMode mode);
+
+enum class DenoiserISA : uint8_t
+{
+    SCALAR = 0,
+    AVX2 = 1,       // 8 pixels per iteration
+    AUTO = 2        // Widest kernel supported by the CPU
+};
+
+std::string to_string(DenoiserISA isa);
+
+// Edge avoiding a-trous wavelet filter (Dammertz et al., 2010). Each
+// iteration is a 5x5 B3 spline filter whose taps are 2^iteration pixels
+// apart, so a few iterations cover a large footprint. The taps are weighted
+// by the similarity of their first hit albedo, normal and depth with the
+// filtered pixel, and of their displayed luminance scaled by the noise of
+// the pixel: converged pixels are left untouched, noisy ones are smoothed
+// until an edge of the guides.
+//
+// The pixels are stored in planes so that the kernels can load 8 neighbour
+// pixels at once. The caller fills the planes with setPixel(), then runs
+// filterRows() over all the rows and endIteration() for each iteration.
+// Rows of an iteration are independent and can be filtered by several
+// threads.
+class Denoiser
+{
+public:
+    Denoiser(){ setISA(DenoiserISA::AUTO); }
+
+    void resize(int width, int height);
+
+    // Between 1 and 10, the taps of the last iteration are 512 pixels apart
+    void setNbIterations(int nbIterations){ m_nbIterations = std::clamp(nbIterations, 1, 10); }
+    int getNbIterations() const { return m_nbIterations; }
+
+    // Edge stopping: the larger the sigma, the more the filter crosses the
+    // differences of the guide. The color sigma is a number of standard
+    // errors of the pixel, the depth sigma is relative to the depth.
+    void setSigmas(float color, float normal, float albedo, float depth)
+    {
+        m_sigmaColor = color;
+        m_sigmaNormal = normal;
+        m_sigmaAlbedo = albedo;
+        m_sigmaDepth = depth;
+    }
+
+    // AUTO by default, falls back to SCALAR when the CPU lacks the instructions
+    void setISA(DenoiserISA isa);
+    DenoiserISA getISA() const { return m_isa; }
+
+    // Noisy color of a pixel, its guides and the standard error of its
+    // displayed luminance
+    void setPixel(size_t index, const glm::vec3& color, const glm::vec3& albedo, const glm::vec3& normal, float depth, float error);
+
+    // Filter the rows [y0, y1) for the given iteration
+    void filterRows(int iteration, int y0, int y1);
+
+    // Make the output of the iteration the input of the next one
+    void endIteration(){ m_current = 1 - m_current; }
+
+    // Filtered color, after the last endIteration()
+    glm::vec3 getPixel(size_t index) const
+    {
+        return glm::vec3(m_color[m_current][0][index], m_color[m_current][1][index], m_color[m_current][2][index]);
+    }
+
+public:
+    int m_width = 0;
+    int m_height = 0;
+
+    int m_nbIterations = 4;
+    float m_sigmaColor = 3.f;
+    float m_sigmaNormal = 0.2f;
+    float m_sigmaAlbedo = 0.05f;
+    float m_sigmaDepth = 0.02f;
+    DenoiserISA m_isa = DenoiserISA::SCALAR;
+
+    // Ping pong color planes and the square root of their luminance
+    int m_current = 0;
+    std::vector<float> m_color[2][3];
+    std::vector<float> m_guideLuminance[2];
+
+    std::vector<float> m_normal[3];
+    std::vector<float> m_albedo[3];
+    std::vector<float> m_depth;
+    std::vector<float> m_invColorVariance;     // 1 / (sigma color * error)^2
+};
+
+} // core
+
+} // miquella
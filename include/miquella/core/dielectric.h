@@ -18,7 +18,7 @@ public:
         Material(), m_refractionIndice(refractionIndice){};
 
 
-    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const override;
+    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const override;
 
     virtual std::shared_ptr<Material> clone() override;
 
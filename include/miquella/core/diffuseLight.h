@@ -14,12 +14,13 @@ class DiffuseLight : public Material
 public:
     DiffuseLight(const glm::vec3& color) : Material(), m_albedo(color){}
 
-    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const override
+    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const override
     {
         (void)incoming;
         (void)record;
         (void)color;
         (void)out;
+        (void)sampler;
         return false;
     }
 
@@ -28,6 +29,11 @@ public:
         return m_albedo;
     }
 
+    virtual glm::vec3 albedo() const override
+    {
+        return glm::min(m_albedo, glm::vec3(1.f, 1.f, 1.f));
+    }
+
     virtual bool isLightSource() const override
     {
         return true;
@@ -2,7 +2,8 @@
 
 #include <miquella/core/ray.h>
 
-#include <memory>
+#include <cstdint>
+#include <limits>
 
 namespace miquella
 {
@@ -10,14 +11,23 @@ namespace miquella
 namespace core
 {
 
-class Material; // forward declaration to avoid circular dependency
+// Light index of a hit record for objects which are not lights
+const uint32_t NO_LIGHT = std::numeric_limits<uint32_t>::max();
+
+// Object index of a ray which hits nothing
+const uint32_t NO_OBJECT = std::numeric_limits<uint32_t>::max();
+
+// Material index of an object which is not in a scene
+const uint32_t NO_MATERIAL = std::numeric_limits<uint32_t>::max();
 
 struct hitRecord {
     glm::vec3 p;
     glm::vec3 normal;
     float t;
     bool front_face;
-    std::shared_ptr<Material> material;
+    uint32_t materialID;    // Index in the material table of the scene
+    uint32_t lightID = NO_LIGHT;    // Index in the lights of the compiled scene
+    uint32_t objectID = NO_OBJECT;  // Index in the objects of the scene
 
     inline void setFaceNormal(const Ray& r, const glm::vec3& outward_normal) {
         front_face = glm::dot(r.direction(), outward_normal) < 0;
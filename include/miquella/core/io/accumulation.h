@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace miquella
+{
+
+namespace core
+{
+
+namespace io
+{
+
+    // Accumulation file: the unnormalized radiance sums of an image and the
+    // number of samples of each pixel, so that the partial renders of a job
+    // made by several workers can be added together. Little endian layout:
+    //
+    //   0    "MQAF", format version (uint32)
+    //   8    width, height (uint32)
+    //   16   samples per pixel requested, first sample index (uint64)
+    //   32   scene id, seed (uint32), reserved, written as 0 (2 uint32)
+    //   48   job id, 64 characters padded with 0
+    //   112  size of the whole image, position of the crop (uint32)
+    //   128  width*height*3 float32 sums, rows from the top, then
+    //        width*height uint32 sample counts
+    //
+    // The data starts at a 128 bytes offset so that a mapped file can be
+    // read with aligned vector loads.
+    struct AccumulationHeader
+    {
+        uint32_t m_width = 0;
+        uint32_t m_height = 0;
+        uint32_t m_frameWidth = 0;      // Whole image of a crop, 0 when the file is the whole image
+        uint32_t m_frameHeight = 0;
+        uint32_t m_cropX = 0;
+        uint32_t m_cropY = 0;
+        uint64_t m_nbSamples = 0;       // Samples per pixel requested, summed when merged
+        uint64_t m_firstSample = 0;     // Index of the first sample of the range
+        uint32_t m_sceneID = 0;
+        uint32_t m_seed = 0;
+        std::string m_jobID;            // At most 63 characters
+
+        size_t getNbPixels() const { return static_cast<size_t>(m_width) * m_height; }
+        uint32_t getFrameWidth() const { return m_frameWidth > 0 ? m_frameWidth : m_width; }
+        uint32_t getFrameHeight() const { return m_frameHeight > 0 ? m_frameHeight : m_height; }
+    };
+
+    constexpr uint32_t accumulationVersion = 1;
+    constexpr size_t accumulationHeaderSize = 128;
+
+    bool writeAccumulation(std::ostream& file, const AccumulationHeader& header, const float* sums, const uint32_t* samples);
+
+    // Content of the file of writeAccumulation() in buffer
+    bool encodeAccumulation(const AccumulationHeader& header, const float* sums, const uint32_t* samples, std::string& buffer);
+
+    bool readAccumulationHeader(std::istream& file, AccumulationHeader& header);
+
+    bool readAccumulation(std::istream& file, AccumulationHeader& header, std::vector<float>& sums, std::vector<uint32_t>& samples);
+
+    // Read only view of an accumulation file mapped in memory: the pages
+    // are loaded by the OS when they are first read, without copy.
+    class MappedAccumulation
+    {
+    public:
+        MappedAccumulation(){}
+        MappedAccumulation(const MappedAccumulation&) = delete;
+        MappedAccumulation& operator=(const MappedAccumulation&) = delete;
+        ~MappedAccumulation(){ close(); }
+
+        bool open(const std::string& path);
+        void close();
+        bool isOpen() const { return m_data != nullptr; }
+
+        const AccumulationHeader& getHeader() const { return m_header; }
+        const float* getSums() const { return reinterpret_cast<const float*>(m_data + accumulationHeaderSize); }
+        const uint32_t* getSamples() const { return reinterpret_cast<const uint32_t*>(m_data + accumulationHeaderSize + 3 * m_header.getNbPixels() * sizeof(float)); }
+
+    public:
+        AccumulationHeader m_header;
+        const unsigned char* m_data = nullptr;
+        size_t m_size = 0;
+#if defined(_WIN32)
+        void* m_file = nullptr;
+        void* m_mapping = nullptr;
+#endif
+    };
+
+    // Add the accumulation files inputs into output. The inputs must have
+    // the same size, crop, scene and job. They are mapped and summed one
+    // block at a time, so the working set stays in cache whatever their
+    // number.
+    // output may be one of the inputs, it is replaced once complete.
+    bool mergeAccumulations(const std::vector<std::string>& inputs, const std::string& output);
+
+    // Stitch crops of the same image into an accumulation of the whole
+    // image. The crops may overlap or cover the same window with different
+    // samples, their sums are added. The pixels covered by no crop have no
+    // samples. The output is built one row at a time and may be one of
+    // the inputs.
+    bool assembleAccumulations(const std::vector<std::string>& inputs, const std::string& output);
+
+    // Displayed 8 bits RGBA image of an accumulation
+    std::vector<unsigned char> tonemapAccumulation(const AccumulationHeader& header, const float* sums, const uint32_t* samples);
+
+} // io
+
+} // core
+
+} // miquella
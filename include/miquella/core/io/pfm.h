@@ -0,0 +1,50 @@
+#pragma once
+
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <bit>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+namespace miquella
+{
+
+namespace core
+{
+
+namespace io
+{
+
+    // Portable float map: "PF" for 3 channels, "Pf" for 1 channel, then the
+    // size and a scale whose sign gives the endianness of the floats. The
+    // rows are stored from the bottom of the image to the top. image holds
+    // w*h pixels of nbChannels floats, top row first.
+    static bool writePFM(std::ofstream& file, int w, int h, int nbChannels, const std::vector<float>& image)
+    {
+        if(nbChannels != 1 && nbChannels != 3)
+        {
+            std::cerr << "ERROR: PFM images have 1 or 3 channels, got " << nbChannels << ".\n";
+            return false;
+        }
+
+        bool littleEndian = std::endian::native == std::endian::little;
+        file << (nbChannels == 3 ? "PF" : "Pf") << '\n' << w << ' ' << h << '\n' << (littleEndian ? "-1.0" : "1.0") << '\n';
+
+        auto rowSize = static_cast<size_t>(w * nbChannels);
+        for (int j = h - 1; j >= 0; --j)
+            file.write(reinterpret_cast<const char*>(image.data() + static_cast<size_t>(j) * rowSize), static_cast<std::streamsize>(rowSize * sizeof(float)));
+
+        file.close();
+        return true;
+    }
+
+} // io
+
+
+} // core
+
+} // miquella
+
+#pragma GCC diagnostic pop
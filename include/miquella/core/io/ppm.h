@@ -1,7 +1,10 @@
 #pragma once
 
+#include <array>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <string>
 #include <vector>
 
 #pragma GCC diagnostic push
@@ -23,20 +26,47 @@ namespace io
         std::vector<unsigned char> image;
     };
 
-    static void writePPM(std::ofstream& file, int w, int h, const std::vector<unsigned char>& image)
+    // ASCII PPM (P3) of the RGBA image in buffer, one "r g b" line per
+    // pixel. The values are copied from a table instead of being formatted
+    // one by one.
+    static void encodePPM(int w, int h, const std::vector<unsigned char>& image, std::string& buffer)
     {
-        file << "P3\n" << w << ' ' << h << "\n255\n";
-
-        for (int j = 0; j < h; ++j) 
+        static const auto digits = []
         {
-            for (int i = 0; i < w; ++i) 
+            std::array<std::array<char, 4>, 256> table{};
+            for(int v = 0; v < 256; ++v)
             {
-                auto index = static_cast<size_t>(j*w*4 + i*4);
+                auto text = std::to_string(v);
+                table[static_cast<size_t>(v)][0] = static_cast<char>(text.size());
+                std::copy(text.begin(), text.end(), table[static_cast<size_t>(v)].begin() + 1);
+            }
+            return table;
+        }();
 
-                file << std::to_string(image[index]) << ' ' << std::to_string(image[index+1]) << ' ' << std::to_string(image[index+2]) << '\n';
+        buffer = "P3\n" + std::to_string(w) + ' ' + std::to_string(h) + "\n255\n";
+        size_t offset = buffer.size();
+        buffer.resize(offset + static_cast<size_t>(w) * static_cast<size_t>(h) * 12);
+
+        char* out = buffer.data() + offset;
+        auto nbPixels = static_cast<size_t>(w*h);
+        for(size_t index = 0; index < nbPixels; ++index)
+        {
+            for(size_t c = 0; c < 3; ++c)
+            {
+                const auto& value = digits[image[4*index + c]];
+                std::memcpy(out, value.data() + 1, 3);
+                out += value[0];
+                *out++ = c == 2 ? '\n' : ' ';
             }
         }
+        buffer.resize(static_cast<size_t>(out - buffer.data()));
+    }
 
+    static void writePPM(std::ofstream& file, int w, int h, const std::vector<unsigned char>& image)
+    {
+        std::string buffer;
+        encodePPM(w, h, image, buffer);
+        file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
         file.close();
     }
 
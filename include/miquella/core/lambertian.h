@@ -14,10 +14,10 @@ class Lambertian : public Material
 public:
     Lambertian(const glm::vec3& color) : Material(), m_albedo(color){}
 
-    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const override
+    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const override
     {
         (void)incoming;
-        auto direction = record.normal + randomUnitVec3();
+        auto direction = record.normal + sampleUnitSphere(sampler.get2D());
 
         // Catch degenerate case (See RayTracingInOneWeekend Section 9.3)
         if(nearZeroVec3(direction))
@@ -29,6 +29,30 @@ public:
         return true;
     }
 
+    virtual bool isSpecular() const override
+    {
+        return false;
+    }
+
+    // scatter() samples the directions proportionally to the cosine
+    virtual glm::vec3 evaluate(const Ray & incoming, const hitRecord& record, const glm::vec3& out) const override
+    {
+        (void)incoming;
+        float cosine = glm::dot(record.normal, glm::normalize(out));
+        return cosine > 0.f ? m_albedo * (cosine / pi) : glm::vec3(0.f, 0.f, 0.f);
+    }
+
+    virtual float pdf(const Ray & incoming, const hitRecord& record, const glm::vec3& out) const override
+    {
+        (void)incoming;
+        return std::max(glm::dot(record.normal, glm::normalize(out)), 0.f) / pi;
+    }
+
+    virtual glm::vec3 albedo() const override
+    {
+        return m_albedo;
+    }
+
     virtual std::shared_ptr<Material> clone() override
     {
         return std::make_shared<Lambertian>(m_albedo);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <string>
+
+#include <miquella/core/aabb.h>
+
+namespace miquella {
+
+namespace core {
+
+enum class LightSelection : uint8_t
+{
+    UNIFORM = 0,    // Every light with the same probability
+    TREE = 1        // Light tree traversed according to the estimated contribution
+};
+
+std::string to_string(LightSelection selection);
+
+// Node of the light tree, stored depth first like BVHNode: the first child of
+// an interior node is the next node, the second child is stored at m_offset.
+// For leaves, m_offset is the index of the light.
+struct LightTreeNode
+{
+    AABB m_box;
+    float m_power = 0.f;    // Sum of the power of the lights below the node
+    uint32_t m_offset = 0;
+    bool m_leaf = false;
+
+    bool isLeaf() const { return m_leaf; }
+};
+
+// Binary hierarchy over the lights of a scene, one light per leaf. A light
+// is selected by walking down from the root and choosing each child with a
+// probability proportional to an estimate of its contribution at the
+// shading point: power over squared distance, and zero when the node is
+// entirely behind the surface (Conty Estevez and Kulla, "Importance
+// Sampling of Many Lights with Adaptive Tree Splitting", 2018, without the
+// orientation cones). The traversal costs O(log n) instead of O(1) for the
+// uniform selection, but lights close to the point are chosen much more often.
+class LightTree
+{
+public:
+    LightTree(){}
+
+    // boxes and powers are given per light, the light indices are their
+    // positions in these arrays
+    void build(const std::vector<AABB>& boxes, const std::vector<float>& powers);
+
+    void clear()
+    {
+        m_nodes.clear();
+        m_lightPaths.clear();
+    }
+
+    bool isEmpty() const { return m_nodes.empty(); }
+
+    // Select a light for the point p of normal n. Returns false when no light
+    // can contribute, otherwise pmf is the probability of the selected light.
+    bool sample(const glm::vec3& p, const glm::vec3& n, float u, uint32_t& light, float& pmf) const;
+
+    // Probability of sample() selecting light at the point p of normal n
+    float pmf(const glm::vec3& p, const glm::vec3& n, uint32_t light) const;
+
+public:
+    std::vector<LightTreeNode> m_nodes;
+
+    // Choices from the root to the leaf of each light: bit d is set when the
+    // second child is taken at depth d. The tree is balanced, its depth is at
+    // most 32.
+    std::vector<uint64_t> m_lightPaths;
+
+private:
+    uint32_t _buildRecursive(const std::vector<AABB>& boxes, const std::vector<float>& powers, std::vector<uint32_t>& lights, uint32_t begin, uint32_t end, uint32_t depth, uint64_t path);
+
+    float _importance(const LightTreeNode& node, const glm::vec3& p, const glm::vec3& n) const;
+};
+
+} // core
+
+} // miquella
@@ -1,8 +1,11 @@
 #pragma once
 
 
+#include <memory>
+
 #include <miquella/core/ray.h>
 #include <miquella/core/hit.h>
+#include <miquella/core/sampler.h>
 
 namespace miquella
 {
@@ -19,7 +22,42 @@ public:
 
     virtual ~Material(){}
 
-    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const = 0;
+    // Random numbers are drawn from sampler, which is set to the current bounce
+    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const = 0;
+
+    // Specular materials (mirrors, glass, and also fuzzy metals) scatter in
+    // directions that only scatter() can produce. The others provide the
+    // value and the density of their scattering for any direction, which
+    // lets the renderer combine scatter() with light sampling.
+    virtual bool isSpecular() const
+    {
+        return true;
+    }
+
+    // BSDF times the cosine between the normal and out
+    virtual glm::vec3 evaluate(const Ray & incoming, const hitRecord& record, const glm::vec3& out) const
+    {
+        (void)incoming;
+        (void)record;
+        (void)out;
+        return glm::vec3(0.f, 0.f, 0.f);
+    }
+
+    // Density of scatter() producing the direction out, with respect to the solid angle
+    virtual float pdf(const Ray & incoming, const hitRecord& record, const glm::vec3& out) const
+    {
+        (void)incoming;
+        (void)record;
+        (void)out;
+        return 0.f;
+    }
+
+    // Color of the surface in the first hit buffers of the renderer, used
+    // to guide the denoiser. White for materials without a base color.
+    virtual glm::vec3 albedo() const
+    {
+        return glm::vec3(1.f, 1.f, 1.f);
+    }
 
     virtual glm::vec3 emitted() const
     {
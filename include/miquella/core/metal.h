@@ -19,7 +19,12 @@ public:
         m_fuzz = std::clamp(fuzz, 0.f, 1.f);
     }
 
-    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const override;
+    virtual bool scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const override;
+
+    virtual glm::vec3 albedo() const override
+    {
+        return m_albedo;
+    }
 
     virtual std::shared_ptr<Material> clone() override;
 
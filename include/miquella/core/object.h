@@ -1,9 +1,11 @@
 #pragma once
 
+#include <cassert>
 #include <memory>
 
 #include <miquella/core/ray.h>
 #include <miquella/core/hit.h>
+#include <miquella/core/aabb.h>
 
 #include <miquella/core/material.h>
 
@@ -11,6 +13,14 @@ namespace miquella {
 
 namespace core {
 
+// Point sampled on the surface of an object, as seen from a reference point
+struct SurfaceSample
+{
+    glm::vec3 p;
+    glm::vec3 normal;
+    float pdf;      // Density with respect to the solid angle around the reference point
+};
+
 class Object {
 
 public:
@@ -19,10 +29,38 @@ public:
 
     virtual ~Object(){}
 
-    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) = 0;
+    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const = 0;
+
+    // Bounding box of the object, used to build the acceleration structures.
+    virtual AABB boundingBox() const = 0;
+
+    // Sample a point of the surface as seen from origin, used to sample the
+    // lights. Returns false when the object cannot be sampled.
+    virtual bool sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const
+    {
+        (void)origin;
+        (void)u;
+        (void)sample;
+        return false;
+    }
+
+    // Density of sample() at the point p of normal n, with respect to the
+    // solid angle around origin
+    virtual float pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const
+    {
+        (void)origin;
+        (void)p;
+        (void)normal;
+        return 0.f;
+    }
+
+    virtual float area() const { return 0.f; }
 
+    // Only before the object is added to a scene, which stores the index of
+    // the material. Use Scene::setMaterial() afterwards.
     void setMaterial(std::shared_ptr<Material> material)
     {
+        assert(m_materialID == NO_MATERIAL && "Use Scene::setMaterial() once the object is in a scene");
         m_material = material;
     }
 
@@ -39,6 +77,9 @@ public:
 
 public:
     std::shared_ptr<Material> m_material;
+
+    // Index of m_material in the material table of the scene, assigned by Scene::addObject
+    uint32_t m_materialID = NO_MATERIAL;
 };
 
 } // core
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <array>
+
+namespace miquella {
+
+namespace core {
+
+// Philox4x32-10 counter based generator (Salmon et al., "Parallel random
+// numbers: as easy as 1, 2, 3"). Maps a 128 bits counter and a 64 bits key
+// to 128 random bits. There is no state: the same counter always gives the
+// same numbers.
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key)
+{
+    for(int round = 0; round < 10; ++round)
+    {
+        uint64_t product0 = static_cast<uint64_t>(0xD2511F53u) * counter[0];
+        uint64_t product1 = static_cast<uint64_t>(0xCD9E8D57u) * counter[2];
+        auto hi0 = static_cast<uint32_t>(product0 >> 32);
+        auto lo0 = static_cast<uint32_t>(product0);
+        auto hi1 = static_cast<uint32_t>(product1 >> 32);
+        auto lo1 = static_cast<uint32_t>(product1);
+
+        counter = { hi1 ^ counter[1] ^ key[0], lo1, hi0 ^ counter[3] ^ key[1], lo0 };
+        key[0] += 0x9E3779B9u;
+        key[1] += 0xBB67AE85u;
+    }
+    return counter;
+}
+
+// Float in [0, 1) from the 24 high bits of a random integer
+inline float uintToFloat(uint32_t value)
+{
+    return static_cast<float>(value >> 8) * 0x1p-24f;
+}
+
+// Random numbers of one sample of one pixel. The n-th number drawn during a
+// bounce is a function of (seed, pixel, sample, bounce, n) only, so an image
+// does not depend on which thread rendered which pixel, nor in which order.
+// Numbers are generated by blocks of 4 dimensions.
+class PixelRNG
+{
+public:
+    PixelRNG(uint32_t pixel, uint32_t sample, uint32_t seed = 0) :
+        m_pixel(pixel), m_sample(sample), m_seed(seed){}
+
+    // Start the numbers of a new bounce, the camera uses bounce 0
+    void setBounce(uint32_t bounce)
+    {
+        m_bounce = bounce;
+        m_dimension = 0;
+    }
+
+    uint32_t nextUInt()
+    {
+        uint32_t lane = m_dimension & 3u;
+        if(lane == 0)
+            m_block = philox4x32({ m_pixel, m_sample, m_bounce, m_dimension >> 2 }, { m_seed, 0x6D697175u });
+        ++m_dimension;
+        return m_block[lane];
+    }
+
+    // Uniform float in [0, 1)
+    float nextFloat() { return uintToFloat(nextUInt()); }
+
+    float nextFloat(float minValue, float maxValue)
+    {
+        return minValue + (maxValue - minValue)*nextFloat();
+    }
+
+private:
+    uint32_t m_pixel;
+    uint32_t m_sample;
+    uint32_t m_seed;
+    uint32_t m_bounce = 0;
+    uint32_t m_dimension = 0;
+    std::array<uint32_t, 4> m_block = {};
+};
+
+// Small sequential generator (PCG32, O'Neill), used to build procedural
+// scenes. Unlike std::mt19937 it fits in 16 bytes and is cheap to seed.
+class PCG32
+{
+public:
+    PCG32(uint64_t seed = 0x853C49E6748FEA9Bull) { setSeed(seed); }
+
+    void setSeed(uint64_t seed)
+    {
+        m_state = 0u;
+        nextUInt();
+        m_state += seed;
+        nextUInt();
+    }
+
+    uint32_t nextUInt()
+    {
+        uint64_t old = m_state;
+        m_state = old * 6364136223846793005ull + m_increment;
+        auto xorShifted = static_cast<uint32_t>(((old >> 18u) ^ old) >> 27u);
+        auto rot = static_cast<uint32_t>(old >> 59u);
+        return (xorShifted >> rot) | (xorShifted << ((32u - rot) & 31u));
+    }
+
+    float nextFloat() { return uintToFloat(nextUInt()); }
+
+private:
+    uint64_t m_state = 0u;
+    uint64_t m_increment = 0xDA3E39CB94B95BDBull;
+};
+
+} // core
+
+} // miquella
@@ -8,6 +8,10 @@ namespace miquella {
 
 namespace core {
 
+// Rectangles have no thickness, their bounding boxes are padded along the
+// normal axis so that the slab test remains well defined.
+const float RECTANGLE_BOX_PADDING = 0.0001f;
+
 class xyRectangle : public Object
 {
 public:
@@ -17,7 +21,15 @@ public:
 
     virtual std::shared_ptr<Object> clone() override;
 
-    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) override;
+    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const override;
+
+    virtual AABB boundingBox() const override;
+
+    virtual bool sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const override;
+
+    virtual float pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const override;
+
+    virtual float area() const override;
 
 public:
     float m_x0;
@@ -34,10 +46,18 @@ public:
     xzRectangle(float x0, float x1, float z0, float z1, float y, std::shared_ptr<Material> mat) :
         Object(mat), m_x0(x0), m_x1(x1), m_z0(z0), m_z1(z1), m_y(y){};
 
-    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) override;
+    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const override;
 
     virtual std::shared_ptr<Object> clone() override;
 
+    virtual AABB boundingBox() const override;
+
+    virtual bool sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const override;
+
+    virtual float pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const override;
+
+    virtual float area() const override;
+
 public:
     float m_x0;
     float m_x1;
@@ -53,10 +73,18 @@ public:
     yzRectangle(float y0, float y1, float z0, float z1, float x, std::shared_ptr<Material> mat) :
         Object(mat), m_y0(y0), m_y1(y1), m_z0(z0), m_z1(z1), m_x(x){};
 
-    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) override;
+    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const override;
 
     virtual std::shared_ptr<Object> clone() override;
 
+    virtual AABB boundingBox() const override;
+
+    virtual bool sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const override;
+
+    virtual float pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const override;
+
+    virtual float area() const override;
+
 public:
     float m_y0;
     float m_y1;
@@ -6,13 +6,19 @@
 #include <miquella/core/simpleCamera.h>
 #include <miquella/core/scene.h>
 #include <miquella/core/utility.h>
+#include <miquella/core/sampler.h>
+#include <miquella/core/denoiser.h>
+#include <miquella/core/tonemap.h>
 
 #include <numeric>
 #include <chrono>
 #include <algorithm>
+#include <functional>
 #include <string.h>
 
 #include <miquella/core/io/ppm.h>
+#include <miquella/core/io/pfm.h>
+#include <miquella/core/io/accumulation.h>
 
 namespace miquella
 {
@@ -20,6 +26,35 @@ namespace miquella
 namespace core
 {
 
+// Auxiliary output buffers, recorded from the first hit of the camera rays
+enum class AOV : uint8_t
+{
+    ALBEDO = 0,         // Average albedo of the first hit materials, background color for misses
+    NORMAL = 1,         // Average shading normal, facing the camera
+    DEPTH = 2,          // Average distance to the camera, 0 for misses
+    OBJECT_ID = 3,      // Index in Scene::m_objects of the object hit by the last sample, -1 for misses
+    SAMPLE_COUNT = 4,   // Number of samples of the pixel
+    MAX_NB_AOV = 5
+};
+
+std::string to_string(AOV aov);
+
+// Number of floats per pixel of an AOV image
+inline int getNbChannels(AOV aov)
+{
+    return aov == AOV::ALBEDO || aov == AOV::NORMAL ? 3 : 1;
+}
+
+// What the camera ray of a sample hits first. A ray leaving the scene gets
+// the background color, a zero normal, a zero depth and NO_OBJECT.
+struct FirstHit
+{
+    glm::vec3 m_albedo;
+    glm::vec3 m_normal;
+    float m_depth;
+    uint32_t m_objectID;
+};
+
 class Renderer
 {
 public:
@@ -36,6 +71,123 @@ public:
 
     void setBackground(const Background& b){ m_background = b; }
 
+    // Maximum number of bounces of a path
+    void setMaxDepth(int maxDepth){ m_maxDepth = std::max(maxDepth, 1); }
+    int getMaxDepth() const { return m_maxDepth; }
+
+    // Terminate paths randomly once they reach minDepth bounces, with a
+    // probability based on their throughput. Surviving paths are reweighted
+    // so the estimate stays unbiased.
+    void setRussianRoulette(bool enabled, int minDepth = 3)
+    {
+        m_russianRoulette = enabled;
+        m_russianRouletteMinDepth = std::max(minDepth, 1);
+    }
+    bool getRussianRoulette() const { return m_russianRoulette; }
+
+    // Next event estimation: at each diffuse bounce, sample a point on a
+    // light of the scene and combine it with the scattered ray through
+    // multiple importance sampling (power heuristic).
+    void setNextEventEstimation(bool enabled){ m_nextEventEstimation = enabled; }
+    bool getNextEventEstimation() const { return m_nextEventEstimation; }
+
+    // How next event estimation chooses the light to sample
+    void setLightSelection(LightSelection selection){ m_lightSelection = selection; }
+    LightSelection getLightSelection() const { return m_lightSelection; }
+
+    // Key of the random numbers. Renders with the same seed are identical,
+    // whatever the number of threads.
+    void setSeed(uint32_t seed){ m_seed = seed; }
+    uint32_t getSeed() const { return m_seed; }
+
+    // Index of the first sample of each pixel. Workers sharing a job render
+    // disjoint ranges of the sample indices of the same seed, so that their
+    // accumulations are uncorrelated and sum to the image of a single render.
+    void setFirstSample(size_t firstSample){ m_firstSample = firstSample; }
+    size_t getFirstSample() const { return m_firstSample; }
+
+    // Generator of the numbers of the samples: pixel jitter and bounces
+    void setSampler(SamplerType type){ m_samplerType = type; }
+    SamplerType getSampler() const { return m_samplerType; }
+
+    // Adaptive sampling: once a pixel has minSamples samples, it stops
+    // receiving samples while the standard error of its displayed value, and
+    // of the values of its 8 neighbours, is below threshold. The error is
+    // estimated after each call to render() from the second moment of the
+    // luminance of the samples.
+    void setAdaptiveSampling(bool enabled, float threshold = 0.01f, size_t minSamples = 16)
+    {
+        m_adaptiveSampling = enabled;
+        m_adaptiveThreshold = threshold;
+        m_adaptiveMinSamples = std::max(minSamples, size_t(2));
+    }
+    bool getAdaptiveSampling() const { return m_adaptiveSampling; }
+
+    // Number of pixels which still receive samples
+    size_t getNbActivePixels() const { return m_nbActivePixels; }
+
+    // Number of samples traced over all the pixels since the last reset
+    size_t getNbSamplesTraced() const
+    {
+        return std::accumulate(m_pixelSamples.begin(), m_pixelSamples.end(), size_t(0));
+    }
+
+    // Estimate of the RMSE of the displayed image against the converged
+    // image, from the difference between the averages of the even and odd
+    // samples of each pixel. Each half has half the samples, so half their
+    // difference has the standard deviation of the full average.
+    float estimateError() const;
+
+    // Record an AOV during the next calls to render(). The buffer of an AOV
+    // is only allocated and written while it is enabled, enabling it again
+    // starts from an empty buffer. Set before rendering.
+    void setAOV(AOV aov, bool enabled);
+    bool isAOVEnabled(AOV aov) const { return (m_aovs & (1u << static_cast<uint32_t>(aov))) != 0; }
+
+    // Image of an enabled AOV, getNbChannels(aov) floats per pixel, top row
+    // first. Empty when the AOV is disabled.
+    std::vector<float> getAOV(AOV aov) const;
+
+    // Write an enabled AOV as a PFM float image
+    bool writeAOV(AOV aov, const std::string& path) const;
+
+    // Write the unnormalized radiance sums and the per pixel sample counts,
+    // to be merged with the renders of the same job by other workers. The
+    // size, crop window, number of samples, first sample and seed of header
+    // are set from the renderer.
+    bool writeAccumulation(const std::string& path, io::AccumulationHeader header) const;
+
+    // Content of the file of writeAccumulation(), in memory
+    bool encodeAccumulation(std::string& buffer, io::AccumulationHeader header) const;
+
+    // Denoise the image with an edge avoiding filter guided by the albedo,
+    // normal and depth of the first hits, either after each call to render()
+    // or only when the image is written. The guides are recorded while the
+    // mode is not OFF, so it must be set before rendering.
+    void setDenoising(DenoiseMode mode);
+    DenoiseMode getDenoising() const { return m_denoiseMode; }
+
+    // Settings of the filter: iterations, edge stopping, instruction set
+    Denoiser& getDenoiser(){ return m_denoiser; }
+
+    // Filter the accumulated radiance and replace the displayed image with
+    // the result. The accumulation buffers are not modified, the next
+    // samples are added to the noisy image.
+    void denoise()
+    {
+        if(_denoise(m_image))
+            m_imageDirty = false;
+    }
+
+    // Duration of the last denoising, in ms
+    double getDenoiseTime() const { return m_denoiseTime; }
+
+    // Average of the samples of a pixel
+    glm::vec3 getPixelRadiance(size_t index) const
+    {
+        return m_pixelSamples[index] > 0 ? m_imageAccumulated[index] / static_cast<float>(m_pixelSamples[index]) : glm::vec3(0.f, 0.f, 0.f);
+    }
+
     virtual void updateImageFromCamera();
 
     void setScene(std::shared_ptr<Scene> scene){ m_scene = scene; }
@@ -76,37 +228,186 @@ public:
         }
     }
 
-    glm::vec3 processRay(const Ray& r, int maxDepth) const
+    glm::vec3 processRay(const Ray& r, int maxDepth, Sampler& sampler) const
+    {
+        return processRay(r, maxDepth, *m_scene->getCompiledScene(), sampler);
+    }
+
+    // Radiance carried back along the ray, following the path for at most
+    // maxDepth bounces. Bounce b draws its numbers from sampler set to b+1.
+    // When firstHit is given, it receives what the camera ray hits.
+    glm::vec3 processRay(const Ray& r, int maxDepth, const CompiledScene& scene, Sampler& sampler, FirstHit* firstHit = nullptr) const;
+
+    // Add one sample per pixel to the image
+    void render(){ render(1); }
+
+    // Add spp samples per pixel to the image. The displayed image is
+    // updated once, after all the samples of the call.
+    virtual void render(size_t spp);
+
+    // Displayed 8 bits RGBA image. It is converted from the accumulated
+    // radiance here, only when samples were added since the last request.
+    unsigned char* getImagePointer()
     {
-        return processRay(r, maxDepth, m_scene);
+        _updateImage();
+        return m_image.data();
     }
 
+    // Instruction set of the conversion to the displayed image
+    void setTonemapISA(TonemapISA isa){ m_tonemapKernel = getTonemapKernel(isa); }
+
+    // Size of the rendered image, the crop window of the camera when it has one
+    int getImageWidth() const { return m_width; }
+    int getImageHeight() const { return m_height; }
+
+    // Write the displayed image, denoised first with DenoiseMode::ON_WRITE
+    void writeToPPM(const std::string& path);
+
+    // Content of the file of writeToPPM(), in memory
+    void encodePPM(std::string& buffer);
+
+    // Copy of the RGBA image of writeToPPM(), to be encoded after the next
+    // samples are started
+    void getOutputImage(std::vector<unsigned char>& image);
+
+protected:
+    // Light arriving at the hit point rec from a point sampled on one of the
+    // lights, weighted for the combination with the scattered ray
+    glm::vec3 _sampleLight(const Ray& incoming, const hitRecord& rec, const Material& material, const CompiledScene& scene, Sampler& sampler) const;
+
+    // Choose a light for the point p of normal n, pmf is its probability
+    bool _selectLight(const CompiledScene& scene, const glm::vec3& p, const glm::vec3& n, float u, uint32_t& lightID, float& pmf) const;
+
+    // Probability of _selectLight() choosing lightID
+    float _lightSelectionPmf(const CompiledScene& scene, const glm::vec3& p, const glm::vec3& n, uint32_t lightID) const;
 
-    glm::vec3 processRay(const Ray& r, int maxDepth, const std::shared_ptr<Scene> scene) const;
+    // Trace spp samples for the pixel (i, j) and update the accumulation
+    // buffers and the image. Pixels stopped by the adaptive sampling are skipped.
+    void _renderPixel(int i, int j, size_t spp, const CompiledScene& scene, Sampler& sampler);
 
-    virtual void render();
+    // Estimate the error of each pixel and choose the pixels of the next call
+    void _updateConvergence();
 
-    unsigned char* getImagePointer(){ return m_image.data(); }
-    int getImageWidth() const { return m_camera->getImageWidth(); }
-    int getImageHeight() const { return m_camera->getImageHeight(); }
+    // Standard error of the displayed luminance of a pixel, infinite with
+    // less than 2 samples
+    float _pixelDisplayError(size_t index) const;
 
-    void writeToPPM(const std::string& path) const;
+    // Run task over the rows [y0, y1) covering [0, nbRows), in parallel when
+    // the renderer has threads
+    virtual void _parallelRows(int nbRows, const std::function<void(int, int)>& task){ task(0, nbRows); }
+
+    // Filter the accumulated radiance into the 8 bits image. Returns false
+    // when the guides are not recorded.
+    bool _denoise(std::vector<unsigned char>& image);
+
+    // Convert the accumulated radiance to m_image if it changed since the
+    // last conversion
+    void _updateImage();
+
+    // Image to write: when the mode is DenoiseMode::ON_WRITE, the image is
+    // denoised into denoised and returned, m_image is returned otherwise
+    const std::vector<unsigned char>& _outputImage(std::vector<unsigned char>& denoised);
+
+    // Size, crop, samples and seed of the accumulation of the renderer
+    void _fillAccumulationHeader(io::AccumulationHeader& header) const;
+
+    // Albedo, normal and depth are recorded for the AOVs or for the denoiser
+    bool _isAOVRecorded(AOV aov) const;
+
+    // Allocate the buffers of the recorded AOVs and free the others
+    void _updateAOVBuffers();
+
+    // Start the sample s of the pixel (i, j) and return the camera ray
+    // through the point of the pixel given by bounce 0 of the sampler
+    Ray _generateCameraRay(int i, int j, size_t s, Sampler& sampler) const
+    {
+        // (i, j) are in the crop window, the sampler and the camera use the
+        // pixel of the whole image
+        int x = i + m_cropX;
+        int y = j + m_cropY;
+        sampler.startPixelSample(static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(s));
+        glm::vec2 jitter = sampler.get2D();
+        float u = (static_cast<float>(x) + jitter.x) / static_cast<float>(m_frameWidth - 1);
+        float v = (static_cast<float>(m_frameHeight - y - 1) + jitter.y) / static_cast<float>(m_frameHeight - 1);   // The camera (0,0) is bottom left, the texture is (0,0) is top left
+        return m_camera->generateRay(u, v);
+    }
+
+    // Convert a radiance to a gamma corrected 8 bits pixel, like the tonemap kernels
+    static void _tonemapColor(const glm::vec3& radiance, unsigned char* rgba)
+    {
+        // Gamma correction
+        auto r = sqrtf(radiance.x);
+        auto g = sqrtf(radiance.y);
+        auto b = sqrtf(radiance.z);
+
+        int ir = static_cast<int>(256.f * std::clamp(r, 0.0f, 0.999f));
+        int ig = static_cast<int>(256.f * std::clamp(g, 0.0f, 0.999f));
+        int ib = static_cast<int>(256.f * std::clamp(b, 0.0f, 0.999f));
+
+        rgba[0] = static_cast<unsigned char>(ir);
+        rgba[1] = static_cast<unsigned char>(ig);
+        rgba[2] = static_cast<unsigned char>(ib);
+        rgba[3] = static_cast<unsigned char>(255);
+    }
 
 public:
     std::shared_ptr<Scene> m_scene;
     std::shared_ptr<Camera> m_camera;
 
     std::vector<unsigned char> m_image;
+    bool m_imageDirty = false;      // Samples were added since m_image was computed
+    TonemapKernel m_tonemapKernel = getTonemapKernel();
     std::vector<glm::vec3> m_imageAccumulated;
-    int m_width = 0;
+    int m_width = 0;            // Size of the buffers, the crop window of the camera
     int m_height = 0;
+    int m_cropX = 0;            // Position of the crop window in the whole image
+    int m_cropY = 0;
+    int m_frameWidth = 0;       // Size of the whole image
+    int m_frameHeight = 0;
 
     size_t m_executionTime = 0;
 
     bool accumulate = true;
-    size_t m_nbFrameAccumulated = 1;
+    size_t m_nbFrameAccumulated = 1;     // Number of calls to render(), starting at 1
+    size_t m_nbSamplesAccumulated = 0;   // Number of samples per pixel requested, pixels stopped by the adaptive sampling have fewer
+
+    // Per pixel statistics: number of samples, sums of the luminance and of
+    // the squared luminance of the samples, error of the displayed value and
+    // whether the pixel receives the samples of the next call. The moments
+    // are summed in double, in float their variance cancels out after many
+    // samples.
+    std::vector<uint32_t> m_pixelSamples;
+    std::vector<double> m_luminanceAccumulated;
+    std::vector<double> m_luminanceSquaredAccumulated;
+    std::vector<glm::vec3> m_imageOddAccumulated;     // Sum of the samples of odd index, for estimateError()
+    std::vector<float> m_pixelError;
+    std::vector<uint8_t> m_pixelActive;
+    size_t m_nbActivePixels = 0;
+
+    // First hits of the samples, only allocated when their AOV is recorded.
+    // The sample count AOV is m_pixelSamples.
+    uint32_t m_aovs = 0;     // Bit i is set when AOV i is enabled
+    std::vector<glm::vec3> m_albedoAccumulated;
+    std::vector<glm::vec3> m_normalAccumulated;
+    std::vector<float> m_depthAccumulated;
+    std::vector<uint32_t> m_objectIDs;
+    Denoiser m_denoiser;
+    double m_denoiseTime = 0.0;
 
     Background m_background;
+
+    int m_maxDepth = 5;
+    bool m_russianRoulette = false;
+    int m_russianRouletteMinDepth = 3;
+    bool m_nextEventEstimation = false;
+    LightSelection m_lightSelection = LightSelection::TREE;
+    uint32_t m_seed = 0;
+    size_t m_firstSample = 0;
+    SamplerType m_samplerType = SamplerType::INDEPENDENT;
+    bool m_adaptiveSampling = false;
+    float m_adaptiveThreshold = 0.01f;
+    size_t m_adaptiveMinSamples = 16;
+    DenoiseMode m_denoiseMode = DenoiseMode::OFF;
 };
 
 } // core
@@ -3,6 +3,7 @@
 #include <miquella/core/renderer.h>
 
 #include <algorithm>
+#include <atomic>
 #include <BS_thread_pool.hpp>
 //#include <execution>  // Not available with gcc8/9
 #include <chrono>
@@ -15,12 +16,46 @@ namespace miquella
 namespace core
 {
 
+// How the image is split between the threads of the pool
+enum class Scheduling : uint8_t
+{
+    COLUMNS = 0,    // m_nbBlocks tasks, each rendering every m_nbBlocks-th pixel column
+    TILES = 1       // Square tiles handed out one at a time through an atomic counter
+};
+
+std::string to_string(Scheduling scheduling);
+
+// Order in which the tiles are handed out to the threads. The space filling
+// curves keep consecutive tiles close in the image, so the threads trace
+// rays through the same regions of the scene at the same time.
+enum class TileOrder : uint8_t
+{
+    ROW_MAJOR = 0,
+    MORTON = 1,
+    HILBERT = 2
+};
+
+std::string to_string(TileOrder order);
+
+// Pixels [m_x0, m_x1) x [m_y0, m_y1) of the image
+struct Tile
+{
+    int m_x0;
+    int m_y0;
+    int m_x1;
+    int m_y1;
+};
+
 class RendererThreads : public Renderer
 {
 public:
     RendererThreads() : Renderer(){}
     RendererThreads(std::shared_ptr<Scene> scene, std::shared_ptr<Camera> camera, uint32_t poolSize = 1) :
-        Renderer(scene, camera), m_pool(poolSize), m_nbThreads(poolSize), m_nbBlocks(2*poolSize){}
+        Renderer(scene, camera), m_pool(poolSize), m_nbThreads(poolSize), m_nbBlocks(2*poolSize)
+    {
+        // The base constructor cannot reach the override of updateImageFromCamera
+        _updateTiles();
+    }
 
     virtual ~RendererThreads(){  }
 
@@ -38,16 +73,39 @@ public:
         m_nbBlocks = nbBlocks;
     }
 
+    void setScheduling(Scheduling scheduling){ m_scheduling = scheduling; }
+
+    void setTileSize(int tileSize)
+    {
+        m_tileSize = std::max(tileSize, 1);
+        _updateTiles();
+    }
+
+    void setTileOrder(TileOrder order)
+    {
+        m_tileOrder = order;
+        _updateTiles();
+    }
+
     virtual void updateImageFromCamera() override
     {
         Renderer::updateImageFromCamera();
-
+        _updateTiles();
 
         //for (int j = m_height-1; j >= 0; --j)
         //    m_heightIndexes.push_back(j);
     }
 
-    virtual void render() override;
+    using Renderer::render;
+    virtual void render(size_t spp) override;
+
+protected:
+    void _updateTiles();
+
+    virtual void _parallelRows(int nbRows, const std::function<void(int, int)>& task) override;
+
+    void _renderColumns(size_t spp, const CompiledScene& scene);
+    void _renderTiles(size_t spp, const CompiledScene& scene);
 
 public:
     BS::thread_pool m_pool;
@@ -55,6 +113,11 @@ public:
     uint32_t m_nbThreads = 1;
     uint32_t m_nbBlocks = 1;
 
+    Scheduling m_scheduling = Scheduling::TILES;
+    int m_tileSize = 32;
+    TileOrder m_tileOrder = TileOrder::ROW_MAJOR;
+    std::vector<Tile> m_tiles;
+
 //    std::vector<int> m_heightIndexes;   // Array used to store a counter from m_height-1 to 0
 };
 
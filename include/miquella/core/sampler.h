@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <glm/glm.hpp>
+
+#include <miquella/core/random.h>
+
+namespace miquella {
+
+namespace core {
+
+enum class SamplerType : uint8_t
+{
+    INDEPENDENT = 0,    // Uniform random numbers
+    SOBOL = 1,          // Owen scrambled Sobol points
+    BLUE_NOISE = 2,     // Sobol points shifted per pixel by a blue noise mask
+    MAX_NB_SAMPLER = 3
+};
+
+std::string to_string(SamplerType type);
+
+// Source of the numbers of a sample: the pixel jitter on bounce 0, then the
+// numbers of each bounce. get1D() and get2D() consume the next dimension of
+// the current bounce. The values only depend on (seed, pixel, sample index,
+// bounce, dimension), so pixels can be rendered by any thread in any order.
+// A sampler has a state: each thread uses its own instance.
+class Sampler
+{
+public:
+    Sampler(uint32_t seed) : m_seed(seed){}
+
+    virtual ~Sampler(){}
+
+    // Start the sample number sample of the pixel (x, y), on bounce 0
+    virtual void startPixelSample(uint32_t x, uint32_t y, uint32_t sample)
+    {
+        m_x = x;
+        m_y = y;
+        m_sample = sample;
+        setBounce(0);
+    }
+
+    virtual void setBounce(uint32_t bounce)
+    {
+        m_bounce = bounce;
+        m_dimension = 0;
+    }
+
+    // Number in [0, 1)
+    virtual float get1D() = 0;
+
+    // Point in [0, 1)^2
+    virtual glm::vec2 get2D() = 0;
+
+    virtual std::unique_ptr<Sampler> clone() const = 0;
+
+protected:
+    uint32_t m_seed;
+    uint32_t m_x = 0;
+    uint32_t m_y = 0;
+    uint32_t m_sample = 0;
+    uint32_t m_bounce = 0;
+    uint32_t m_dimension = 0;
+};
+
+// Independent uniform numbers from the counter based PixelRNG
+class IndependentSampler : public Sampler
+{
+public:
+    IndependentSampler(uint32_t seed = 0) : Sampler(seed), m_rng(0, 0, seed){}
+
+    virtual void startPixelSample(uint32_t x, uint32_t y, uint32_t sample) override;
+    virtual void setBounce(uint32_t bounce) override;
+
+    virtual float get1D() override { return m_rng.nextFloat(); }
+    virtual glm::vec2 get2D() override;
+
+    virtual std::unique_ptr<Sampler> clone() const override;
+
+private:
+    PixelRNG m_rng;
+};
+
+// Owen scrambled Sobol points (Burley, "Practical Hash-based Owen
+// Scrambling", 2020). Every dimension is a 2D Sobol point set with its own
+// scramble and shuffled index, seeded by the pixel, the bounce and the
+// dimension. The first 2^k samples of a pixel are well stratified in every
+// dimension.
+class SobolSampler : public Sampler
+{
+public:
+    SobolSampler(uint32_t seed = 0) : Sampler(seed){}
+
+    virtual float get1D() override;
+    virtual glm::vec2 get2D() override;
+
+    virtual std::unique_ptr<Sampler> clone() const override;
+
+private:
+    uint32_t _dimensionSeed();
+};
+
+// Blue noise dithered sampling (Georgiev and Fajardo, 2016): all the pixels
+// share the same Owen scrambled Sobol sequence, shifted modulo 1 by the value
+// of a 64x64 blue noise mask at the pixel. Each dimension reads the mask at
+// a different offset. Neighbour pixels get very different shifts, which
+// turns the error of low sample counts into high frequency noise.
+class BlueNoiseSampler : public Sampler
+{
+public:
+    BlueNoiseSampler(uint32_t seed = 0);
+
+    virtual float get1D() override;
+    virtual glm::vec2 get2D() override;
+
+    virtual std::unique_ptr<Sampler> clone() const override;
+
+private:
+    uint32_t _maskValue(uint32_t dimensionSeed) const;
+
+    const uint32_t* m_mask;
+};
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, uint32_t seed = 0);
+
+// Ranks of a 64x64 blue noise mask built with the void and cluster method
+// (Ulichney, 1993), scaled to 32 bits. Built once, on first use.
+constexpr uint32_t blueNoiseMaskSize = 64;
+const uint32_t* getBlueNoiseMask();
+
+} // core
+
+} // miquella
@@ -1,13 +1,25 @@
 #pragma once
 
 #include <vector>
+#include <string>
 
 #include <miquella/core/sphere.h>
+#include <miquella/core/compiledScene.h>
 
 namespace miquella {
 
 namespace core {
 
+enum class AccelerationStructure : uint8_t
+{
+    LINEAR = 0,     // Test every object
+    BVH = 1,        // Binary BVH
+    WIDE_BVH_4 = 2, // 4-wide BVH, SSE node test
+    WIDE_BVH_8 = 3, // 8-wide BVH, AVX2 node test
+    AUTO = 4        // Widest BVH supported by the CPU
+};
+
+std::string to_string(AccelerationStructure accel);
 
 class Scene
 {
@@ -18,7 +30,26 @@ public:
 
     void addObject(std::shared_ptr<Object> obj);
 
-    bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record);
+    // Add a material to the material table if not already present and
+    // return its index
+    uint32_t addMaterial(std::shared_ptr<Material> material);
+
+    const Material& getMaterial(uint32_t materialID) const { return *m_materials[materialID]; }
+
+    // Replace the material of an object of the scene. Returns false if the
+    // object is not in the scene.
+    bool setMaterial(const std::shared_ptr<Object>& obj, std::shared_ptr<Material> material);
+
+    void setAccelerationStructure(AccelerationStructure accel)
+    {
+        m_accelerationStructure = accel;
+        m_compiledScene.reset();
+    }
+
+    // Flattened version of the scene traversed by the renderers. Compiled on
+    // the first call and again after the scene is modified. The compiled
+    // scene is a read only snapshot, safe to share between threads.
+    std::shared_ptr<const CompiledScene> getCompiledScene();
 
     virtual std::shared_ptr<Scene> clone();
 
@@ -26,6 +57,13 @@ public:
     std::vector<std::shared_ptr<Object>> m_objects;
 
     std::vector<std::shared_ptr<Object>> m_lights;
+
+    // Materials referenced by the hit records, each distinct material is stored once
+    std::vector<std::shared_ptr<Material>> m_materials;
+
+    AccelerationStructure m_accelerationStructure = AccelerationStructure::AUTO;
+
+    std::shared_ptr<const CompiledScene> m_compiledScene;
 };
 
 } // core
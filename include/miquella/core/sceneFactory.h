@@ -26,7 +26,8 @@ enum class SceneID : uint8_t
     SCENE_DIELECTRIC = 5,
     SCENE_EMPTY_CORNEL = 6,
     SCENE_SPHERE_CORNEL = 7,
-    MAX_NB_SCENE = 8
+    SCENE_MANY_LIGHTS = 8,
+    MAX_NB_SCENE = 9
 };
 
 std::string to_string(SceneID id);
@@ -45,6 +46,8 @@ public:
 
     std::tuple<std::shared_ptr<miquella::core::Scene>, std::shared_ptr<miquella::core::Camera>, miquella::core::Background > createScene(SceneID id) const
     {
+        // Procedural scenes are the same from one process to the next
+        seedRandom(0);
         switch(id)
         {
             case SceneID::SCENE_THREE_BALLS:
@@ -63,11 +66,18 @@ public:
                 return createEmptyCornel();
             case SceneID::SCENE_SPHERE_CORNEL:
                 return createSphereCornel();
+            case SceneID::SCENE_MANY_LIGHTS:
+                return createManyLights(1024);
             default:
                 return createThreeBalls();
         }
     }
 
+    // Ground and a few balls lit by nbLights small spherical lights of random
+    // colors and intensities spread over the ground. Used to compare the
+    // light selection strategies.
+    std::tuple<std::shared_ptr<miquella::core::Scene>, std::shared_ptr<miquella::core::Camera>, miquella::core::Background > createManyLights(uint32_t nbLights) const;
+
 private:
     std::tuple<std::shared_ptr<miquella::core::Scene>, std::shared_ptr<miquella::core::Camera>, miquella::core::Background > createThreeBalls() const;
     
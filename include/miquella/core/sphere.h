@@ -4,6 +4,7 @@
 
 #include <miquella/core/object.h>
 #include <miquella/core/material.h>
+#include <miquella/core/utility.h>
 
 namespace miquella {
 
@@ -21,7 +22,20 @@ public:
         return std::make_shared<Sphere>(m_center,m_r, m_material->clone());
     }
 
-    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) override;
+    virtual bool intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const override;
+
+    virtual AABB boundingBox() const override
+    {
+        return AABB(m_center - glm::vec3(m_r, m_r, m_r), m_center + glm::vec3(m_r, m_r, m_r));
+    }
+
+    // Uniform sampling of the cone of directions subtended by the sphere.
+    // From inside the sphere, uniform sampling of its area.
+    virtual bool sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const override;
+
+    virtual float pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const override;
+
+    virtual float area() const override { return 4.f*pi*m_r*m_r; }
 
 public:
     glm::vec3 m_center;
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <miquella/core/ray.h>
+
+namespace miquella {
+
+namespace core {
+
+struct SphereArray;
+
+enum class SphereKernelISA : uint8_t
+{
+    SCALAR = 0,
+    AVX2 = 1,       // 8 spheres per iteration
+    AVX512 = 2,     // 16 spheres per iteration
+    AUTO = 3        // Widest kernel supported by the CPU
+};
+
+std::string to_string(SphereKernelISA isa);
+
+// Nearest intersection between a ray and the spheres [begin, end) of the
+// array. On success, index is the index of the closest sphere and t its
+// distance. Ties are resolved toward the lowest index, as a linear scan would.
+using SphereKernel = bool (*)(const SphereArray& spheres, uint32_t begin, uint32_t end, const Ray& r, float tmin, float tmax, uint32_t& index, float& t);
+
+bool intersectSpheresScalar(const SphereArray& spheres, uint32_t begin, uint32_t end, const Ray& r, float tmin, float tmax, uint32_t& index, float& t);
+
+// Return the requested kernel, or the scalar one when the CPU does not support
+// the instruction set.
+SphereKernel getSphereKernel(SphereKernelISA isa = SphereKernelISA::AUTO);
+
+// Instruction set actually used by getSphereKernel(isa)
+SphereKernelISA resolveSphereKernelISA(SphereKernelISA isa);
+
+// Number of spheres tested per iteration by the kernel
+uint32_t getSphereKernelWidth(SphereKernelISA isa);
+
+} // core
+
+} // miquella
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include <glm/glm.hpp>
+
+namespace miquella {
+
+namespace core {
+
+enum class TonemapISA : uint8_t
+{
+    SCALAR = 0,
+    SSE41 = 1,      // 4 pixels per iteration
+    AVX2 = 2,       // 8 pixels per iteration
+    AUTO = 3        // Widest kernel supported by the CPU
+};
+
+std::string to_string(TonemapISA isa);
+
+// Convert count pixels of accumulated radiance to the 8 bits RGBA image:
+// average over the samples of the pixel, gamma 2 (square root), clamp and
+// quantize. Pixels without samples are black. All the kernels give the same
+// bytes as the scalar one.
+using TonemapKernel = void (*)(const glm::vec3* accumulated, const uint32_t* samples, size_t count, unsigned char* rgba);
+
+void tonemapScalar(const glm::vec3* accumulated, const uint32_t* samples, size_t count, unsigned char* rgba);
+
+// Return the requested kernel, or the scalar one when the CPU does not
+// support the instruction set
+TonemapKernel getTonemapKernel(TonemapISA isa = TonemapISA::AUTO);
+
+// Instruction set actually used by getTonemapKernel(isa)
+TonemapISA resolveTonemapISA(TonemapISA isa);
+
+} // core
+
+} // miquella
@@ -1,9 +1,11 @@
 #pragma once
 
-#include <random>
-
 #include <glm/glm.hpp>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+
+#include <miquella/core/random.h>
 
 namespace miquella {
 
@@ -11,9 +13,15 @@ namespace core {
 
 const float pi = 3.1415926535897932385f;
 
-static thread_local std::random_device rd;
-static thread_local std::mt19937 generator = std::mt19937(rd());
-static thread_local std::uniform_real_distribution<float> distribution(0.f, 1.f);
+// Sequential generator used to build procedural scenes. Rendering draws its
+// numbers from a Sampler instead.
+inline thread_local PCG32 generator;
+
+// Restart the sequence of randomFloat() so a procedural scene can be rebuilt identically
+inline void seedRandom(uint64_t seed)
+{
+    generator.setSeed(seed);
+}
 
 inline float degreeToRadians(float degrees)
 {
@@ -33,7 +41,7 @@ inline float randomFloat(float minValue, float maxValue)
 #else
 inline float randomFloat(float minValue = 0.0f, float maxValue = 1.0f)
 {
-    return minValue + (maxValue-minValue)*distribution(generator);
+    return minValue + (maxValue-minValue)*generator.nextFloat();
 }
 #endif
 
@@ -56,6 +64,16 @@ inline glm::vec3 randomUnitVec3()
     }
 }
 
+// Uniform direction on the unit sphere from a point of the unit square.
+// Stratified points give stratified directions.
+inline glm::vec3 sampleUnitSphere(const glm::vec2& u)
+{
+    float z = 1.f - 2.f*u.x;
+    float phi = 2.f*pi*u.y;
+    float r = std::sqrt(std::max(0.f, 1.f - z*z));
+    return glm::vec3(r*std::cos(phi), r*std::sin(phi), z);
+}
+
 inline glm::vec3 randomHemisphereVec3(const glm::vec3& normal)
 {
     auto result = randomUnitVec3();
@@ -64,6 +82,12 @@ inline glm::vec3 randomHemisphereVec3(const glm::vec3& normal)
     return result;
 }
 
+// Relative luminance of a linear color (Rec. 709)
+inline float luminance(const glm::vec3& color)
+{
+    return 0.2126f*color.x + 0.7152f*color.y + 0.0722f*color.z;
+}
+
 inline bool nearZeroVec3(const glm::vec3& vec)
 {
     const auto delta = 1e-10f;
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <bit>
+#include <cmath>
+
+#include <miquella/core/bvh.h>
+
+namespace miquella {
+
+namespace core {
+
+// Node of a W-wide BVH. The child boxes are stored as structure of arrays
+// (one row of W floats per plane) so that all the children can be tested at
+// once with a single vectorized slab test. Unused slots have an empty box
+// and can never be hit.
+template<uint32_t W>
+struct alignas(32) WideBVHNode
+{
+    // Rows 0-2: min x/y/z, rows 3-5: max x/y/z
+    float m_bounds[6][W];
+    // Interior child: index of the node. Leaf child: first primitive index.
+    uint32_t m_child[W];
+    // 0 for interior children, number of primitives for leaves
+    uint16_t m_count[W];
+};
+
+// Ray data precomputed once per traversal for the node tests.
+struct WideRay
+{
+    WideRay(const Ray& r)
+    {
+        for(int a = 0; a < 3; ++a)
+        {
+            // Avoid infinite inverses, 0 * inf would give NaN in the slab test
+            float d = r.m_dir[a];
+            if(std::fabs(d) < 1e-20f)
+                d = std::copysign(1e-20f, d);
+            m_invDir[a] = 1.f / d;
+            m_originScaled[a] = r.m_orig[a] * m_invDir[a];
+            // Near plane is the min plane, unless the ray goes toward negative values
+            m_nearRow[a] = static_cast<uint32_t>(m_invDir[a] < 0.f ? a + 3 : a);
+            m_farRow[a] = static_cast<uint32_t>(m_invDir[a] < 0.f ? a : a + 3);
+        }
+    }
+
+    float m_invDir[3];
+    float m_originScaled[3];
+    uint32_t m_nearRow[3];
+    uint32_t m_farRow[3];
+};
+
+// Slab tests of all the children of a node. Return a bit mask of the children
+// hit and write their entry distance in tEntry. The 4-wide version uses SSE,
+// the 8-wide version AVX2 and must only be called when the CPU supports it.
+uint32_t intersectWideNode4(const WideBVHNode<4>& node, const WideRay& ray, float tmin, float tmax, float* tEntry);
+uint32_t intersectWideNode8(const WideBVHNode<8>& node, const WideRay& ray, float tmin, float tmax, float* tEntry);
+
+// Multi branching BVH obtained by collapsing a binary BVH. Width 8 relies on
+// AVX2, width 4 on SSE. build() picks the widest one supported by the CPU
+// unless a width is requested.
+class WideBVH
+{
+public:
+    WideBVH(){}
+
+    // width: 4, 8 or 0 to select from the CPU features
+    void build(const BVH& bvh, uint32_t width = 0);
+
+    void clear()
+    {
+        m_nodes4.clear();
+        m_nodes8.clear();
+        m_primitiveIndices.clear();
+    }
+
+    bool isEmpty() const { return m_nodes4.empty() && m_nodes8.empty(); }
+
+    uint32_t getWidth() const { return m_width; }
+
+    // Same contract as BVH::intersect
+    template<typename IntersectFunc>
+    bool intersect(const Ray& r, float tmin, float tmax, IntersectFunc&& intersectPrimitive) const
+    {
+        return traverse(r, tmin, tmax, [&](uint32_t first, uint32_t count, float& currentMax)
+        {
+            bool hitFound = false;
+            for(uint32_t i = first; i < first + count; ++i)
+            {
+                if(intersectPrimitive(m_primitiveIndices[i], currentMax))
+                    hitFound = true;
+            }
+            return hitFound;
+        });
+    }
+
+    // Same contract as BVH::traverse
+    template<typename LeafFunc>
+    bool traverse(const Ray& r, float tmin, float tmax, LeafFunc&& intersectLeaf) const
+    {
+        if(m_width == 8)
+            return _traverse<8>(m_nodes8, intersectWideNode8, r, tmin, tmax, intersectLeaf);
+        return _traverse<4>(m_nodes4, intersectWideNode4, r, tmin, tmax, intersectLeaf);
+    }
+
+private:
+    template<uint32_t W>
+    uint32_t _collapse(const BVH& bvh, uint32_t binaryIndex, std::vector<WideBVHNode<W>>& nodes);
+
+    template<uint32_t W, typename NodeTest, typename LeafFunc>
+    bool _traverse(const std::vector<WideBVHNode<W>>& nodes, NodeTest nodeTest, const Ray& r, float tmin, float tmax, LeafFunc& intersectLeaf) const
+    {
+        if(nodes.empty())
+            return false;
+
+        struct StackEntry
+        {
+            uint32_t m_child;
+            uint32_t m_count;
+            float m_t;
+        };
+
+        const WideRay ray(r);
+        StackEntry stack[W * BVH::MAX_DEPTH];
+        uint32_t stackSize = 0;
+        stack[stackSize++] = { 0, 0, tmin };
+        bool hitFound = false;
+
+        while(stackSize > 0)
+        {
+            StackEntry entry = stack[--stackSize];
+
+            // A closer hit was found since this entry was pushed
+            if(entry.m_t > tmax)
+                continue;
+
+            if(entry.m_count > 0)
+            {
+                if(intersectLeaf(entry.m_child, entry.m_count, tmax))
+                    hitFound = true;
+                continue;
+            }
+
+            const WideBVHNode<W>& node = nodes[entry.m_child];
+            alignas(32) float tEntry[W];
+            uint32_t mask = nodeTest(node, ray, tmin, tmax, tEntry);
+            if(mask == 0)
+                continue;
+
+            // Sort the children hit from far to near so that the nearest
+            // one is on top of the stack
+            uint32_t first = stackSize;
+            while(mask != 0)
+            {
+                auto c = static_cast<uint32_t>(std::countr_zero(mask));
+                mask &= mask - 1;
+
+                StackEntry child = { node.m_child[c], node.m_count[c], tEntry[c] };
+                uint32_t pos = stackSize++;
+                while(pos > first && stack[pos - 1].m_t < child.m_t)
+                {
+                    stack[pos] = stack[pos - 1];
+                    --pos;
+                }
+                stack[pos] = child;
+            }
+        }
+
+        return hitFound;
+    }
+
+public:
+    uint32_t m_width = 4;
+    std::vector<WideBVHNode<4>> m_nodes4;
+    std::vector<WideBVHNode<8>> m_nodes8;
+    std::vector<uint32_t> m_primitiveIndices;
+};
+
+} // core
+
+} // miquella
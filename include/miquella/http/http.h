@@ -2,39 +2,113 @@
 
 #include <miquella/core/sceneFactory.h>
 
+#include <atomic>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
 //#include <cpr/cpr.h>
 
 //#include <nlohmann/json.hpp>
 //using json = nlohmann::json;
 
+namespace cpr
+{
+    class Session;
+    class Response;
+}
+
 namespace miquella 
 {
 
 namespace http 
 {
 
+// noiseLevel is the estimated error of the image, completed is set on the
+// last upload of a job, when the sample count or the noise threshold was reached
 std::tuple<long, std::string> uploadJobToRemoteController(
                                 const std::string& serverURL,
                                 int port,
                                 const std::string& filePath, 
                                 const std::string& jobID,
-                                size_t lastSample);
+                                size_t lastSample,
+                                float noiseLevel = -1.f,
+                                bool completed = false);
+
+// Same as uploadJobToRemoteController() with the content of the image in
+// memory, sent as the file fileName
+std::tuple<long, std::string> uploadJobBufferToRemoteController(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& buffer,
+                                const std::string& fileName,
+                                const std::string& jobID,
+                                size_t lastSample,
+                                float noiseLevel = -1.f,
+                                bool completed = false);
 
 std::tuple<long, std::string> uploadJobToLocalController(
                                 const std::string& filePath, 
                                 const std::string& jobID,
-                                size_t lastSample);
+                                size_t lastSample,
+                                float noiseLevel = -1.f,
+                                bool completed = false);
+
+// Accumulation file of the part partID of a job, a sample range or a crop
+// window, lastSample samples after the start of the part. The remote version
+// sends the content of the file, the local one its path on the shared file
+// system.
+std::tuple<long, std::string> uploadPartToRemoteController(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& filePath,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed = false);
+
+// Same as uploadPartToRemoteController() with the content of the
+// accumulation in memory
+std::tuple<long, std::string> uploadPartBufferToRemoteController(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& buffer,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed = false);
+
+std::tuple<long, std::string> uploadPartToLocalController(
+                                const std::string& filePath,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed = false);
+
+// Accumulation of the whole image assembled from the parts of a job
+// received so far, as the raw content of an accumulation file
+std::tuple<long, std::string> requestJobAccumulation(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& jobID);
 
 std::tuple<long, std::string> requestJob(
                                 const std::string& serverURL,
                                 int port);
 
+// A noiseThreshold of 0 is not sent, the servers use their own
 std::tuple<long, std::string> submitJob(
                                 const std::string& serverURL,
                                 int port,
                                 miquella::core::SceneID id,
                                 int nSamples,
-                                int freqOutput);
+                                int freqOutput,
+                                float noiseThreshold = 0.f);
 
 std::tuple<long, std::string> requestLastLocalSample(
                                 const std::string& serverURL,
@@ -59,6 +133,87 @@ std::tuple<long, std::string> requestRemoveJob(
                                 const std::string& serverURL,
                                 int port,
                                 const std::string& jobID);
+
+// Connection to a controller which keeps its HTTP connections open between
+// requests. Each endpoint keeps its idle cpr sessions, the next request to
+// the endpoint reuses the connection of one of them instead of opening a new
+// one. Requests can be made from several threads at once, a request takes
+// an idle session of its endpoint or creates one. At most 4 idle sessions
+// are kept per endpoint, the others are closed after their request.
+// The Async variants make the request on another thread and return the
+// reply through a future. The client must outlive the futures.
+// Unlike the functions above, the local controller versions contact the
+// controller of the client rather than http://localhost:8000.
+class ControllerClient
+{
+public:
+    using Reply = std::tuple<long, std::string>;
+    using ReplyWithHeader = std::tuple<long, std::string, std::map<std::string, std::string>>;
+
+    ControllerClient(const std::string& serverURL = "http://localhost", int port = 8000);
+    ControllerClient(const ControllerClient&) = delete;
+    ControllerClient& operator=(const ControllerClient&) = delete;
+    ~ControllerClient();
+
+    // Contact another controller, the open connections are closed
+    void setController(const std::string& serverURL, int port);
+    std::string getServerURL() const;
+    int getPort() const;
+
+    // Number of sessions created since the client was created, one per
+    // connection opened unless the controller closes them
+    size_t getNbSessions() const { return m_nbSessions; }
+
+    // Number of connections opened by the requests of the client, as
+    // reported by curl. Stays at the number of sessions while the
+    // connections are kept open.
+    size_t getNbConnections() const { return m_nbConnections; }
+
+    Reply uploadJobToRemoteController(const std::string& filePath, const std::string& jobID, size_t lastSample, float noiseLevel = -1.f, bool completed = false);
+    Reply uploadJobBufferToRemoteController(const std::string& buffer, const std::string& fileName, const std::string& jobID, size_t lastSample, float noiseLevel = -1.f, bool completed = false);
+    Reply uploadJobToLocalController(const std::string& filePath, const std::string& jobID, size_t lastSample, float noiseLevel = -1.f, bool completed = false);
+    Reply uploadPartToRemoteController(const std::string& filePath, const std::string& jobID, size_t partID, size_t lastSample, bool completed = false);
+    Reply uploadPartBufferToRemoteController(const std::string& buffer, const std::string& jobID, size_t partID, size_t lastSample, bool completed = false);
+    Reply uploadPartToLocalController(const std::string& filePath, const std::string& jobID, size_t partID, size_t lastSample, bool completed = false);
+    Reply requestJobAccumulation(const std::string& jobID);
+    Reply requestJob();
+    Reply submitJob(miquella::core::SceneID id, int nSamples, int freqOutput, float noiseThreshold = 0.f);
+    Reply requestLastLocalSample(const std::string& jobID);
+    ReplyWithHeader requestLastRemoteSample(const std::string& jobID);
+    Reply requestListJobs();
+    Reply requestCancelJob(const std::string& jobID);
+    Reply requestRemoveJob(const std::string& jobID);
+
+    // The buffers are moved to the request thread, pass them with std::move
+    // to avoid a copy
+    std::future<Reply> uploadJobToRemoteControllerAsync(std::string filePath, std::string jobID, size_t lastSample, float noiseLevel = -1.f, bool completed = false);
+    std::future<Reply> uploadJobBufferToRemoteControllerAsync(std::string buffer, std::string fileName, std::string jobID, size_t lastSample, float noiseLevel = -1.f, bool completed = false);
+    std::future<Reply> uploadJobToLocalControllerAsync(std::string filePath, std::string jobID, size_t lastSample, float noiseLevel = -1.f, bool completed = false);
+    std::future<Reply> uploadPartToRemoteControllerAsync(std::string filePath, std::string jobID, size_t partID, size_t lastSample, bool completed = false);
+    std::future<Reply> uploadPartBufferToRemoteControllerAsync(std::string buffer, std::string jobID, size_t partID, size_t lastSample, bool completed = false);
+    std::future<Reply> uploadPartToLocalControllerAsync(std::string filePath, std::string jobID, size_t partID, size_t lastSample, bool completed = false);
+    std::future<Reply> requestJobAccumulationAsync(std::string jobID);
+    std::future<Reply> requestJobAsync();
+    std::future<Reply> submitJobAsync(miquella::core::SceneID id, int nSamples, int freqOutput, float noiseThreshold = 0.f);
+    std::future<Reply> requestLastLocalSampleAsync(std::string jobID);
+    std::future<ReplyWithHeader> requestLastRemoteSampleAsync(std::string jobID);
+    std::future<Reply> requestListJobsAsync();
+    std::future<Reply> requestCancelJobAsync(std::string jobID);
+    std::future<Reply> requestRemoveJobAsync(std::string jobID);
+
+protected:
+    // Run request on an idle session of endpoint, with the URL of the
+    // endpoint already set
+    cpr::Response _send(const char* endpoint, const std::function<cpr::Response(cpr::Session&)>& request);
+
+    mutable std::mutex m_mutex;
+    std::string m_serverURL;
+    int m_port = 8000;
+    std::map<std::string, std::vector<std::unique_ptr<cpr::Session>>> m_idleSessions;
+    std::atomic<size_t> m_nbSessions = 0;
+    std::atomic<size_t> m_nbConnections = 0;
+};
+
 } // http
 
 } // miquella 
\ No newline at end of file
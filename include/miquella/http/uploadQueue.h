@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace miquella 
+{
+
+namespace http 
+{
+
+// Runs the checkpoint uploads of a worker on a background thread, in the
+// order they were pushed, while the renderer computes the next samples.
+// push() blocks while maxPending uploads wait, so that the snapshots do not
+// pile up when the network is slower than the renderer. With maxPending 0,
+// push() runs the upload immediately on the calling thread.
+class UploadQueue
+{
+public:
+    // Encode and send one checkpoint, return false when the controller
+    // asks to stop the job
+    using Upload = std::function<bool()>;
+
+    UploadQueue(size_t maxPending = 2);
+    UploadQueue(const UploadQueue&) = delete;
+    UploadQueue& operator=(const UploadQueue&) = delete;
+    ~UploadQueue();
+
+    void push(Upload upload);
+
+    // Wait until all the pushed uploads are sent
+    void finish();
+
+    // False once an upload returned false. The uploads still waiting are
+    // dropped, the renderer should stop.
+    bool isRunning() const { return m_running.load(); }
+
+    // Time spent by push() waiting for room in the queue, in ms
+    double getWaitTime() const { return m_waitTime; }
+
+protected:
+    void _run();
+
+    size_t m_maxPending = 2;
+    std::deque<Upload> m_pending;
+    bool m_uploading = false;   // An upload taken from m_pending is running
+    bool m_stop = false;
+    std::atomic<bool> m_running = true;
+    double m_waitTime = 0.0;
+
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::thread m_thread;
+};
+
+} // http
+
+} // miquella
@@ -0,0 +1,146 @@
+#include <benchmark/benchmark.h>
+
+#include <cpprest/http_listener.h>
+
+#include <miquella/http/http.h>
+
+#include <future>
+#include <string>
+#include <vector>
+
+using namespace web::http;
+using namespace web::http::experimental::listener;
+
+static const std::string standInURL = "http://localhost";
+static constexpr int standInPort = 8765;
+
+// Stand-in for the controller on the local machine. It answers the requests
+// of the benchmarks without any work, so that the time measured is the one
+// of the client and of the connections.
+class StandInController
+{
+public:
+    StandInController() : m_listener(standInURL + ":" + std::to_string(standInPort))
+    {
+        m_listener.support([](http_request request)
+        {
+            auto path = web::uri::decode(request.relative_uri().path());
+            if(path == "/requestListAllJobs" && request.method() == methods::GET)
+            {
+                request.reply(status_codes::OK, "{\"jobs\":[]}", "application/json");
+            }
+            else if(path == "/updateRemotePartExec" && request.method() == methods::POST)
+            {
+                // Read the whole upload before replying, as the controller
+                request.extract_vector().wait();
+                request.reply(status_codes::OK, "{\"status\":\"RUNNING\"}", "application/json");
+            }
+            else
+            {
+                request.reply(status_codes::NotFound);
+            }
+        });
+        m_listener.open().wait();
+    }
+
+    ~StandInController()
+    {
+        m_listener.close().wait();
+    }
+
+protected:
+    http_listener m_listener;
+};
+
+static void startStandIn()
+{
+    static StandInController standIn;
+}
+
+// Latency of a small request, with a new connection for each request or
+// with the connection kept open by a client. range(0) enables the client,
+// its connections counter stays at 1 when the connection is reused.
+static void BM_RequestLatency(benchmark::State& state)
+{
+    startStandIn();
+    bool reuse = state.range(0) != 0;
+    state.SetLabel(reuse ? "keep-alive" : "new connection");
+
+    miquella::http::ControllerClient controller(standInURL, standInPort);
+    for(auto _ : state)
+    {
+        auto [ returnCode, text ] = reuse ? controller.requestListJobs() : miquella::http::requestListJobs(standInURL, standInPort);
+        if(returnCode != 200)
+        {
+            state.SkipWithError("The stand-in controller did not answer.");
+            break;
+        }
+        benchmark::DoNotOptimize(text.data());
+    }
+    state.counters["sessions"] = static_cast<double>(controller.getNbSessions());
+    state.counters["connections"] = static_cast<double>(controller.getNbConnections());
+}
+
+// Latency of the upload of an accumulation of range(1) KB, with a new
+// connection for each upload or with the connection kept open by a client.
+// range(0) enables the client.
+static void BM_UploadLatency(benchmark::State& state)
+{
+    startStandIn();
+    bool reuse = state.range(0) != 0;
+    std::string buffer(static_cast<size_t>(state.range(1)) * 1024, 'a');
+    state.SetLabel(reuse ? "keep-alive" : "new connection");
+
+    miquella::http::ControllerClient controller(standInURL, standInPort);
+    for(auto _ : state)
+    {
+        auto [ returnCode, text ] = reuse ? 
+            controller.uploadPartBufferToRemoteController(buffer, "job", 0, 1) :
+            miquella::http::uploadPartBufferToRemoteController(standInURL, standInPort, buffer, "job", 0, 1);
+        if(returnCode != 200)
+        {
+            state.SkipWithError("The stand-in controller did not answer.");
+            break;
+        }
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(buffer.size()));
+    state.counters["connections"] = static_cast<double>(controller.getNbConnections());
+}
+
+// Time to get the replies of 16 requests sent one after the other, or all
+// at once with the Async variants of the client. range(0) enables the
+// Async variants.
+static void BM_AsyncRequests(benchmark::State& state)
+{
+    startStandIn();
+    bool async = state.range(0) != 0;
+    const size_t nbRequests = 16;
+    state.SetLabel(async ? "async" : "sequential");
+
+    miquella::http::ControllerClient controller(standInURL, standInPort);
+    for(auto _ : state)
+    {
+        if(async)
+        {
+            std::vector<std::future<miquella::http::ControllerClient::Reply>> replies;
+            for(size_t i = 0; i < nbRequests; ++i)
+                replies.push_back(controller.requestListJobsAsync());
+            for(auto& reply : replies)
+                benchmark::DoNotOptimize(reply.get());
+        }
+        else
+        {
+            for(size_t i = 0; i < nbRequests; ++i)
+                benchmark::DoNotOptimize(controller.requestListJobs());
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(nbRequests));
+    state.counters["sessions"] = static_cast<double>(controller.getNbSessions());
+    state.counters["connections"] = static_cast<double>(controller.getNbConnections());
+}
+
+BENCHMARK(BM_RequestLatency)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_UploadLatency)->ArgsProduct({{0, 1}, {16, 1024, 8192}})->UseRealTime()->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_AsyncRequests)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
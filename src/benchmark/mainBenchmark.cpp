@@ -2,28 +2,90 @@
 
 #include <miquella/core/rendererThreads.h>
 #include <miquella/core/sceneFactory.h>
+#include <miquella/http/uploadQueue.h>
 
+#include "perfCounter.h"
 
-static void runBenchmarkScene(miquella::core::SceneID sceneID, size_t nSamples, uint32_t nbThreads, uint32_t nbBlocks)
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <map>
+#include <memory>
+#include <new>
+#include <thread>
+#include <utility>
+
+// Heap allocations performed by the process, counted by the replaced global
+// operator new.
+static std::atomic<size_t> nbAllocations{0};
+
+// GCC does not see that the replaced operators pair malloc with free
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(std::size_t size)
+{
+    nbAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* ptr = std::malloc(size > 0 ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept
+{
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    operator delete(ptr);
+}
+
+// Render the first sample, which compiles the scene, so that the
+// compilation is not part of the measure
+static void renderFirstSample(miquella::core::Renderer& renderer)
+{
+    renderer.render();
+}
+
+// Render nSamples of the scene and return the average number of heap
+// allocations per sample. The scene setup is not counted.
+static double runBenchmarkScene(
+                        miquella::core::SceneID sceneID,
+                        size_t nSamples,
+                        uint32_t nbThreads,
+                        uint32_t nbBlocks,
+                        miquella::core::AccelerationStructure accel = miquella::core::AccelerationStructure::AUTO,
+                        miquella::core::Scheduling scheduling = miquella::core::Scheduling::TILES)
 {
     miquella::core::SceneFactory sceneFactory;
         auto [ scene, camera, background ] = sceneFactory.createScene(sceneID);
+        scene->setAccelerationStructure(accel);
 
         miquella::core::RendererThreads renderer(scene, camera, nbThreads);
         renderer.setNbBlocks(nbBlocks);
+        renderer.setScheduling(scheduling);
         renderer.setBackground(background);
 
-        
-        for(size_t i = 1; i <= nSamples; ++i)
+        renderFirstSample(renderer);
+
+        size_t allocationsStart = nbAllocations.load();
+        for(size_t i = 2; i <= nSamples; ++i)
         {
             // Compute the image
             renderer.render();
         }
+        size_t allocations = nbAllocations.load() - allocationsStart;
         std::cout<<"Completed "<<nSamples<<" samples for "<<nbThreads<<" threads and "<<nbBlocks<<" blocks."<<std::endl;
+
+        return nSamples > 1 ? static_cast<double>(allocations) / static_cast<double>(nSamples - 1) : 0.0;
 }
 
 static void BM_ThreeBall(benchmark::State& state)
 {
+    double allocationsPerSample = 0.0;
     for(auto _ : state)
     {
         auto sceneID = miquella::core::SceneID::SCENE_THREE_BALLS;
@@ -31,12 +93,14 @@ static void BM_ThreeBall(benchmark::State& state)
         uint32_t nbThreads = static_cast<uint32_t>(state.range(0));
         uint32_t nbBlocks = static_cast<uint32_t>(state.range(1));
 
-        runBenchmarkScene(sceneID, nSamples, nbThreads, nbBlocks);
+        allocationsPerSample = runBenchmarkScene(sceneID, nSamples, nbThreads, nbBlocks);
     }
+    state.counters["allocations/sample"] = allocationsPerSample;
 }
 
 static void BM_OneWeekend(benchmark::State& state)
 {
+    double allocationsPerSample = 0.0;
     for(auto _ : state)
     {
         auto sceneID = miquella::core::SceneID::SCENE_ONE_WEEKEND;
@@ -44,11 +108,581 @@ static void BM_OneWeekend(benchmark::State& state)
         uint32_t nbThreads = static_cast<uint32_t>(state.range(0));
         uint32_t nbBlocks = static_cast<uint32_t>(state.range(1));
 
-        runBenchmarkScene(sceneID, nSamples, nbThreads, nbBlocks);
+        allocationsPerSample = runBenchmarkScene(sceneID, nSamples, nbThreads, nbBlocks);
+    }
+    state.counters["allocations/sample"] = allocationsPerSample;
+}
+
+// Compare the acceleration structures. range(0) is a miquella::core::SceneID,
+// range(1) a miquella::core::AccelerationStructure and range(2) the number
+// of samples.
+static void BM_Acceleration(benchmark::State& state)
+{
+    auto sceneID = static_cast<miquella::core::SceneID>(state.range(0));
+    auto accel = static_cast<miquella::core::AccelerationStructure>(state.range(1));
+    size_t nSamples = static_cast<size_t>(state.range(2));
+    state.SetLabel(miquella::core::to_string(sceneID) + " " + miquella::core::to_string(accel));
+
+    double allocationsPerSample = 0.0;
+    for(auto _ : state)
+    {
+        allocationsPerSample = runBenchmarkScene(sceneID, nSamples, 6, 12, accel);
+    }
+    state.counters["allocations/sample"] = allocationsPerSample;
+}
+
+// Intersection throughput on a generated scene of a million small spheres.
+// Only the traversal is measured, the scene and its hierarchy are built once.
+static void BM_MillionSpheres(benchmark::State& state)
+{
+    auto accel = static_cast<miquella::core::AccelerationStructure>(state.range(0));
+    state.SetLabel(miquella::core::to_string(accel));
+
+    static std::shared_ptr<miquella::core::Scene> scene;
+    if(!scene)
+    {
+        scene = std::make_shared<miquella::core::Scene>();
+        auto mat = std::make_shared<miquella::core::Lambertian>(glm::vec3(0.5f, 0.5f, 0.5f));
+        for(size_t i = 0; i < 1000000; ++i)
+        {
+            auto center = glm::vec3(miquella::core::randomFloat(-100.f, 100.f), miquella::core::randomFloat(-100.f, 100.f), miquella::core::randomFloat(-100.f, 100.f));
+            scene->addObject(std::make_shared<miquella::core::Sphere>(center, miquella::core::randomFloat(0.05f, 0.5f), mat));
+        }
+    }
+    scene->setAccelerationStructure(accel);
+    auto compiledScene = scene->getCompiledScene();
+
+    std::vector<miquella::core::Ray> rays;
+    for(size_t i = 0; i < 100000; ++i)
+        rays.emplace_back(glm::vec3(miquella::core::randomFloat(-100.f, 100.f), miquella::core::randomFloat(-100.f, 100.f), miquella::core::randomFloat(-100.f, 100.f)), miquella::core::randomUnitVec3());
+
+    for(auto _ : state)
+    {
+        size_t nbHits = 0;
+        for(auto & ray : rays)
+        {
+            miquella::core::hitRecord record;
+            if(compiledScene->intersect(ray, 0.001f, std::numeric_limits<float>::max(), record))
+                nbHits++;
+        }
+        benchmark::DoNotOptimize(nbHits);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(rays.size()));
+}
+
+// Scaling of the scheduling schemes with the number of threads.
+// range(0) is a miquella::core::SceneID, range(1) a miquella::core::Scheduling
+// and range(2) the number of threads.
+static void BM_SchedulingScaling(benchmark::State& state)
+{
+    auto sceneID = static_cast<miquella::core::SceneID>(state.range(0));
+    auto scheduling = static_cast<miquella::core::Scheduling>(state.range(1));
+    uint32_t nbThreads = static_cast<uint32_t>(state.range(2));
+    size_t nSamples = 10;
+    state.SetLabel(miquella::core::to_string(sceneID) + " " + miquella::core::to_string(scheduling));
+
+    double allocationsPerSample = 0.0;
+    for(auto _ : state)
+    {
+        allocationsPerSample = runBenchmarkScene(sceneID, nSamples, nbThreads, 2 * nbThreads, miquella::core::AccelerationStructure::AUTO, scheduling);
+    }
+    state.counters["allocations/sample"] = allocationsPerSample;
+    state.counters["threads"] = static_cast<double>(nbThreads);
+}
+
+// 1, 2, 4, ... threads up to the number of cores of the machine
+static void schedulingScalingArguments(benchmark::internal::Benchmark* benchmark)
+{
+    auto nbCores = static_cast<int64_t>(std::max(1u, std::thread::hardware_concurrency()));
+    for(auto sceneID : { miquella::core::SceneID::SCENE_ONE_WEEKEND, miquella::core::SceneID::SCENE_SPHERE_CORNEL })
+    {
+        for(auto scheduling : { miquella::core::Scheduling::COLUMNS, miquella::core::Scheduling::TILES })
+        {
+            for(int64_t nbThreads = 1; nbThreads < nbCores; nbThreads *= 2)
+                benchmark->Args({ static_cast<int64_t>(sceneID), static_cast<int64_t>(scheduling), nbThreads });
+            benchmark->Args({ static_cast<int64_t>(sceneID), static_cast<int64_t>(scheduling), nbCores });
+        }
+    }
+}
+
+// Tile orders on SCENE_ONE_WEEKEND. range(0) is a miquella::core::TileOrder
+// and range(1) the image height, 1080 or 2160 for 1080p and 4K.
+// Reports the time per sample and the last level cache misses per sample
+// when the hardware counters are available.
+static void BM_TileOrder(benchmark::State& state)
+{
+    auto order = static_cast<miquella::core::TileOrder>(state.range(0));
+    int height = static_cast<int>(state.range(1));
+    size_t nSamples = 4;
+    auto nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    state.SetLabel(miquella::core::to_string(order));
+
+    miquella::core::SceneFactory sceneFactory;
+    auto [ scene, camera, background ] = sceneFactory.createScene(miquella::core::SceneID::SCENE_ONE_WEEKEND);
+    camera->m_imageWidth = height * 16 / 9;
+    camera->m_imageHeight = height;
+
+    // Opened before the pool threads are created so that they inherit it
+    auto llcMisses = PerfCounter::llcMisses();
+
+    miquella::core::RendererThreads renderer(scene, camera, nbThreads);
+    renderer.setTileOrder(order);
+    renderer.setBackground(background);
+
+    renderFirstSample(renderer);
+
+    double msPerSample = 0.0;
+    double missesPerSample = 0.0;
+    for(auto _ : state)
+    {
+        llcMisses.start();
+        auto start = std::chrono::steady_clock::now();
+        for(size_t i = 0; i < nSamples; ++i)
+            renderer.render();
+        auto end = std::chrono::steady_clock::now();
+        llcMisses.stop();
+
+        msPerSample = std::chrono::duration<double, std::milli>(end - start).count() / static_cast<double>(nSamples);
+        missesPerSample = static_cast<double>(llcMisses.read()) / static_cast<double>(nSamples);
+    }
+    state.counters["ms/sample"] = msPerSample;
+    if(llcMisses.isValid())
+        state.counters["LLC misses/sample"] = missesPerSample;
+}
+
+// Same total number of samples computed with range(0) samples per call to
+// render(). Fewer calls means fewer synchronizations and tonemapping passes.
+static void BM_SamplesPerDispatch(benchmark::State& state)
+{
+    auto spp = static_cast<size_t>(state.range(0));
+    size_t nSamples = 64;
+    auto nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    miquella::core::SceneFactory sceneFactory;
+    auto [ scene, camera, background ] = sceneFactory.createScene(miquella::core::SceneID::SCENE_THREE_BALLS);
+    miquella::core::RendererThreads renderer(scene, camera, nbThreads);
+    renderer.setBackground(background);
+
+    renderFirstSample(renderer);
+
+    for(auto _ : state)
+    {
+        for(size_t i = 0; i < nSamples; i += spp)
+            renderer.render(spp);
+    }
+
+    auto nbPixels = static_cast<double>(renderer.m_width) * static_cast<double>(renderer.m_height);
+    state.counters["samples"] = benchmark::Counter(static_cast<double>(state.iterations()) * static_cast<double>(nSamples) * nbPixels, benchmark::Counter::kIsRate);
+}
+
+// Time per sample against the maximum path depth on the glass Cornell box.
+// range(0) is the maximum depth, range(1) enables the Russian roulette.
+static void BM_MaxDepth(benchmark::State& state)
+{
+    int maxDepth = static_cast<int>(state.range(0));
+    bool russianRoulette = state.range(1) != 0;
+    size_t nSamples = 4;
+    auto nbThreads = std::max(1u, std::thread::hardware_concurrency());
+    state.SetLabel(russianRoulette ? "ROULETTE" : "NO_ROULETTE");
+
+    miquella::core::SceneFactory sceneFactory;
+    auto [ scene, camera, background ] = sceneFactory.createScene(miquella::core::SceneID::SCENE_SPHERE_CORNEL);
+    miquella::core::RendererThreads renderer(scene, camera, nbThreads);
+    renderer.setBackground(background);
+    renderer.setMaxDepth(maxDepth);
+    renderer.setRussianRoulette(russianRoulette);
+
+    renderFirstSample(renderer);
+
+    double msPerSample = 0.0;
+    for(auto _ : state)
+    {
+        auto start = std::chrono::steady_clock::now();
+        renderer.render(nSamples);
+        auto end = std::chrono::steady_clock::now();
+        msPerSample = std::chrono::duration<double, std::milli>(end - start).count() / static_cast<double>(nSamples);
+    }
+    state.counters["ms/sample"] = msPerSample;
+}
+
+// Convergence is measured on small images so that the reference converges
+static constexpr int convergenceResolution = 96;
+static constexpr size_t convergenceReferenceSamples = 4096;
+
+// Renderer of a scene at the resolution of the convergence benchmarks
+static std::unique_ptr<miquella::core::RendererThreads> createConvergenceRenderer(
+                        std::shared_ptr<miquella::core::Scene> scene,
+                        std::shared_ptr<miquella::core::Camera> camera,
+                        const miquella::core::Background& background)
+{
+    camera->m_imageWidth = convergenceResolution;
+    camera->m_imageHeight = convergenceResolution;
+
+    auto renderer = std::make_unique<miquella::core::RendererThreads>(scene, camera, std::max(1u, std::thread::hardware_concurrency()));
+    renderer->setBackground(background);
+    return renderer;
+}
+
+static std::unique_ptr<miquella::core::RendererThreads> createConvergenceRenderer(miquella::core::SceneID sceneID)
+{
+    miquella::core::SceneFactory sceneFactory;
+    auto [ scene, camera, background ] = sceneFactory.createScene(sceneID);
+    return createConvergenceRenderer(scene, camera, background);
+}
+
+// Average radiance of each pixel
+static std::vector<glm::vec3> getRadiance(const miquella::core::Renderer& renderer)
+{
+    std::vector<glm::vec3> radiance(renderer.m_imageAccumulated.size());
+    for(size_t i = 0; i < radiance.size(); ++i)
+        radiance[i] = renderer.getPixelRadiance(i);
+    return radiance;
+}
+
+// High sample count image of the scene, computed once per scene with
+// independent numbers, light sampling and a seed not used by the measured
+// renders
+static const std::vector<glm::vec3>& getReferenceRadiance(miquella::core::SceneID sceneID)
+{
+    static std::map<miquella::core::SceneID, std::vector<glm::vec3>> references;
+    auto it = references.find(sceneID);
+    if(it != references.end())
+        return it->second;
+
+    auto renderer = createConvergenceRenderer(sceneID);
+    renderer->setSeed(0xFFFFFFFFu);
+    renderer->setNextEventEstimation(true);
+    renderer->render(convergenceReferenceSamples);
+    return references[sceneID] = getRadiance(*renderer);
+}
+
+static double computeRMSE(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference)
+{
+    double sum = 0.0;
+    for(size_t i = 0; i < image.size(); ++i)
+    {
+        glm::vec3 diff = image[i] - reference[i];
+        sum += static_cast<double>(glm::dot(diff, diff));
+    }
+    return std::sqrt(sum / static_cast<double>(3 * image.size()));
+}
+
+// RMSE of the displayed images: gamma corrected and clamped like the 8 bits
+// image of the renderer
+static double computeDisplayRMSE(const std::vector<glm::vec3>& image, const std::vector<glm::vec3>& reference)
+{
+    auto display = [](const glm::vec3& color)
+    {
+        return glm::vec3(std::sqrt(std::clamp(color.x, 0.f, 1.f)), std::sqrt(std::clamp(color.y, 0.f, 1.f)), std::sqrt(std::clamp(color.z, 0.f, 1.f)));
+    };
+    double sum = 0.0;
+    for(size_t i = 0; i < image.size(); ++i)
+    {
+        glm::vec3 diff = display(image[i]) - display(reference[i]);
+        sum += static_cast<double>(glm::dot(diff, diff));
+    }
+    return std::sqrt(sum / static_cast<double>(3 * image.size()));
+}
+
+// Add one sample per pixel until the time budget, in ms, is spent. Return
+// the number of samples per pixel rendered.
+static size_t renderForDuration(miquella::core::Renderer& renderer, double budget)
+{
+    auto start = std::chrono::steady_clock::now();
+    size_t nbSamples = 0;
+    while(nbSamples == 0 || std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() < budget)
+    {
+        renderer.render();
+        nbSamples++;
+    }
+    return nbSamples;
+}
+
+// RMSE against a high sample count reference after the same rendering time.
+// configure sets up the renderer of each iteration, budget is in ms.
+static void measureConvergence(benchmark::State& state, miquella::core::SceneID sceneID, double budget, const std::function<void(miquella::core::RendererThreads&)>& configure)
+{
+    const auto& reference = getReferenceRadiance(sceneID);
+
+    double rmse = 0.0;
+    size_t nbSamples = 0;
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        auto renderer = createConvergenceRenderer(sceneID);
+        configure(*renderer);
+        state.ResumeTiming();
+
+        nbSamples = renderForDuration(*renderer, budget);
+
+        state.PauseTiming();
+        rmse = computeRMSE(getRadiance(*renderer), reference);
+        state.ResumeTiming();
+    }
+    state.counters["rmse"] = rmse;
+    state.counters["samples"] = static_cast<double>(nbSamples);
+}
+
+// range(0) is the scene, range(1) a miquella::core::SamplerType, range(2)
+// the time budget in ms.
+static void BM_SamplerConvergence(benchmark::State& state)
+{
+    auto sceneID = static_cast<miquella::core::SceneID>(state.range(0));
+    auto samplerType = static_cast<miquella::core::SamplerType>(state.range(1));
+    state.SetLabel(miquella::core::to_string(sceneID) + "/" + miquella::core::to_string(samplerType));
+
+    measureConvergence(state, sceneID, static_cast<double>(state.range(2)), [samplerType](miquella::core::RendererThreads& renderer)
+    {
+        renderer.setSampler(samplerType);
+    });
+}
+
+// With and without next event estimation. range(0) is the scene, range(1)
+// enables light sampling, range(2) is the time budget in ms.
+static void BM_LightSamplingConvergence(benchmark::State& state)
+{
+    auto sceneID = static_cast<miquella::core::SceneID>(state.range(0));
+    bool nextEventEstimation = state.range(1) != 0;
+    state.SetLabel(miquella::core::to_string(sceneID) + (nextEventEstimation ? "/NEE" : "/NO_NEE"));
+
+    measureConvergence(state, sceneID, static_cast<double>(state.range(2)), [nextEventEstimation](miquella::core::RendererThreads& renderer)
+    {
+        renderer.setNextEventEstimation(nextEventEstimation);
+    });
+}
+
+// Adaptive sampling run until every pixel is below the threshold, compared
+// to uniform sampling with the same average number of samples per pixel.
+// range(0) is the scene, range(1) the threshold in 1/10000.
+static void BM_AdaptiveSampling(benchmark::State& state)
+{
+    auto sceneID = static_cast<miquella::core::SceneID>(state.range(0));
+    auto threshold = static_cast<float>(state.range(1)) * 1e-4f;
+    size_t nbSamplesPerCall = 8;
+    size_t maxSamplesPerPixel = 1024;
+    state.SetLabel(miquella::core::to_string(sceneID));
+
+    const auto& reference = getReferenceRadiance(sceneID);
+
+    double adaptiveRMSE = 0.0;
+    double uniformRMSE = 0.0;
+    double samplesPerPixel = 0.0;
+    for(auto _ : state)
+    {
+        auto renderer = createConvergenceRenderer(sceneID);
+        renderer->setAdaptiveSampling(true, threshold);
+        while(renderer->getNbActivePixels() > 0 && renderer->m_nbSamplesAccumulated < maxSamplesPerPixel)
+            renderer->render(nbSamplesPerCall);
+
+        state.PauseTiming();
+        auto nbPixels = static_cast<double>(renderer->m_imageAccumulated.size());
+        samplesPerPixel = static_cast<double>(renderer->getNbSamplesTraced()) / nbPixels;
+        adaptiveRMSE = computeDisplayRMSE(getRadiance(*renderer), reference);
+
+        auto uniformRenderer = createConvergenceRenderer(sceneID);
+        uniformRenderer->render(static_cast<size_t>(std::lround(samplesPerPixel)));
+        uniformRMSE = computeDisplayRMSE(getRadiance(*uniformRenderer), reference);
+        state.ResumeTiming();
+    }
+    state.counters["samples/pixel"] = samplesPerPixel;
+    state.counters["adaptive rmse"] = adaptiveRMSE;
+    state.counters["uniform rmse"] = uniformRMSE;
+}
+
+// Cost and gain of the denoiser: time of the denoising of an image with spp
+// samples per pixel, its RMSE before and after, and the number of samples
+// per pixel the renderer needs to reach the denoised RMSE without
+// denoising, with the time to render them. range(0) is the scene, range(1)
+// the samples per pixel, range(2) a miquella::core::DenoiserISA.
+static void BM_Denoiser(benchmark::State& state)
+{
+    auto sceneID = static_cast<miquella::core::SceneID>(state.range(0));
+    auto spp = static_cast<size_t>(state.range(1));
+    auto isa = static_cast<miquella::core::DenoiserISA>(state.range(2));
+    size_t maxSamplesPerPixel = 64 * spp;
+
+    const auto& reference = getReferenceRadiance(sceneID);
+
+    auto renderer = createConvergenceRenderer(sceneID);
+    renderer->setNextEventEstimation(true);
+    renderer->setDenoising(miquella::core::DenoiseMode::ON_WRITE);
+    renderer->getDenoiser().setISA(isa);
+    renderer->render(spp);
+    state.SetLabel(miquella::core::to_string(sceneID) + "/" + miquella::core::to_string(renderer->getDenoiser().getISA()));
+
+    for(auto _ : state)
+        renderer->denoise();
+
+    std::vector<glm::vec3> denoised(reference.size());
+    for(size_t i = 0; i < denoised.size(); ++i)
+        denoised[i] = renderer->m_denoiser.getPixel(i);
+    double noisyRMSE = computeDisplayRMSE(getRadiance(*renderer), reference);
+    double denoisedRMSE = computeDisplayRMSE(denoised, reference);
+
+    // Same quality without the denoiser, in steps of an eighth of spp
+    size_t step = std::max(spp / 8, size_t(1));
+    auto start = std::chrono::steady_clock::now();
+    while(renderer->m_nbSamplesAccumulated < maxSamplesPerPixel && computeDisplayRMSE(getRadiance(*renderer), reference) > denoisedRMSE)
+        renderer->render(step);
+    auto renderTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    state.counters["noisy rmse"] = noisyRMSE;
+    state.counters["denoised rmse"] = denoisedRMSE;
+    state.counters["equal rmse spp"] = static_cast<double>(renderer->m_nbSamplesAccumulated);
+    state.counters["saved ms"] = renderTime;
+}
+
+// Renderer of the many lights scene at the resolution of the convergence
+// benchmarks, with light sampling
+static std::unique_ptr<miquella::core::RendererThreads> createManyLightsRenderer(uint32_t nbLights, miquella::core::LightSelection selection)
+{
+    miquella::core::SceneFactory sceneFactory;
+    auto [ scene, camera, background ] = sceneFactory.createManyLights(nbLights);
+    auto renderer = createConvergenceRenderer(scene, camera, background);
+    renderer->setNextEventEstimation(true);
+    renderer->setLightSelection(selection);
+    return renderer;
+}
+
+// Time per sample and RMSE after the same number of samples, with the lights
+// selected uniformly or with the light tree. range(0) is the number of
+// lights, range(1) a miquella::core::LightSelection.
+static void BM_ManyLights(benchmark::State& state)
+{
+    auto nbLights = static_cast<uint32_t>(state.range(0));
+    auto selection = static_cast<miquella::core::LightSelection>(state.range(1));
+    size_t nSamples = 16;
+    state.SetLabel(miquella::core::to_string(selection));
+
+    // The reference of each number of lights is computed once with the tree
+    static std::map<uint32_t, std::vector<glm::vec3>> references;
+    if(references.find(nbLights) == references.end())
+    {
+        auto renderer = createManyLightsRenderer(nbLights, miquella::core::LightSelection::TREE);
+        renderer->setSeed(0xFFFFFFFFu);
+        renderer->render(convergenceReferenceSamples / 4);
+        references[nbLights] = getRadiance(*renderer);
+    }
+
+    double rmse = 0.0;
+    double msPerSample = 0.0;
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        auto renderer = createManyLightsRenderer(nbLights, selection);
+        renderFirstSample(*renderer);
+        state.ResumeTiming();
+
+        auto start = std::chrono::steady_clock::now();
+        renderer->render(nSamples);
+        auto end = std::chrono::steady_clock::now();
+        msPerSample = std::chrono::duration<double, std::milli>(end - start).count() / static_cast<double>(nSamples);
+
+        state.PauseTiming();
+        rmse = computeRMSE(getRadiance(*renderer), references[nbLights]);
+        state.ResumeTiming();
+    }
+    state.counters["ms/sample"] = msPerSample;
+    state.counters["rmse"] = rmse;
+}
+
+// Wall time of a 640x360 job sending a checkpoint every 4 samples, with the
+// uploads made on the render thread or by the upload queue while the next
+// samples are rendered. The network is simulated by a sleep of range(1) ms
+// after encoding the image. range(0) enables the queue.
+static void BM_CheckpointUpload(benchmark::State& state)
+{
+    bool overlapped = state.range(0) != 0;
+    auto roundTrip = std::chrono::milliseconds(state.range(1));
+    size_t nSamples = 32;
+    size_t outputFrequency = 4;
+    auto nbThreads = std::max(1u, std::thread::hardware_concurrency());
+
+    miquella::core::SceneFactory sceneFactory;
+    auto [ scene, camera, background ] = sceneFactory.createScene(miquella::core::SceneID::SCENE_THREE_BALLS);
+    camera->m_imageWidth = 640;
+    camera->m_imageHeight = 360;
+
+    double waitTime = 0.0;
+    for(auto _ : state)
+    {
+        state.PauseTiming();
+        miquella::core::RendererThreads renderer(scene, camera, nbThreads);
+        renderer.setBackground(background);
+        state.ResumeTiming();
+
+        miquella::http::UploadQueue uploads(overlapped ? 2 : 0);
+        for(size_t i = 0; i < nSamples; i += outputFrequency)
+        {
+            renderer.render(outputFrequency);
+
+            std::vector<unsigned char> image;
+            renderer.getOutputImage(image);
+            int width = renderer.getImageWidth();
+            int height = renderer.getImageHeight();
+            uploads.push([=, image = std::move(image)]
+            {
+                std::string buffer;
+                miquella::core::io::encodePPM(width, height, image, buffer);
+                benchmark::DoNotOptimize(buffer.data());
+                std::this_thread::sleep_for(roundTrip);
+                return true;
+            });
+        }
+        uploads.finish();
+        waitTime = uploads.getWaitTime();
+    }
+    state.SetLabel(overlapped ? "overlapped" : "synchronous");
+    state.counters["queue wait ms"] = waitTime;
+}
+
+static void accelerationArguments(benchmark::internal::Benchmark* benchmark)
+{
+    // The random balls are rendered with more samples, they are faster to intersect
+    for(auto [ sceneID, nSamples ] : { std::pair{ miquella::core::SceneID::SCENE_ONE_WEEKEND, 10 }, std::pair{ miquella::core::SceneID::SCENE_RANDOM_BALLS, 50 } })
+    {
+        for(auto accel : { miquella::core::AccelerationStructure::LINEAR, miquella::core::AccelerationStructure::BVH, miquella::core::AccelerationStructure::WIDE_BVH_4, miquella::core::AccelerationStructure::WIDE_BVH_8 })
+            benchmark->Args({ static_cast<int64_t>(sceneID), static_cast<int64_t>(accel), nSamples });
+    }
+}
+
+static void samplerConvergenceArguments(benchmark::internal::Benchmark* benchmark)
+{
+    for(auto scene : { miquella::core::SceneID::SCENE_EMPTY_CORNEL, miquella::core::SceneID::SCENE_SPHERE_CORNEL })
+    {
+        for(auto sampler : { miquella::core::SamplerType::INDEPENDENT, miquella::core::SamplerType::SOBOL, miquella::core::SamplerType::BLUE_NOISE })
+        {
+            for(int64_t budget : { 250, 1000, 4000 })
+                benchmark->Args({ static_cast<int64_t>(scene), static_cast<int64_t>(sampler), budget });
+        }
+    }
+}
+
+static void lightSamplingConvergenceArguments(benchmark::internal::Benchmark* benchmark)
+{
+    for(auto scene : { miquella::core::SceneID::SCENE_EMPTY_CORNEL, miquella::core::SceneID::SCENE_SPHERE_CORNEL })
+    {
+        for(int64_t nextEventEstimation : { 0, 1 })
+        {
+            for(int64_t budget : { 250, 1000, 4000 })
+                benchmark->Args({ static_cast<int64_t>(scene), nextEventEstimation, budget });
+        }
     }
 }
 
 BENCHMARK(BM_ThreeBall)->Args({6,6})->Args({6, 12})->MeasureProcessCPUTime();
 BENCHMARK(BM_OneWeekend)->Args({6,6})->Args({6, 12});
+BENCHMARK(BM_Acceleration)->Apply(accelerationArguments);
+BENCHMARK(BM_SchedulingScaling)->Apply(schedulingScalingArguments)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_TileOrder)->ArgsProduct({{0, 1, 2}, {1080, 2160}})->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SamplesPerDispatch)->Arg(1)->Arg(4)->Arg(16)->Arg(64)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MaxDepth)->ArgsProduct({{2, 5, 10, 20, 50}, {0, 1}})->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SamplerConvergence)->Apply(samplerConvergenceArguments)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LightSamplingConvergence)->Apply(lightSamplingConvergenceArguments)->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_AdaptiveSampling)->ArgsProduct({{0, 7}, {100, 200, 400}})->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_ManyLights)->ArgsProduct({{16, 256, 4096}, {0, 1}})->Iterations(1)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Denoiser)->ArgsProduct({{0, 7}, {4, 16, 64}, {0, 1}})->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CheckpointUpload)->ArgsProduct({{0, 1}, {0, 20, 100}})->Iterations(5)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MillionSpheres)->Arg(1)->Arg(2)->Arg(3)->Unit(benchmark::kMillisecond);
 
 BENCHMARK_MAIN();
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <benchmark/benchmark.h>
+
+#include <random>
+
+#include <miquella/core/compiledScene.h>
+#include <miquella/core/sphereKernels.h>
+#include <miquella/core/tonemap.h>
+#include <miquella/core/utility.h>
+
+// Ray/sphere kernel throughput. range(0) is a miquella::core::SphereKernelISA,
+// range(1) the number of spheres tested per ray.
+static void BM_SphereKernel(benchmark::State& state)
+{
+    auto isa = static_cast<miquella::core::SphereKernelISA>(state.range(0));
+    auto nbSpheres = static_cast<uint32_t>(state.range(1));
+    state.SetLabel(miquella::core::to_string(isa));
+    if(miquella::core::resolveSphereKernelISA(isa) != isa)
+    {
+        state.SkipWithError("Instruction set not supported by this CPU");
+        return;
+    }
+
+    miquella::core::SphereArray spheres;
+    for(uint32_t i = 0; i < nbSpheres; ++i)
+    {
+        spheres.m_centerX.push_back(miquella::core::randomFloat(-50.f, 50.f));
+        spheres.m_centerY.push_back(miquella::core::randomFloat(-50.f, 50.f));
+        spheres.m_centerZ.push_back(miquella::core::randomFloat(-50.f, 50.f));
+        spheres.m_radius.push_back(miquella::core::randomFloat(0.1f, 2.f));
+        spheres.m_material.push_back(0);
+    }
+
+    std::vector<miquella::core::Ray> rays;
+    for(size_t i = 0; i < 1024; ++i)
+        rays.emplace_back(glm::vec3(0.f, 0.f, 0.f), miquella::core::randomUnitVec3());
+
+    auto kernel = miquella::core::getSphereKernel(isa);
+    for(auto _ : state)
+    {
+        size_t nbHits = 0;
+        for(auto & ray : rays)
+        {
+            uint32_t index;
+            float t;
+            if(kernel(spheres, 0, nbSpheres, ray, 0.001f, std::numeric_limits<float>::max(), index, t))
+                nbHits++;
+        }
+        benchmark::DoNotOptimize(nbHits);
+    }
+
+    auto nbIntersections = static_cast<double>(state.iterations()) * static_cast<double>(rays.size()) * static_cast<double>(nbSpheres);
+    state.counters["intersections"] = benchmark::Counter(nbIntersections, benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_SphereKernel)->ArgsProduct({{0, 1, 2}, {16, 1024, 65536}});
+
+// Conversion of a 1920x1080 accumulated image to the displayed 8 bits image.
+// range(0) is a miquella::core::TonemapISA.
+static void BM_Tonemap(benchmark::State& state)
+{
+    auto isa = static_cast<miquella::core::TonemapISA>(state.range(0));
+    state.SetLabel(miquella::core::to_string(isa));
+    if(miquella::core::resolveTonemapISA(isa) != isa)
+    {
+        state.SkipWithError("Instruction set not supported by this CPU");
+        return;
+    }
+
+    const size_t nbPixels = 1920 * 1080;
+    std::vector<glm::vec3> accumulated(nbPixels);
+    std::vector<uint32_t> samples(nbPixels, 64);
+    for(auto & pixel : accumulated)
+        pixel = 64.f * glm::vec3(miquella::core::randomFloat(0.f, 1.2f), miquella::core::randomFloat(0.f, 1.2f), miquella::core::randomFloat(0.f, 1.2f));
+    std::vector<unsigned char> image(4 * nbPixels);
+
+    auto kernel = miquella::core::getTonemapKernel(isa);
+    for(auto _ : state)
+    {
+        kernel(accumulated.data(), samples.data(), nbPixels, image.data());
+        benchmark::DoNotOptimize(image.data());
+        benchmark::ClobberMemory();
+    }
+
+    state.counters["pixels"] = benchmark::Counter(static_cast<double>(state.iterations()) * static_cast<double>(nbPixels), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_Tonemap)->Arg(0)->Arg(1)->Arg(2)->Unit(benchmark::kMillisecond);
+
+// Random numbers drawn by a path: a few per bounce, for each bounce of a sample
+static constexpr int nbNumbersPerSample = 64;
+
+// Previous generator of the renderers, kept as the reference: one thread_local
+// std::mt19937 behind a std::uniform_real_distribution.
+static void BM_RandomFloatMersenne(benchmark::State& state)
+{
+    static thread_local std::mt19937 generator(0);
+    static thread_local std::uniform_real_distribution<float> distribution(0.f, 1.f);
+    float sum = 0.f;
+    for(auto _ : state)
+    {
+        for(int n = 0; n < nbNumbersPerSample; ++n)
+            sum += distribution(generator);
+    }
+    benchmark::DoNotOptimize(sum);
+    state.counters["numbers"] = benchmark::Counter(static_cast<double>(state.iterations() * nbNumbersPerSample), benchmark::Counter::kIsRate);
+}
+
+// Counter based generator of the renderers, including the construction of
+// the generator of each sample.
+static void BM_RandomFloatPhilox(benchmark::State& state)
+{
+    float sum = 0.f;
+    uint32_t pixel = 0;
+    for(auto _ : state)
+    {
+        miquella::core::PixelRNG rng(pixel++, 0);
+        for(int n = 0; n < nbNumbersPerSample; ++n)
+        {
+            if(n % 8 == 0)
+                rng.setBounce(static_cast<uint32_t>(n / 8));
+            sum += rng.nextFloat();
+        }
+    }
+    benchmark::DoNotOptimize(sum);
+    state.counters["numbers"] = benchmark::Counter(static_cast<double>(state.iterations() * nbNumbersPerSample), benchmark::Counter::kIsRate);
+}
+
+BENCHMARK(BM_RandomFloatMersenne);
+BENCHMARK(BM_RandomFloatPhilox);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Hardware event counter of the calling thread and of the threads it creates
+// after the counter is opened, read through perf_event_open. isValid() is
+// false when the counter is not available: other platforms, virtual machines
+// without PMU, or a restrictive kernel.perf_event_paranoid.
+class PerfCounter
+{
+public:
+    // Last level cache read misses
+    static PerfCounter llcMisses()
+    {
+#ifdef __linux__
+        return PerfCounter(PERF_TYPE_HW_CACHE,
+                           PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+#else
+        return PerfCounter(0, 0);
+#endif
+    }
+
+    PerfCounter(uint32_t type, uint64_t config)
+    {
+#ifdef __linux__
+        perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.inherit = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#else
+        (void)type;
+        (void)config;
+#endif
+    }
+
+    PerfCounter(const PerfCounter&) = delete;
+    PerfCounter& operator=(const PerfCounter&) = delete;
+
+    PerfCounter(PerfCounter&& other) noexcept : m_fd(other.m_fd)
+    {
+        other.m_fd = -1;
+    }
+
+    ~PerfCounter()
+    {
+#ifdef __linux__
+        if(m_fd >= 0)
+            close(m_fd);
+#endif
+    }
+
+    bool isValid() const { return m_fd >= 0; }
+
+    void start()
+    {
+#ifdef __linux__
+        if(m_fd >= 0)
+        {
+            ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    void stop()
+    {
+#ifdef __linux__
+        if(m_fd >= 0)
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+#endif
+    }
+
+    // Sum over the thread and its children
+    uint64_t read() const
+    {
+        uint64_t value = 0;
+#ifdef __linux__
+        if(m_fd >= 0 && ::read(m_fd, &value, sizeof(value)) != static_cast<ssize_t>(sizeof(value)))
+            value = 0;
+#endif
+        return value;
+    }
+
+private:
+    int m_fd = -1;
+};
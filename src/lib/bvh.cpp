@@ -0,0 +1,171 @@
+#include <miquella/core/bvh.h>
+
+#include <numeric>
+#include <array>
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    constexpr uint32_t NB_BINS = 16;
+
+    // Past this depth, splits fall back to the median to guarantee that the
+    // tree never exceeds BVH::MAX_DEPTH.
+    constexpr uint32_t MAX_SAH_DEPTH = 40;
+
+    // Relative cost of traversing a node compared to intersecting a primitive
+    constexpr float TRAVERSAL_COST = 1.f;
+
+    struct Bin
+    {
+        AABB m_box;
+        uint32_t m_count = 0;
+    };
+}
+
+void BVH::build(const std::vector<AABB>& boxes, uint32_t maxLeafSize)
+{
+    clear();
+    if(boxes.empty())
+        return;
+
+    std::vector<glm::vec3> centroids(boxes.size());
+    for(size_t i = 0; i < boxes.size(); ++i)
+        centroids[i] = boxes[i].centroid();
+
+    m_primitiveIndices.resize(boxes.size());
+    std::iota(m_primitiveIndices.begin(), m_primitiveIndices.end(), 0u);
+    m_nodes.reserve(2 * boxes.size());
+
+    _buildRecursive(boxes, centroids, 0, static_cast<uint32_t>(boxes.size()), 0, std::max(maxLeafSize, 1u));
+}
+
+uint32_t BVH::_buildRecursive(const std::vector<AABB>& boxes, const std::vector<glm::vec3>& centroids, uint32_t begin, uint32_t end, uint32_t depth, uint32_t maxLeafSize)
+{
+    uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    AABB bounds;
+    AABB centroidBounds;
+    for(uint32_t i = begin; i < end; ++i)
+    {
+        bounds.extend(boxes[m_primitiveIndices[i]]);
+        centroidBounds.extend(centroids[m_primitiveIndices[i]]);
+    }
+    m_nodes[nodeIndex].m_box = bounds;
+
+    uint32_t count = end - begin;
+    auto makeLeaf = [&]()
+    {
+        m_nodes[nodeIndex].m_offset = begin;
+        m_nodes[nodeIndex].m_count = static_cast<uint16_t>(count);
+        return nodeIndex;
+    };
+
+    if(count == 1)
+        return makeLeaf();
+
+    int axis = centroidBounds.longestAxis();
+    float axisMin = centroidBounds.m_min[axis];
+    float axisExtent = centroidBounds.m_max[axis] - axisMin;
+
+    uint32_t mid = begin + count / 2;
+    auto indexBegin = m_primitiveIndices.begin() + begin;
+    auto indexEnd = m_primitiveIndices.begin() + end;
+
+    if(axisExtent <= 0.f)
+    {
+        // All centroids are identical, no split can separate them
+        if(count <= maxLeafSize)
+            return makeLeaf();
+    }
+    else if(depth >= MAX_SAH_DEPTH)
+    {
+        std::nth_element(indexBegin, m_primitiveIndices.begin() + mid, indexEnd,
+            [&](uint32_t a, uint32_t b){ return centroids[a][axis] < centroids[b][axis]; });
+    }
+    else
+    {
+        // Binned SAH: project the centroids into NB_BINS buckets along the
+        // longest axis and evaluate the cost of splitting after each bucket.
+        std::array<Bin, NB_BINS> bins;
+        float binScale = static_cast<float>(NB_BINS) / axisExtent;
+        auto binIndex = [&](uint32_t prim)
+        {
+            auto b = static_cast<uint32_t>((centroids[prim][axis] - axisMin) * binScale);
+            return std::min(b, NB_BINS - 1);
+        };
+
+        for(uint32_t i = begin; i < end; ++i)
+        {
+            auto& bin = bins[binIndex(m_primitiveIndices[i])];
+            bin.m_count++;
+            bin.m_box.extend(boxes[m_primitiveIndices[i]]);
+        }
+
+        // Sweep from the right to get the area and count of each right side
+        std::array<float, NB_BINS - 1> rightArea;
+        std::array<uint32_t, NB_BINS - 1> rightCount;
+        AABB rightBox;
+        uint32_t rightSum = 0;
+        for(uint32_t i = NB_BINS - 1; i > 0; --i)
+        {
+            rightBox.extend(bins[i].m_box);
+            rightSum += bins[i].m_count;
+            rightArea[i - 1] = rightBox.surfaceArea();
+            rightCount[i - 1] = rightSum;
+        }
+
+        float bestCost = std::numeric_limits<float>::max();
+        uint32_t bestSplit = 0;
+        AABB leftBox;
+        uint32_t leftSum = 0;
+        for(uint32_t i = 0; i < NB_BINS - 1; ++i)
+        {
+            leftBox.extend(bins[i].m_box);
+            leftSum += bins[i].m_count;
+            if(leftSum == 0 || rightCount[i] == 0)
+                continue;
+            float cost = leftBox.surfaceArea() * static_cast<float>(leftSum) + rightArea[i] * static_cast<float>(rightCount[i]);
+            if(cost < bestCost)
+            {
+                bestCost = cost;
+                bestSplit = i;
+            }
+        }
+
+        float parentArea = bounds.surfaceArea();
+        float splitCost = parentArea > 0.f ? TRAVERSAL_COST + bestCost / parentArea : std::numeric_limits<float>::max();
+        float leafCost = static_cast<float>(count);
+
+        if(count <= maxLeafSize && leafCost <= splitCost)
+            return makeLeaf();
+
+        if(bestCost < std::numeric_limits<float>::max())
+        {
+            auto midIt = std::partition(indexBegin, indexEnd,
+                [&](uint32_t prim){ return binIndex(prim) <= bestSplit; });
+            mid = static_cast<uint32_t>(midIt - m_primitiveIndices.begin());
+        }
+        else
+        {
+            std::nth_element(indexBegin, m_primitiveIndices.begin() + mid, indexEnd,
+                [&](uint32_t a, uint32_t b){ return centroids[a][axis] < centroids[b][axis]; });
+        }
+    }
+
+    _buildRecursive(boxes, centroids, begin, mid, depth + 1, maxLeafSize);
+    uint32_t secondChild = _buildRecursive(boxes, centroids, mid, end, depth + 1, maxLeafSize);
+
+    m_nodes[nodeIndex].m_offset = secondChild;
+    m_nodes[nodeIndex].m_count = 0;
+    m_nodes[nodeIndex].m_axis = static_cast<uint8_t>(axis);
+
+    return nodeIndex;
+}
+
+} // core
+
+} // miquella
@@ -0,0 +1,286 @@
+#include <miquella/core/compiledScene.h>
+#include <miquella/core/scene.h>
+#include <miquella/core/rectangle.h>
+#include <miquella/core/cpuFeatures.h>
+
+#include <numeric>
+#include <algorithm>
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    template<int K, int A, int B>
+    inline bool intersectRectangle(const RectangleArray& rectangles, uint32_t i, const Ray & r, float tmin, float tmax, float& t)
+    {
+        auto tHit = (rectangles.m_k[i] - r.m_orig[K]) / r.m_dir[K];
+        if (tHit < tmin || tHit > tmax)
+            return false;
+        auto a = r.m_orig[A] + tHit*r.m_dir[A];
+        auto b = r.m_orig[B] + tHit*r.m_dir[B];
+        if (a < rectangles.m_a0[i] || a > rectangles.m_a1[i] || b < rectangles.m_b0[i] || b > rectangles.m_b1[i])
+            return false;
+
+        t = tHit;
+        return true;
+    }
+
+    void pushRectangle(RectangleArray& rectangles, float a0, float a1, float b0, float b1, float k, uint32_t material)
+    {
+        rectangles.m_a0.push_back(a0);
+        rectangles.m_a1.push_back(a1);
+        rectangles.m_b0.push_back(b0);
+        rectangles.m_b1.push_back(b1);
+        rectangles.m_k.push_back(k);
+        rectangles.m_material.push_back(material);
+    }
+}
+
+CompiledScene::CompiledScene(const Scene& scene)
+{
+    const auto& objects = scene.m_objects;
+
+    std::vector<AABB> boxes;
+    boxes.reserve(objects.size());
+    for(auto & obj : objects)
+        boxes.push_back(obj->boundingBox());
+
+    // Primitives are laid out in the order of the BVH leaves so that the
+    // traversal walks the arrays mostly linearly.
+    std::vector<uint32_t> order(objects.size());
+    std::iota(order.begin(), order.end(), 0u);
+    m_useLinear = scene.m_accelerationStructure == AccelerationStructure::LINEAR;
+    m_sphereKernel = getSphereKernel();
+    if(!m_useLinear)
+    {
+        // Larger leaves let the vectorized sphere kernel test several spheres at once
+        m_bvh.build(boxes, std::max(4u, getSphereKernelWidth(SphereKernelISA::AUTO)));
+        order = m_bvh.m_primitiveIndices;
+        std::iota(m_bvh.m_primitiveIndices.begin(), m_bvh.m_primitiveIndices.end(), 0u);
+    }
+
+    m_materials = scene.m_materials;
+
+    // The lights are the emitting objects, in the order of Scene::m_lights.
+    // They are matched to the primitives by object index, the objects of
+    // m_lights are not the same pointers in a cloned scene.
+    std::vector<uint32_t> objectLights(objects.size(), NO_LIGHT);
+    std::vector<AABB> lightBoxes;
+    std::vector<float> lightPowers;
+    for(size_t index = 0; index < objects.size(); ++index)
+    {
+        const auto& light = objects[index];
+        if(!light->isLightSource())
+            continue;
+
+        objectLights[index] = static_cast<uint32_t>(m_lights.size());
+        m_lights.push_back(light);
+
+        glm::vec3 emitted = scene.getMaterial(light->m_materialID).emitted();
+        lightBoxes.push_back(light->boundingBox());
+        lightPowers.push_back(luminance(emitted) * light->area());
+    }
+    m_lightTree.build(lightBoxes, lightPowers);
+
+    m_primitives.reserve(objects.size());
+    m_primitiveLights.reserve(objects.size());
+    m_primitiveObjects.reserve(objects.size());
+    for(auto index : order)
+    {
+        const auto& obj = objects[index];
+        uint32_t material = obj->m_materialID;
+        m_primitiveLights.push_back(objectLights[index]);
+        m_primitiveObjects.push_back(index);
+
+        if(auto sphere = dynamic_cast<const Sphere*>(obj.get()))
+        {
+            m_primitives.push_back({ PrimitiveType::SPHERE, static_cast<uint32_t>(m_spheres.size()) });
+            m_spheres.m_centerX.push_back(sphere->m_center.x);
+            m_spheres.m_centerY.push_back(sphere->m_center.y);
+            m_spheres.m_centerZ.push_back(sphere->m_center.z);
+            m_spheres.m_radius.push_back(sphere->m_r);
+            m_spheres.m_material.push_back(material);
+        }
+        else if(auto xy = dynamic_cast<const xyRectangle*>(obj.get()))
+        {
+            m_primitives.push_back({ PrimitiveType::XY_RECTANGLE, static_cast<uint32_t>(m_xyRectangles.size()) });
+            pushRectangle(m_xyRectangles, xy->m_x0, xy->m_x1, xy->m_y0, xy->m_y1, xy->m_z, material);
+        }
+        else if(auto xz = dynamic_cast<const xzRectangle*>(obj.get()))
+        {
+            m_primitives.push_back({ PrimitiveType::XZ_RECTANGLE, static_cast<uint32_t>(m_xzRectangles.size()) });
+            pushRectangle(m_xzRectangles, xz->m_x0, xz->m_x1, xz->m_z0, xz->m_z1, xz->m_y, material);
+        }
+        else if(auto yz = dynamic_cast<const yzRectangle*>(obj.get()))
+        {
+            m_primitives.push_back({ PrimitiveType::YZ_RECTANGLE, static_cast<uint32_t>(m_yzRectangles.size()) });
+            pushRectangle(m_yzRectangles, yz->m_y0, yz->m_y1, yz->m_z0, yz->m_z1, yz->m_x, material);
+        }
+        else
+        {
+            m_primitives.push_back({ PrimitiveType::OBJECT, static_cast<uint32_t>(m_objects.size()) });
+            m_objects.push_back(obj);
+        }
+    }
+
+    switch(scene.m_accelerationStructure)
+    {
+        case AccelerationStructure::WIDE_BVH_4:
+            m_wideBvh.build(m_bvh, 4);
+            break;
+        case AccelerationStructure::WIDE_BVH_8:
+            m_wideBvh.build(m_bvh, 8);
+            break;
+        case AccelerationStructure::AUTO:
+#ifdef MQ_ARCH_X86_64
+            m_wideBvh.build(m_bvh);
+#endif
+            break;
+        default:
+            break;
+    }
+}
+
+bool CompiledScene::_intersectPrimitive(const PrimitiveRef& primitive, const Ray & r, float tmin, float tmax, float& t) const
+{
+    switch(primitive.m_type)
+    {
+        case PrimitiveType::SPHERE:
+        {
+            uint32_t sphere;
+            return intersectSpheresScalar(m_spheres, primitive.m_index, primitive.m_index + 1, r, tmin, tmax, sphere, t);
+        }
+        case PrimitiveType::XY_RECTANGLE:
+            return intersectRectangle<2, 0, 1>(m_xyRectangles, primitive.m_index, r, tmin, tmax, t);
+        case PrimitiveType::XZ_RECTANGLE:
+            return intersectRectangle<1, 0, 2>(m_xzRectangles, primitive.m_index, r, tmin, tmax, t);
+        case PrimitiveType::YZ_RECTANGLE:
+            return intersectRectangle<0, 1, 2>(m_yzRectangles, primitive.m_index, r, tmin, tmax, t);
+        case PrimitiveType::OBJECT:
+        {
+            hitRecord record;
+            if(!m_objects[primitive.m_index]->intersect(r, tmin, tmax, record))
+                return false;
+            t = record.t;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void CompiledScene::_fillRecord(const PrimitiveRef& primitive, const Ray & r, float t, hitRecord& record) const
+{
+    auto i = primitive.m_index;
+    record.t = t;
+    record.p = r.at(t);
+    switch(primitive.m_type)
+    {
+        case PrimitiveType::SPHERE:
+        {
+            glm::vec3 center(m_spheres.m_centerX[i], m_spheres.m_centerY[i], m_spheres.m_centerZ[i]);
+            record.setFaceNormal(r, (record.p - center) / m_spheres.m_radius[i]);
+            record.materialID = m_spheres.m_material[i];
+            break;
+        }
+        case PrimitiveType::XY_RECTANGLE:
+            record.setFaceNormal(r, glm::vec3(0, 0, 1));
+            record.materialID = m_xyRectangles.m_material[i];
+            break;
+        case PrimitiveType::XZ_RECTANGLE:
+            record.setFaceNormal(r, glm::vec3(0, 1, 0));
+            record.materialID = m_xzRectangles.m_material[i];
+            break;
+        case PrimitiveType::YZ_RECTANGLE:
+            record.setFaceNormal(r, glm::vec3(1, 0, 0));
+            record.materialID = m_yzRectangles.m_material[i];
+            break;
+        case PrimitiveType::OBJECT:
+            // Intersect again to let the object compute its own normal and material
+            m_objects[i]->intersect(r, t, t, record);
+            break;
+        default:
+            break;
+    }
+}
+
+bool CompiledScene::_intersectRange(uint32_t first, uint32_t count, const Ray & r, float tmin, float& tmax, uint32_t& closest) const
+{
+    bool hitFound = false;
+    uint32_t i = first;
+    const uint32_t end = first + count;
+    while(i < end)
+    {
+        const PrimitiveRef& primitive = m_primitives[i];
+        if(primitive.m_type == PrimitiveType::SPHERE)
+        {
+            // Spheres are stored in primitive order, so a run of sphere
+            // primitives is a contiguous range of the sphere array.
+            uint32_t runEnd = i + 1;
+            while(runEnd < end && m_primitives[runEnd].m_type == PrimitiveType::SPHERE)
+                ++runEnd;
+
+            uint32_t sphereBegin = primitive.m_index;
+            uint32_t sphere;
+            float t;
+            if(m_sphereKernel(m_spheres, sphereBegin, sphereBegin + (runEnd - i), r, tmin, tmax, sphere, t))
+            {
+                tmax = t;
+                closest = i + (sphere - sphereBegin);
+                hitFound = true;
+            }
+            i = runEnd;
+            continue;
+        }
+
+        float t;
+        if(_intersectPrimitive(primitive, r, tmin, tmax, t))
+        {
+            tmax = t;
+            closest = i;
+            hitFound = true;
+        }
+        ++i;
+    }
+    return hitFound;
+}
+
+bool CompiledScene::intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const
+{
+    // Only the distance is computed during the traversal, the hit record is
+    // filled once for the closest primitive.
+    uint32_t closest = 0;
+    float closestT = tmax;
+    auto intersectLeaf = [&](uint32_t first, uint32_t count, float& currentMax)
+    {
+        if(_intersectRange(first, count, r, tmin, currentMax, closest))
+        {
+            closestT = currentMax;
+            return true;
+        }
+        return false;
+    };
+
+    bool hitFound = false;
+    float currentMax = tmax;
+    if(m_useLinear)
+        hitFound = intersectLeaf(0, static_cast<uint32_t>(m_primitives.size()), currentMax);
+    else if(!m_wideBvh.isEmpty())
+        hitFound = m_wideBvh.traverse(r, tmin, tmax, intersectLeaf);
+    else
+        hitFound = m_bvh.traverse(r, tmin, tmax, intersectLeaf);
+
+    if(!hitFound)
+        return false;
+
+    _fillRecord(m_primitives[closest], r, closestT, record);
+    record.lightID = m_primitiveLights[closest];
+    record.objectID = m_primitiveObjects[closest];
+    return true;
+}
+
+} // core
+
+} // miquella
@@ -0,0 +1,340 @@
+#include <miquella/core/denoiser.h>
+#include <miquella/core/cpuFeatures.h>
+#include <miquella/core/utility.h>
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#ifdef MQ_ARCH_X86_64
+#include <immintrin.h>
+#endif
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    // 1D B3 spline, the 5x5 kernel is the product of two of them
+    const float splineWeights[5] = { 1.f/16.f, 1.f/4.f, 3.f/8.f, 1.f/4.f, 1.f/16.f };
+
+    // Avoids dividing by 0 when both depths are 0 (background)
+    const float minDepthVariance = 1e-6f;
+
+    // Half a level of the 8 bits display
+    const float minColorError = 0.002f;
+
+    // Coefficients of 2^f on [0, 1), degree 5, relative error below 2e-7
+    const float exp2Coefficients[5] = { 0.693147182f, 0.240226507f, 0.0555041087f, 0.00961812911f, 0.00133335581f };
+
+    // e^x for x <= 0, flushed to about 1e-24 below -55. The scalar and AVX2
+    // versions use the same formula so both kernels give close results.
+    inline float fastExp(float x)
+    {
+        float t = std::max(x * 1.44269504f, -80.f);
+        float fi = std::floor(t);
+        float f = t - fi;
+        float p = exp2Coefficients[4];
+        for(int k = 3; k >= 0; --k)
+            p = p*f + exp2Coefficients[k];
+        p = p*f + 1.f;
+
+        auto bits = static_cast<uint32_t>(static_cast<int>(fi) + 127) << 23;
+        float scale;
+        std::memcpy(&scale, &bits, sizeof(float));
+        return p * scale;
+    }
+
+    // Planes read and written by one iteration, and its constants
+    struct FilterPass
+    {
+        int m_width;
+        int m_height;
+        int m_step;
+
+        const float* m_color[3];
+        const float* m_guide;
+        const float* m_normal[3];
+        const float* m_albedo[3];
+        const float* m_depth;
+        const float* m_invColorVariance;
+
+        float m_colorScale;         // Tightens the color stopping at each iteration
+        float m_invSigmaNormal2;
+        float m_invSigmaAlbedo2;
+        float m_sigmaDepth2;        // Relative to the depth, times the step
+
+        float* m_outColor[3];
+        float* m_outGuide;
+    };
+
+    void filterPixelScalar(const FilterPass& pass, int x, int y)
+    {
+        auto p = static_cast<size_t>(y*pass.m_width + x);
+        const float guide = pass.m_guide[p];
+        const float invColor = pass.m_invColorVariance[p] * pass.m_colorScale;
+        const glm::vec3 normal(pass.m_normal[0][p], pass.m_normal[1][p], pass.m_normal[2][p]);
+        const glm::vec3 albedo(pass.m_albedo[0][p], pass.m_albedo[1][p], pass.m_albedo[2][p]);
+        const float depth = pass.m_depth[p];
+        const float invDepth = 1.f / (pass.m_sigmaDepth2 * depth * depth + minDepthVariance);
+
+        glm::vec3 sum(0.f, 0.f, 0.f);
+        float sumWeights = 0.f;
+        for(int dy = -2; dy <= 2; ++dy)
+        {
+            int qy = y + dy*pass.m_step;
+            if(qy < 0 || qy >= pass.m_height)
+                continue;
+            for(int dx = -2; dx <= 2; ++dx)
+            {
+                int qx = x + dx*pass.m_step;
+                if(qx < 0 || qx >= pass.m_width)
+                    continue;
+
+                auto q = static_cast<size_t>(qy*pass.m_width + qx);
+                float dGuide = pass.m_guide[q] - guide;
+                glm::vec3 dNormal = glm::vec3(pass.m_normal[0][q], pass.m_normal[1][q], pass.m_normal[2][q]) - normal;
+                glm::vec3 dAlbedo = glm::vec3(pass.m_albedo[0][q], pass.m_albedo[1][q], pass.m_albedo[2][q]) - albedo;
+                float dDepth = pass.m_depth[q] - depth;
+
+                float distance = dGuide*dGuide*invColor + glm::dot(dNormal, dNormal)*pass.m_invSigmaNormal2
+                               + glm::dot(dAlbedo, dAlbedo)*pass.m_invSigmaAlbedo2 + dDepth*dDepth*invDepth;
+                float weight = splineWeights[dx + 2] * splineWeights[dy + 2] * fastExp(-distance);
+                sum += weight * glm::vec3(pass.m_color[0][q], pass.m_color[1][q], pass.m_color[2][q]);
+                sumWeights += weight;
+            }
+        }
+
+        // The center tap always has a positive weight
+        glm::vec3 color = sum / sumWeights;
+        pass.m_outColor[0][p] = color.x;
+        pass.m_outColor[1][p] = color.y;
+        pass.m_outColor[2][p] = color.z;
+        pass.m_outGuide[p] = std::sqrt(std::max(luminance(color), 0.f));
+    }
+
+#ifdef MQ_ARCH_X86_64
+
+    MQ_TARGET("avx2,fma") inline __m256 fastExpAVX2(__m256 x)
+    {
+        __m256 t = _mm256_max_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _mm256_set1_ps(-80.f));
+        __m256 fi = _mm256_floor_ps(t);
+        __m256 f = _mm256_sub_ps(t, fi);
+        __m256 p = _mm256_set1_ps(exp2Coefficients[4]);
+        for(int k = 3; k >= 0; --k)
+            p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(exp2Coefficients[k]));
+        p = _mm256_fmadd_ps(p, f, _mm256_set1_ps(1.f));
+
+        __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(fi), _mm256_set1_epi32(127)), 23);
+        return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+    }
+
+    MQ_TARGET("avx2,fma") inline __m256 squaredDifferenceAVX2(const float* const planes[3], size_t q, __m256 reference[3])
+    {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(planes[0] + q), reference[0]);
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(planes[1] + q), reference[1]);
+        __m256 d2 = _mm256_sub_ps(_mm256_loadu_ps(planes[2] + q), reference[2]);
+        return _mm256_fmadd_ps(d2, d2, _mm256_fmadd_ps(d1, d1, _mm256_mul_ps(d0, d0)));
+    }
+
+    // Pixels [x0, x1) of row y, 8 at a time. All the horizontal taps of these
+    // pixels must be inside the image.
+    MQ_TARGET("avx2,fma") void filterSpanAVX2(const FilterPass& pass, int x0, int x1, int y)
+    {
+        const __m256 colorScale = _mm256_set1_ps(pass.m_colorScale);
+        const __m256 invSigmaNormal2 = _mm256_set1_ps(pass.m_invSigmaNormal2);
+        const __m256 invSigmaAlbedo2 = _mm256_set1_ps(pass.m_invSigmaAlbedo2);
+        const __m256 lumaR = _mm256_set1_ps(0.2126f);
+        const __m256 lumaG = _mm256_set1_ps(0.7152f);
+        const __m256 lumaB = _mm256_set1_ps(0.0722f);
+
+        for(int x = x0; x + 8 <= x1; x += 8)
+        {
+            auto p = static_cast<size_t>(y*pass.m_width + x);
+            const __m256 guide = _mm256_loadu_ps(pass.m_guide + p);
+            const __m256 invColor = _mm256_mul_ps(_mm256_loadu_ps(pass.m_invColorVariance + p), colorScale);
+            __m256 normal[3] = { _mm256_loadu_ps(pass.m_normal[0] + p), _mm256_loadu_ps(pass.m_normal[1] + p), _mm256_loadu_ps(pass.m_normal[2] + p) };
+            __m256 albedo[3] = { _mm256_loadu_ps(pass.m_albedo[0] + p), _mm256_loadu_ps(pass.m_albedo[1] + p), _mm256_loadu_ps(pass.m_albedo[2] + p) };
+            const __m256 depth = _mm256_loadu_ps(pass.m_depth + p);
+            const __m256 invDepth = _mm256_div_ps(_mm256_set1_ps(1.f),
+                _mm256_fmadd_ps(_mm256_mul_ps(_mm256_set1_ps(pass.m_sigmaDepth2), depth), depth, _mm256_set1_ps(minDepthVariance)));
+
+            __m256 sumR = _mm256_setzero_ps();
+            __m256 sumG = _mm256_setzero_ps();
+            __m256 sumB = _mm256_setzero_ps();
+            __m256 sumWeights = _mm256_setzero_ps();
+            for(int dy = -2; dy <= 2; ++dy)
+            {
+                int qy = y + dy*pass.m_step;
+                if(qy < 0 || qy >= pass.m_height)
+                    continue;
+                for(int dx = -2; dx <= 2; ++dx)
+                {
+                    auto q = static_cast<size_t>(qy*pass.m_width + x + dx*pass.m_step);
+                    __m256 dGuide = _mm256_sub_ps(_mm256_loadu_ps(pass.m_guide + q), guide);
+                    __m256 dDepth = _mm256_sub_ps(_mm256_loadu_ps(pass.m_depth + q), depth);
+
+                    __m256 distance = _mm256_mul_ps(_mm256_mul_ps(dGuide, dGuide), invColor);
+                    distance = _mm256_fmadd_ps(squaredDifferenceAVX2(pass.m_normal, q, normal), invSigmaNormal2, distance);
+                    distance = _mm256_fmadd_ps(squaredDifferenceAVX2(pass.m_albedo, q, albedo), invSigmaAlbedo2, distance);
+                    distance = _mm256_fmadd_ps(_mm256_mul_ps(dDepth, dDepth), invDepth, distance);
+
+                    __m256 weight = _mm256_mul_ps(_mm256_set1_ps(splineWeights[dx + 2] * splineWeights[dy + 2]),
+                                                  fastExpAVX2(_mm256_sub_ps(_mm256_setzero_ps(), distance)));
+                    sumR = _mm256_fmadd_ps(weight, _mm256_loadu_ps(pass.m_color[0] + q), sumR);
+                    sumG = _mm256_fmadd_ps(weight, _mm256_loadu_ps(pass.m_color[1] + q), sumG);
+                    sumB = _mm256_fmadd_ps(weight, _mm256_loadu_ps(pass.m_color[2] + q), sumB);
+                    sumWeights = _mm256_add_ps(sumWeights, weight);
+                }
+            }
+
+            __m256 invSum = _mm256_div_ps(_mm256_set1_ps(1.f), sumWeights);
+            __m256 r = _mm256_mul_ps(sumR, invSum);
+            __m256 g = _mm256_mul_ps(sumG, invSum);
+            __m256 b = _mm256_mul_ps(sumB, invSum);
+            _mm256_storeu_ps(pass.m_outColor[0] + p, r);
+            _mm256_storeu_ps(pass.m_outColor[1] + p, g);
+            _mm256_storeu_ps(pass.m_outColor[2] + p, b);
+
+            __m256 lum = _mm256_fmadd_ps(lumaB, b, _mm256_fmadd_ps(lumaG, g, _mm256_mul_ps(lumaR, r)));
+            _mm256_storeu_ps(pass.m_outGuide + p, _mm256_sqrt_ps(_mm256_max_ps(lum, _mm256_setzero_ps())));
+        }
+    }
+
+#endif
+
+    DenoiserISA resolveDenoiserISA(DenoiserISA isa)
+    {
+#ifdef MQ_ARCH_X86_64
+        const auto& features = cpuFeatures();
+        bool hasAVX2 = features.avx2 && features.fma;
+        if((isa == DenoiserISA::AUTO || isa == DenoiserISA::AVX2) && hasAVX2)
+            return DenoiserISA::AVX2;
+#else
+        (void)isa;
+#endif
+        return DenoiserISA::SCALAR;
+    }
+}
+
+std::string to_string(DenoiseMode mode)
+{
+    switch(mode)
+    {
+        case DenoiseMode::OFF:          return "OFF";
+        case DenoiseMode::EVERY_RENDER: return "EVERY_RENDER";
+        case DenoiseMode::ON_WRITE:     return "ON_WRITE";
+        default: return "";
+    }
+}
+
+std::string to_string(DenoiserISA isa)
+{
+    switch(isa)
+    {
+        case DenoiserISA::SCALAR:   return "SCALAR";
+        case DenoiserISA::AVX2:     return "AVX2";
+        case DenoiserISA::AUTO:     return "AUTO";
+        default: return "";
+    }
+}
+
+void Denoiser::resize(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    auto nbPixels = static_cast<size_t>(width * height);
+    for(int c = 0; c < 3; ++c)
+    {
+        m_color[0][c].assign(nbPixels, 0.f);
+        m_color[1][c].assign(nbPixels, 0.f);
+        m_normal[c].assign(nbPixels, 0.f);
+        m_albedo[c].assign(nbPixels, 0.f);
+    }
+    m_guideLuminance[0].assign(nbPixels, 0.f);
+    m_guideLuminance[1].assign(nbPixels, 0.f);
+    m_depth.assign(nbPixels, 0.f);
+    m_invColorVariance.assign(nbPixels, 0.f);
+    m_current = 0;
+}
+
+void Denoiser::setISA(DenoiserISA isa)
+{
+    m_isa = resolveDenoiserISA(isa);
+}
+
+void Denoiser::setPixel(size_t index, const glm::vec3& color, const glm::vec3& albedo, const glm::vec3& normal, float depth, float error)
+{
+    for(int c = 0; c < 3; ++c)
+    {
+        m_color[m_current][c][index] = color[c];
+        m_albedo[c][index] = albedo[c];
+        m_normal[c][index] = normal[c];
+    }
+    m_guideLuminance[m_current][index] = std::sqrt(std::max(luminance(color), 0.f));
+    m_depth[index] = depth;
+
+    // Pixels without an error estimate are only stopped by the other guides.
+    // Pixels whose samples are all equal keep a small tolerance for the
+    // quantization of the display.
+    float sigma = m_sigmaColor * std::max(error, minColorError);
+    m_invColorVariance[index] = sigma < std::numeric_limits<float>::infinity() ? 1.f / (sigma*sigma) : 0.f;
+}
+
+void Denoiser::filterRows(int iteration, int y0, int y1)
+{
+    const int step = 1 << iteration;
+    const int next = 1 - m_current;
+
+    FilterPass pass;
+    pass.m_width = m_width;
+    pass.m_height = m_height;
+    pass.m_step = step;
+    for(int c = 0; c < 3; ++c)
+    {
+        pass.m_color[c] = m_color[m_current][c].data();
+        pass.m_normal[c] = m_normal[c].data();
+        pass.m_albedo[c] = m_albedo[c].data();
+        pass.m_outColor[c] = m_color[next][c].data();
+    }
+    pass.m_guide = m_guideLuminance[m_current].data();
+    pass.m_depth = m_depth.data();
+    pass.m_invColorVariance = m_invColorVariance.data();
+    pass.m_outGuide = m_guideLuminance[next].data();
+
+    // The noise left after each iteration is lower, the color differences
+    // are given less tolerance: the sigma is halved at each iteration
+    // (Dammertz et al.), the inverse variance is multiplied by 4
+    pass.m_colorScale = std::ldexp(1.f, 2 * iteration);
+    pass.m_invSigmaNormal2 = 1.f / (m_sigmaNormal * m_sigmaNormal);
+    pass.m_invSigmaAlbedo2 = 1.f / (m_sigmaAlbedo * m_sigmaAlbedo);
+    pass.m_sigmaDepth2 = m_sigmaDepth * m_sigmaDepth * static_cast<float>(step * step);
+
+    // The vector kernel handles the pixels whose taps are all inside the row
+    int xBegin = 0;
+    int xEnd = 0;
+#ifdef MQ_ARCH_X86_64
+    if(m_isa == DenoiserISA::AVX2)
+    {
+        xBegin = std::min(2*step, m_width);
+        xEnd = xBegin + std::max(m_width - 2*step - xBegin, 0) / 8 * 8;
+    }
+#endif
+
+    for(int y = y0; y < y1; ++y)
+    {
+        for(int x = 0; x < xBegin; ++x)
+            filterPixelScalar(pass, x, y);
+#ifdef MQ_ARCH_X86_64
+        if(xEnd > xBegin)
+            filterSpanAVX2(pass, xBegin, xEnd, y);
+#endif
+        for(int x = std::max(xBegin, xEnd); x < m_width; ++x)
+            filterPixelScalar(pass, x, y);
+    }
+}
+
+} // core
+
+} // miquella
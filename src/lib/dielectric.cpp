@@ -6,7 +6,7 @@ namespace miquella
 namespace core
 {
 
-bool Dielectric::scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const
+bool Dielectric::scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const
 {
     color = {1.f, 1.f, 1.f};
 
@@ -22,7 +22,7 @@ bool Dielectric::scatter(const Ray & incoming, const hitRecord& record, glm::vec
 
     bool cannotRefract = refractionRatio * sinTheta > 1.f;
     glm::vec3 direction;
-    if(cannotRefract || _reflectance(cosTheta, refractionRatio) > randomFloat())
+    if(cannotRefract || _reflectance(cosTheta, refractionRatio) > sampler.get1D())
         direction = _reflect(incoming.direction(), record.normal);
     else
         direction = _refract(dir, record.normal, refractionRatio);
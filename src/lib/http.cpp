@@ -2,11 +2,18 @@
 
 #include <cpr/cpr.h>
 
+#include <filesystem>
+#include <fstream>
+#include <utility>
+
 // Actual type is std::string_view, not std::string. std::string was 
 // supposed to be working for c++20 but doesn't seem to be supported 
 // universally
 constexpr auto CONTROLLER_UPDATE_REMOTE_JOB          = "/updateRemoteJobExec";
 constexpr auto CONTROLLER_UPDATE_LOCAL_JOB           = "/updateLocalJobExec";
+constexpr auto CONTROLLER_UPDATE_REMOTE_PART         = "/updateRemotePartExec";
+constexpr auto CONTROLLER_UPDATE_LOCAL_PART          = "/updateLocalPartExec";
+constexpr auto CONTROLLER_REQUEST_JOB_ACCUMULATION   = "/requestJobAccumulation";
 constexpr auto CONTROLLER_REQUEST_JOB                = "/requestJob";
 constexpr auto CONTROLLER_SUBMIT_JOB                 = "/submitJob";
 constexpr auto CONTROLLER_REQUEST_LAST_LOCAL_SAMPLE  = "/requestLastLocalSample";
@@ -15,101 +22,425 @@ constexpr auto CONTROLLER_REQUEST_LIST_JOB           = "/requestListAllJobs";
 constexpr auto CONTROLLER_CANCEL_JOB                 = "/cancelJob";
 constexpr auto CONTROLLER_REMOVE_JOB                 = "/removeJob";
 
+// Sessions kept open per endpoint once a burst of Async requests is over
+constexpr size_t MAX_IDLE_SESSIONS                   = 4;
+
 namespace miquella 
 {
 
 namespace http 
 {
 
+namespace
+{
+    std::string readFile(const std::string& filePath)
+    {
+        std::ifstream file(filePath, std::ifstream::binary | std::ifstream::ate);
+        if(!file)
+            return std::string();
+
+        std::string content(static_cast<size_t>(file.tellg()), '\0');
+        file.seekg(0);
+        file.read(content.data(), static_cast<std::streamsize>(content.size()));
+        return content;
+    }
+}
+
+// Each call opens its own connection, the controller of the local versions
+// is always http://localhost:8000
+
 std::tuple<long, std::string> uploadJobToRemoteController(
                                 const std::string& serverURL,
                                 int port,
                                 const std::string& filePath, 
                                 const std::string& jobID,
-                                size_t lastSample)
+                                size_t lastSample,
+                                float noiseLevel,
+                                bool completed)
+{
+    return ControllerClient(serverURL, port).uploadJobToRemoteController(filePath, jobID, lastSample, noiseLevel, completed);
+}
+
+std::tuple<long, std::string> uploadJobBufferToRemoteController(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& buffer,
+                                const std::string& fileName,
+                                const std::string& jobID,
+                                size_t lastSample,
+                                float noiseLevel,
+                                bool completed)
+{
+    return ControllerClient(serverURL, port).uploadJobBufferToRemoteController(buffer, fileName, jobID, lastSample, noiseLevel, completed);
+}
+
+std::tuple<long, std::string> uploadJobToLocalController(
+                                const std::string& filePath, 
+                                const std::string& jobID,
+                                size_t lastSample,
+                                float noiseLevel,
+                                bool completed)
+{
+    return ControllerClient().uploadJobToLocalController(filePath, jobID, lastSample, noiseLevel, completed);
+}
+
+std::tuple<long, std::string> uploadPartToRemoteController(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& filePath,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed)
+{
+    return ControllerClient(serverURL, port).uploadPartToRemoteController(filePath, jobID, partID, lastSample, completed);
+}
+
+std::tuple<long, std::string> uploadPartBufferToRemoteController(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& buffer,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed)
+{
+    return ControllerClient(serverURL, port).uploadPartBufferToRemoteController(buffer, jobID, partID, lastSample, completed);
+}
+
+std::tuple<long, std::string> uploadPartToLocalController(
+                                const std::string& filePath,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed)
+{
+    return ControllerClient().uploadPartToLocalController(filePath, jobID, partID, lastSample, completed);
+}
+
+std::tuple<long, std::string> requestJobAccumulation(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& jobID)
+{
+    return ControllerClient(serverURL, port).requestJobAccumulation(jobID);
+}
+
+std::tuple<long, std::string> requestJob(
+                                const std::string& serverURL,
+                                int port)
+{
+    return ControllerClient(serverURL, port).requestJob();
+}    
+
+std::tuple<long, std::string> submitJob(
+                                const std::string& serverURL,
+                                int port,
+                                miquella::core::SceneID id,
+                                int nSamples,
+                                int freqOutput,
+                                float noiseThreshold)
 {
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_UPDATE_REMOTE_JOB;
+    return ControllerClient(serverURL, port).submitJob(id, nSamples, freqOutput, noiseThreshold);
+}
 
+std::tuple<long, std::string> requestLastLocalSample(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& jobID)
+{
+    return ControllerClient(serverURL, port).requestLastLocalSample(jobID);
+}
+
+std::tuple<long, std::string, std::map<std::string, std::string>> requestLastRemoteSample(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& jobID)
+{
+    return ControllerClient(serverURL, port).requestLastRemoteSample(jobID);
+}
+
+std::tuple<long, std::string> requestListJobs(
+                                const std::string& serverURL,
+                                int port)
+{
+    return ControllerClient(serverURL, port).requestListJobs();
+}
+
+std::tuple<long, std::string> requestCancelJob(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& jobID)
+{
+    return ControllerClient(serverURL, port).requestCancelJob(jobID);
+}
+
+std::tuple<long, std::string> requestRemoveJob(
+                                const std::string& serverURL,
+                                int port,
+                                const std::string& jobID)
+{
+    return ControllerClient(serverURL, port).requestRemoveJob(jobID);
+}
+
+ControllerClient::ControllerClient(const std::string& serverURL, int port) : 
+    m_serverURL(serverURL),
+    m_port(port)
+{
+}
+
+// Defined here, where cpr::Session is complete
+ControllerClient::~ControllerClient() = default;
+
+void ControllerClient::setController(const std::string& serverURL, int port)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(serverURL == m_serverURL && port == m_port)
+        return;
+
+    m_serverURL = serverURL;
+    m_port = port;
+    m_idleSessions.clear();
+}
+
+std::string ControllerClient::getServerURL() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_serverURL;
+}
+
+int ControllerClient::getPort() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_port;
+}
+
+cpr::Response ControllerClient::_send(const char* endpoint, const std::function<cpr::Response(cpr::Session&)>& request)
+{
+    std::unique_ptr<cpr::Session> session;
+    std::string url;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        url = m_serverURL + ":" + std::to_string(m_port) + endpoint;
+        auto& idle = m_idleSessions[endpoint];
+        if(!idle.empty())
+        {
+            session = std::move(idle.back());
+            idle.pop_back();
+        }
+    }
+    if(!session)
+    {
+        session = std::make_unique<cpr::Session>();
+        m_nbSessions++;
+    }
+
+    // A session always serves the same endpoint, so the options set by the
+    // previous request are the ones overwritten by this one
+    session->SetUrl(cpr::Url{url});
+    cpr::Response r = request(*session);
+
+    long nbConnects = 0;
+    if(curl_easy_getinfo(session->GetCurlHolder()->handle, CURLINFO_NUM_CONNECTS, &nbConnects) == CURLE_OK && nbConnects > 0)
+        m_nbConnections += static_cast<size_t>(nbConnects);
+
+    // A session whose request failed may hold a broken connection
+    if(r.error.code == cpr::ErrorCode::OK)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& idle = m_idleSessions[endpoint];
+        if(url == m_serverURL + ":" + std::to_string(m_port) + endpoint && idle.size() < MAX_IDLE_SESSIONS)
+            idle.push_back(std::move(session));
+    }
+    return r;
+}
+
+ControllerClient::Reply ControllerClient::uploadJobToRemoteController(
+                                const std::string& filePath, 
+                                const std::string& jobID,
+                                size_t lastSample,
+                                float noiseLevel,
+                                bool completed)
+{
     // IMPORTANT: the part name "file" must match the parameter name in the 
     // controller function!
-    cpr::Response r = cpr::Post(cpr::Url{url},
-                cpr::Multipart{
+    cpr::Response r = _send(CONTROLLER_UPDATE_REMOTE_JOB, [&](cpr::Session& session)
+    {
+        session.SetMultipart(cpr::Multipart{
                     {"file", cpr::File{filePath}},
                     {"jobID", jobID},
-                    {"lastSample", std::to_string(lastSample)}
+                    {"lastSample", std::to_string(lastSample)},
+                    {"noiseLevel", std::to_string(noiseLevel)},
+                    {"completed", completed ? "true" : "false"}
                     });
+        return session.Post();
+    });
 
     return {r.status_code, r.text};
 }
 
-std::tuple<long, std::string> uploadJobToLocalController(
-                                const std::string& filePath, 
+ControllerClient::Reply ControllerClient::uploadJobBufferToRemoteController(
+                                const std::string& buffer,
+                                const std::string& fileName,
                                 const std::string& jobID,
-                                size_t lastSample)
+                                size_t lastSample,
+                                float noiseLevel,
+                                bool completed)
 {
-    std::string url = std::string("http://localhost:8000") + CONTROLLER_UPDATE_LOCAL_JOB;
+    // Same form as uploadJobToRemoteController(), the "file" part is read
+    // from memory
+    cpr::Response r = _send(CONTROLLER_UPDATE_REMOTE_JOB, [&](cpr::Session& session)
+    {
+        session.SetMultipart(cpr::Multipart{
+                    {"file", cpr::Buffer{buffer.begin(), buffer.end(), std::filesystem::path(fileName)}},
+                    {"jobID", jobID},
+                    {"lastSample", std::to_string(lastSample)},
+                    {"noiseLevel", std::to_string(noiseLevel)},
+                    {"completed", completed ? "true" : "false"}
+                    });
+        return session.Post();
+    });
+
+    return {r.status_code, r.text};
+}
 
-    cpr::Response r = cpr::Post(cpr::Url{url},
-    cpr::Parameters{
-        {"jobID", jobID},
-        {"filePath", filePath},
-        {"lastSample", std::to_string(lastSample)}
-        });  
+ControllerClient::Reply ControllerClient::uploadJobToLocalController(
+                                const std::string& filePath, 
+                                const std::string& jobID,
+                                size_t lastSample,
+                                float noiseLevel,
+                                bool completed)
+{
+    cpr::Response r = _send(CONTROLLER_UPDATE_LOCAL_JOB, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{
+            {"jobID", jobID},
+            {"filePath", filePath},
+            {"lastSample", std::to_string(lastSample)},
+            {"noiseLevel", std::to_string(noiseLevel)},
+            {"completed", completed ? "true" : "false"}
+            });
+        return session.Post();
+    });
     
     return {r.status_code, r.text};
 }
 
-std::tuple<long, std::string> requestJob(
-                                const std::string& serverURL,
-                                int port)
+ControllerClient::Reply ControllerClient::uploadPartToRemoteController(
+                                const std::string& filePath,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed)
 {
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_REQUEST_JOB;
+    return uploadPartBufferToRemoteController(readFile(filePath), jobID, partID, lastSample, completed);
+}
 
-    cpr::Response r = cpr::Post(cpr::Url{url});
+ControllerClient::Reply ControllerClient::uploadPartBufferToRemoteController(
+                                const std::string& buffer,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed)
+{
+    // The accumulation is binary, it is sent as the body of the request
+    // rather than as a multipart form
+    cpr::Response r = _send(CONTROLLER_UPDATE_REMOTE_PART, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{
+            {"jobID", jobID},
+            {"partID", std::to_string(partID)},
+            {"lastSample", std::to_string(lastSample)},
+            {"completed", completed ? "true" : "false"}
+            });
+        session.SetHeader(cpr::Header{{"Content-Type", "application/octet-stream"}});
+        session.SetBody(cpr::Body{buffer});
+        return session.Post();
+    });
 
     return {r.status_code, r.text};
-}    
+}
 
-std::tuple<long, std::string> submitJob(
-                                const std::string& serverURL,
-                                int port,
+ControllerClient::Reply ControllerClient::uploadPartToLocalController(
+                                const std::string& filePath,
+                                const std::string& jobID,
+                                size_t partID,
+                                size_t lastSample,
+                                bool completed)
+{
+    cpr::Response r = _send(CONTROLLER_UPDATE_LOCAL_PART, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{
+            {"jobID", jobID},
+            {"filePath", filePath},
+            {"partID", std::to_string(partID)},
+            {"lastSample", std::to_string(lastSample)},
+            {"completed", completed ? "true" : "false"}
+            });
+        return session.Post();
+    });
+
+    return {r.status_code, r.text};
+}
+
+ControllerClient::Reply ControllerClient::requestJobAccumulation(const std::string& jobID)
+{
+    cpr::Response r = _send(CONTROLLER_REQUEST_JOB_ACCUMULATION, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{{"jobID", jobID}});
+        return session.Get();
+    });
+
+    return {r.status_code, r.text};
+}
+
+ControllerClient::Reply ControllerClient::requestJob()
+{
+    cpr::Response r = _send(CONTROLLER_REQUEST_JOB, [](cpr::Session& session){ return session.Post(); });
+
+    return {r.status_code, r.text};
+}
+
+ControllerClient::Reply ControllerClient::submitJob(
                                 miquella::core::SceneID id,
                                 int nSamples,
-                                int freqOutput)
+                                int freqOutput,
+                                float noiseThreshold)
 {
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_SUBMIT_JOB;
-    cpr::Response r = cpr::Post(cpr::Url{url},
-        cpr::Parameters{
+    cpr::Response r = _send(CONTROLLER_SUBMIT_JOB, [&](cpr::Session& session)
+    {
+        cpr::Parameters parameters{
             {"sceneID", std::to_string(static_cast<uint8_t>(id))},
             {"nSamples", std::to_string(nSamples)},
             {"freqOutput", std::to_string(freqOutput)}
+            };
+        if(noiseThreshold > 0.f)
+            parameters.Add({"noiseThreshold", std::to_string(noiseThreshold)});
+        session.SetParameters(std::move(parameters));
+        return session.Post();
     });
 
     return {r.status_code, r.text};
 }
 
-std::tuple<long, std::string> requestLastLocalSample(
-                                const std::string& serverURL,
-                                int port,
-                                const std::string& jobID)
+ControllerClient::Reply ControllerClient::requestLastLocalSample(const std::string& jobID)
 {
-    // Create an HTTP request.
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_REQUEST_LAST_LOCAL_SAMPLE;
-    cpr::Response r = cpr::Get(cpr::Url{url},
-        cpr::Parameters{{"jobID", jobID}});
+    cpr::Response r = _send(CONTROLLER_REQUEST_LAST_LOCAL_SAMPLE, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{{"jobID", jobID}});
+        return session.Get();
+    });
 
     return {r.status_code, r.text};
 }
 
-std::tuple<long, std::string, std::map<std::string, std::string>> requestLastRemoteSample(
-                                const std::string& serverURL,
-                                int port,
-                                const std::string& jobID)
+ControllerClient::ReplyWithHeader ControllerClient::requestLastRemoteSample(const std::string& jobID)
 {
-    // Create an HTTP request.
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_REQUEST_LAST_REMOTE_SAMPLE;
-    cpr::Response r = cpr::Get(cpr::Url{url},
-        cpr::Parameters{{"jobID", jobID}});
+    cpr::Response r = _send(CONTROLLER_REQUEST_LAST_REMOTE_SAMPLE, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{{"jobID", jobID}});
+        return session.Get();
+    });
 
     // Copy the header to a regular map to avoid having the caller depend on cpr 
     // Necessary because the cpr header map uses a custom comparator that the caller 
@@ -122,43 +453,111 @@ std::tuple<long, std::string, std::map<std::string, std::string>> requestLastRem
     return {r.status_code, r.text, header};
 }
 
-std::tuple<long, std::string> requestListJobs(
-                                const std::string& serverURL,
-                                int port)
+ControllerClient::Reply ControllerClient::requestListJobs()
 {
-    // Create an HTTP request.
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_REQUEST_LIST_JOB;
-    cpr::Response r = cpr::Get(cpr::Url{url});
+    cpr::Response r = _send(CONTROLLER_REQUEST_LIST_JOB, [](cpr::Session& session){ return session.Get(); });
 
     return {r.status_code, r.text};
 }
 
-std::tuple<long, std::string> requestCancelJob(
-                                const std::string& serverURL,
-                                int port,
-                                const std::string& jobID)
+ControllerClient::Reply ControllerClient::requestCancelJob(const std::string& jobID)
 {
-    // Create an HTTP request.
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_CANCEL_JOB;
-    cpr::Response r = cpr::Post(cpr::Url{url},
-        cpr::Parameters{{"jobID", jobID}});
+    cpr::Response r = _send(CONTROLLER_CANCEL_JOB, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{{"jobID", jobID}});
+        return session.Post();
+    });
 
     return {r.status_code, r.text};
 }
 
-std::tuple<long, std::string> requestRemoveJob(
-                                const std::string& serverURL,
-                                int port,
-                                const std::string& jobID)
+ControllerClient::Reply ControllerClient::requestRemoveJob(const std::string& jobID)
 {
-    // Create an HTTP request.
-    std::string url = serverURL + ":" + std::to_string(port) + CONTROLLER_REMOVE_JOB;
-    cpr::Response r = cpr::Post(cpr::Url{url},
-        cpr::Parameters{{"jobID", jobID}});
+    cpr::Response r = _send(CONTROLLER_REMOVE_JOB, [&](cpr::Session& session)
+    {
+        session.SetParameters(cpr::Parameters{{"jobID", jobID}});
+        return session.Post();
+    });
 
     return {r.status_code, r.text};
 }
 
+std::future<ControllerClient::Reply> ControllerClient::uploadJobToRemoteControllerAsync(std::string filePath, std::string jobID, size_t lastSample, float noiseLevel, bool completed)
+{
+    return std::async(std::launch::async, [=, this, filePath = std::move(filePath), jobID = std::move(jobID)]
+        { return uploadJobToRemoteController(filePath, jobID, lastSample, noiseLevel, completed); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::uploadJobBufferToRemoteControllerAsync(std::string buffer, std::string fileName, std::string jobID, size_t lastSample, float noiseLevel, bool completed)
+{
+    return std::async(std::launch::async, [=, this, buffer = std::move(buffer), fileName = std::move(fileName), jobID = std::move(jobID)]
+        { return uploadJobBufferToRemoteController(buffer, fileName, jobID, lastSample, noiseLevel, completed); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::uploadJobToLocalControllerAsync(std::string filePath, std::string jobID, size_t lastSample, float noiseLevel, bool completed)
+{
+    return std::async(std::launch::async, [=, this, filePath = std::move(filePath), jobID = std::move(jobID)]
+        { return uploadJobToLocalController(filePath, jobID, lastSample, noiseLevel, completed); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::uploadPartToRemoteControllerAsync(std::string filePath, std::string jobID, size_t partID, size_t lastSample, bool completed)
+{
+    return std::async(std::launch::async, [=, this, filePath = std::move(filePath), jobID = std::move(jobID)]
+        { return uploadPartToRemoteController(filePath, jobID, partID, lastSample, completed); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::uploadPartBufferToRemoteControllerAsync(std::string buffer, std::string jobID, size_t partID, size_t lastSample, bool completed)
+{
+    return std::async(std::launch::async, [=, this, buffer = std::move(buffer), jobID = std::move(jobID)]
+        { return uploadPartBufferToRemoteController(buffer, jobID, partID, lastSample, completed); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::uploadPartToLocalControllerAsync(std::string filePath, std::string jobID, size_t partID, size_t lastSample, bool completed)
+{
+    return std::async(std::launch::async, [=, this, filePath = std::move(filePath), jobID = std::move(jobID)]
+        { return uploadPartToLocalController(filePath, jobID, partID, lastSample, completed); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::requestJobAccumulationAsync(std::string jobID)
+{
+    return std::async(std::launch::async, [this, jobID = std::move(jobID)]{ return requestJobAccumulation(jobID); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::requestJobAsync()
+{
+    return std::async(std::launch::async, [this]{ return requestJob(); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::submitJobAsync(miquella::core::SceneID id, int nSamples, int freqOutput, float noiseThreshold)
+{
+    return std::async(std::launch::async, [=, this]{ return submitJob(id, nSamples, freqOutput, noiseThreshold); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::requestLastLocalSampleAsync(std::string jobID)
+{
+    return std::async(std::launch::async, [this, jobID = std::move(jobID)]{ return requestLastLocalSample(jobID); });
+}
+
+std::future<ControllerClient::ReplyWithHeader> ControllerClient::requestLastRemoteSampleAsync(std::string jobID)
+{
+    return std::async(std::launch::async, [this, jobID = std::move(jobID)]{ return requestLastRemoteSample(jobID); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::requestListJobsAsync()
+{
+    return std::async(std::launch::async, [this]{ return requestListJobs(); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::requestCancelJobAsync(std::string jobID)
+{
+    return std::async(std::launch::async, [this, jobID = std::move(jobID)]{ return requestCancelJob(jobID); });
+}
+
+std::future<ControllerClient::Reply> ControllerClient::requestRemoveJobAsync(std::string jobID)
+{
+    return std::async(std::launch::async, [this, jobID = std::move(jobID)]{ return requestRemoveJob(jobID); });
+}
+
 } // http
 
-} // miquella 
\ No newline at end of file
+} // miquella 
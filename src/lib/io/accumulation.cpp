@@ -0,0 +1,470 @@
+#include <miquella/core/io/accumulation.h>
+#include <miquella/core/tonemap.h>
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <tuple>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace miquella
+{
+
+namespace core
+{
+
+namespace io
+{
+
+namespace
+{
+    const char magic[4] = {'M', 'Q', 'A', 'F'};
+    const size_t jobIDOffset = 48;
+    const size_t jobIDSize = 64;
+
+    // Number of values of each input summed at once: 64KB per input
+    const size_t mergeBlockSize = 16384;
+
+    static_assert(sizeof(glm::vec3) == 3 * sizeof(float), "The sums are read as glm::vec3");
+
+    template <typename T>
+    void store(unsigned char* buffer, size_t offset, T value)
+    {
+        std::memcpy(buffer + offset, &value, sizeof(T));
+    }
+
+    template <typename T>
+    T load(const unsigned char* buffer, size_t offset)
+    {
+        T value;
+        std::memcpy(&value, buffer + offset, sizeof(T));
+        return value;
+    }
+
+    size_t dataSize(const AccumulationHeader& header)
+    {
+        return header.getNbPixels() * (3 * sizeof(float) + sizeof(uint32_t));
+    }
+
+    bool checkEndianness()
+    {
+        if(std::endian::native != std::endian::little)
+        {
+            std::cerr << "ERROR: accumulation files are only supported on little endian machines.\n";
+            return false;
+        }
+        return true;
+    }
+
+    void encodeHeader(const AccumulationHeader& header, unsigned char* buffer)
+    {
+        std::memset(buffer, 0, accumulationHeaderSize);
+        std::memcpy(buffer, magic, sizeof(magic));
+        store(buffer, 4, accumulationVersion);
+        store(buffer, 8, header.m_width);
+        store(buffer, 12, header.m_height);
+        store(buffer, 16, header.m_nbSamples);
+        store(buffer, 24, header.m_firstSample);
+        store(buffer, 32, header.m_sceneID);
+        store(buffer, 36, header.m_seed);
+        std::memcpy(buffer + jobIDOffset, header.m_jobID.data(), std::min(header.m_jobID.size(), jobIDSize - 1));
+        store(buffer, 112, header.m_frameWidth);
+        store(buffer, 116, header.m_frameHeight);
+        store(buffer, 120, header.m_cropX);
+        store(buffer, 124, header.m_cropY);
+    }
+
+    bool decodeHeader(const unsigned char* buffer, AccumulationHeader& header)
+    {
+        if(std::memcmp(buffer, magic, sizeof(magic)) != 0)
+        {
+            std::cerr << "ERROR: not an accumulation file.\n";
+            return false;
+        }
+
+        auto version = load<uint32_t>(buffer, 4);
+        if(version != accumulationVersion)
+        {
+            std::cerr << "ERROR: unsupported accumulation file version " << version << ".\n";
+            return false;
+        }
+
+        header.m_width = load<uint32_t>(buffer, 8);
+        header.m_height = load<uint32_t>(buffer, 12);
+        header.m_nbSamples = load<uint64_t>(buffer, 16);
+        header.m_firstSample = load<uint64_t>(buffer, 24);
+        header.m_sceneID = load<uint32_t>(buffer, 32);
+        header.m_seed = load<uint32_t>(buffer, 36);
+        const char* jobID = reinterpret_cast<const char*>(buffer + jobIDOffset);
+        header.m_jobID.assign(jobID, strnlen(jobID, jobIDSize - 1));
+        header.m_frameWidth = load<uint32_t>(buffer, 112);
+        header.m_frameHeight = load<uint32_t>(buffer, 116);
+        header.m_cropX = load<uint32_t>(buffer, 120);
+        header.m_cropY = load<uint32_t>(buffer, 124);
+
+        if(static_cast<uint64_t>(header.m_cropX) + header.m_width > header.getFrameWidth() || static_cast<uint64_t>(header.m_cropY) + header.m_height > header.getFrameHeight())
+        {
+            std::cerr << "ERROR: the crop of the accumulation file is outside of its image.\n";
+            return false;
+        }
+        return true;
+    }
+
+    // Map all the inputs and check that they belong to the same job
+    bool openParts(const std::vector<std::string>& inputs, std::vector<std::unique_ptr<MappedAccumulation>>& parts)
+    {
+        if(inputs.empty())
+        {
+            std::cerr << "ERROR: no accumulation file to merge.\n";
+            return false;
+        }
+
+        for(const auto& path : inputs)
+        {
+            parts.push_back(std::make_unique<MappedAccumulation>());
+            if(!parts.back()->open(path))
+                return false;
+        }
+
+        const auto& first = parts[0]->getHeader();
+        for(size_t i = 1; i < parts.size(); ++i)
+        {
+            const auto& other = parts[i]->getHeader();
+            if(other.m_sceneID != first.m_sceneID || other.m_jobID != first.m_jobID)
+            {
+                std::cerr << "ERROR: " << inputs[i] << " belongs to another scene or job.\n";
+                return false;
+            }
+            if(other.getFrameWidth() != first.getFrameWidth() || other.getFrameHeight() != first.getFrameHeight())
+            {
+                std::cerr << "ERROR: " << inputs[i] << " is a part of a " << other.getFrameWidth() << "x" << other.getFrameHeight() << " image, expected " << first.getFrameWidth() << "x" << first.getFrameHeight() << ".\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // The merged file is written next to output and renamed once complete,
+    // after the inputs are unmapped, so that output may be one of them
+    std::string temporaryOutput(const std::string& output)
+    {
+        return output + ".tmp";
+    }
+
+    bool replaceOutput(std::ofstream& file, std::vector<std::unique_ptr<MappedAccumulation>>& parts, const std::string& output)
+    {
+        file.close();
+        parts.clear();
+
+        std::error_code error;
+        if(file)
+            std::filesystem::rename(temporaryOutput(output), output, error);
+        if(!file || error)
+        {
+            std::cerr << "ERROR: unable to write " << output << ".\n";
+            std::filesystem::remove(temporaryOutput(output), error);
+            return false;
+        }
+        return true;
+    }
+}
+
+bool writeAccumulation(std::ostream& file, const AccumulationHeader& header, const float* sums, const uint32_t* samples)
+{
+    if(!checkEndianness())
+        return false;
+    if(header.m_jobID.size() >= jobIDSize)
+    {
+        std::cerr << "ERROR: the job id " << header.m_jobID << " is longer than " << jobIDSize - 1 << " characters.\n";
+        return false;
+    }
+
+    unsigned char buffer[accumulationHeaderSize];
+    encodeHeader(header, buffer);
+    file.write(reinterpret_cast<const char*>(buffer), accumulationHeaderSize);
+
+    size_t nbPixels = header.getNbPixels();
+    file.write(reinterpret_cast<const char*>(sums), static_cast<std::streamsize>(3 * nbPixels * sizeof(float)));
+    file.write(reinterpret_cast<const char*>(samples), static_cast<std::streamsize>(nbPixels * sizeof(uint32_t)));
+
+    if(!file)
+    {
+        std::cerr << "ERROR: unable to write the accumulation file.\n";
+        return false;
+    }
+    return true;
+}
+
+bool encodeAccumulation(const AccumulationHeader& header, const float* sums, const uint32_t* samples, std::string& buffer)
+{
+    if(!checkEndianness())
+        return false;
+    if(header.m_jobID.size() >= jobIDSize)
+    {
+        std::cerr << "ERROR: the job id " << header.m_jobID << " is longer than " << jobIDSize - 1 << " characters.\n";
+        return false;
+    }
+
+    size_t nbPixels = header.getNbPixels();
+    buffer.resize(accumulationHeaderSize + dataSize(header));
+    auto* data = reinterpret_cast<unsigned char*>(buffer.data());
+    encodeHeader(header, data);
+    std::memcpy(data + accumulationHeaderSize, sums, 3 * nbPixels * sizeof(float));
+    std::memcpy(data + accumulationHeaderSize + 3 * nbPixels * sizeof(float), samples, nbPixels * sizeof(uint32_t));
+    return true;
+}
+
+bool readAccumulationHeader(std::istream& file, AccumulationHeader& header)
+{
+    if(!checkEndianness())
+        return false;
+
+    unsigned char buffer[accumulationHeaderSize];
+    if(!file.read(reinterpret_cast<char*>(buffer), accumulationHeaderSize))
+    {
+        std::cerr << "ERROR: truncated accumulation file header.\n";
+        return false;
+    }
+    return decodeHeader(buffer, header);
+}
+
+bool readAccumulation(std::istream& file, AccumulationHeader& header, std::vector<float>& sums, std::vector<uint32_t>& samples)
+{
+    if(!readAccumulationHeader(file, header))
+        return false;
+
+    size_t nbPixels = header.getNbPixels();
+    sums.resize(3 * nbPixels);
+    samples.resize(nbPixels);
+    file.read(reinterpret_cast<char*>(sums.data()), static_cast<std::streamsize>(sums.size() * sizeof(float)));
+    file.read(reinterpret_cast<char*>(samples.data()), static_cast<std::streamsize>(samples.size() * sizeof(uint32_t)));
+    if(!file)
+    {
+        std::cerr << "ERROR: truncated accumulation file.\n";
+        return false;
+    }
+    return true;
+}
+
+bool MappedAccumulation::open(const std::string& path)
+{
+    close();
+    if(!checkEndianness())
+        return false;
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if(file == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "ERROR: unable to open " << path << ".\n";
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = size.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    m_file = file;
+    m_mapping = mapping;
+    if(!data)
+    {
+        std::cerr << "ERROR: unable to map " << path << ".\n";
+        close();
+        return false;
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        std::cerr << "ERROR: unable to open " << path << ".\n";
+        return false;
+    }
+    struct stat status;
+    void* data = MAP_FAILED;
+    if(fstat(fd, &status) == 0 && status.st_size > 0)
+        data = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if(data == MAP_FAILED)
+    {
+        std::cerr << "ERROR: unable to map " << path << ".\n";
+        return false;
+    }
+    m_size = static_cast<size_t>(status.st_size);
+    madvise(data, m_size, MADV_SEQUENTIAL);
+#endif
+    m_data = static_cast<const unsigned char*>(data);
+
+    if(m_size < accumulationHeaderSize || !decodeHeader(m_data, m_header))
+    {
+        std::cerr << "ERROR: invalid accumulation file " << path << ".\n";
+        close();
+        return false;
+    }
+    if(m_size != accumulationHeaderSize + dataSize(m_header))
+    {
+        std::cerr << "ERROR: the size of " << path << " does not match its header.\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void MappedAccumulation::close()
+{
+#if defined(_WIN32)
+    if(m_data)
+        UnmapViewOfFile(m_data);
+    if(m_mapping)
+        CloseHandle(m_mapping);
+    if(m_file)
+        CloseHandle(m_file);
+    m_mapping = nullptr;
+    m_file = nullptr;
+#else
+    if(m_data)
+        munmap(const_cast<unsigned char*>(m_data), m_size);
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_header = AccumulationHeader();
+}
+
+bool mergeAccumulations(const std::vector<std::string>& inputs, const std::string& output)
+{
+    std::vector<std::unique_ptr<MappedAccumulation>> parts;
+    if(!openParts(inputs, parts))
+        return false;
+
+    AccumulationHeader header = parts[0]->getHeader();
+    for(size_t i = 1; i < parts.size(); ++i)
+    {
+        const auto& other = parts[i]->getHeader();
+        if(other.m_width != header.m_width || other.m_height != header.m_height || other.m_cropX != header.m_cropX || other.m_cropY != header.m_cropY)
+        {
+            std::cerr << "ERROR: " << inputs[i] << " is another crop of the image, use assembleAccumulations().\n";
+            return false;
+        }
+        header.m_nbSamples += other.m_nbSamples;
+        header.m_firstSample = std::min(header.m_firstSample, other.m_firstSample);
+    }
+
+    std::ofstream file(temporaryOutput(output), std::ofstream::binary);
+    unsigned char buffer[accumulationHeaderSize];
+    encodeHeader(header, buffer);
+    file.write(reinterpret_cast<const char*>(buffer), accumulationHeaderSize);
+
+    // Sum one block of every input before writing it, instead of one
+    // input after the other over the whole image
+    auto mergeBlocks = [&](auto getData, size_t count, auto* block)
+    {
+        for(size_t begin = 0; begin < count; begin += mergeBlockSize)
+        {
+            size_t size = std::min(mergeBlockSize, count - begin);
+            const auto* first = getData(*parts[0]) + begin;
+            std::copy(first, first + size, block);
+            for(size_t p = 1; p < parts.size(); ++p)
+            {
+                const auto* values = getData(*parts[p]) + begin;
+                for(size_t k = 0; k < size; ++k)
+                    block[k] += values[k];
+            }
+            file.write(reinterpret_cast<const char*>(block), static_cast<std::streamsize>(size * sizeof(*block)));
+        }
+    };
+
+    std::vector<float> sums(mergeBlockSize);
+    std::vector<uint32_t> samples(mergeBlockSize);
+    mergeBlocks([](const MappedAccumulation& part){ return part.getSums(); }, 3 * header.getNbPixels(), sums.data());
+    mergeBlocks([](const MappedAccumulation& part){ return part.getSamples(); }, header.getNbPixels(), samples.data());
+
+    return replaceOutput(file, parts, output);
+}
+
+bool assembleAccumulations(const std::vector<std::string>& inputs, const std::string& output)
+{
+    std::vector<std::unique_ptr<MappedAccumulation>> parts;
+    if(!openParts(inputs, parts))
+        return false;
+
+    // The parts on the same window add their samples, the windows are
+    // side by side and keep the largest number of samples
+    AccumulationHeader header = parts[0]->getHeader();
+    header.m_width = header.getFrameWidth();
+    header.m_height = header.getFrameHeight();
+    header.m_frameWidth = 0;
+    header.m_frameHeight = 0;
+    header.m_cropX = 0;
+    header.m_cropY = 0;
+    header.m_nbSamples = 0;
+    std::map<std::tuple<uint32_t, uint32_t, uint32_t, uint32_t>, uint64_t> windowSamples;
+    for(const auto& part : parts)
+    {
+        const auto& h = part->getHeader();
+        auto& nbSamples = windowSamples[{h.m_cropX, h.m_cropY, h.m_width, h.m_height}];
+        nbSamples += h.m_nbSamples;
+        header.m_nbSamples = std::max(header.m_nbSamples, nbSamples);
+        header.m_firstSample = std::min(header.m_firstSample, h.m_firstSample);
+    }
+
+    std::ofstream file(temporaryOutput(output), std::ofstream::binary);
+    unsigned char buffer[accumulationHeaderSize];
+    encodeHeader(header, buffer);
+    file.write(reinterpret_cast<const char*>(buffer), accumulationHeaderSize);
+
+    // Each row of the output receives the matching row of the parts which
+    // cover it, the parts are read in order
+    auto assembleRows = [&](auto getData, size_t nbChannels, auto* row)
+    {
+        size_t rowSize = header.m_width * nbChannels;
+        for(uint32_t y = 0; y < header.m_height; ++y)
+        {
+            std::fill(row, row + rowSize, 0);
+            for(const auto& part : parts)
+            {
+                const auto& h = part->getHeader();
+                if(y < h.m_cropY || y >= h.m_cropY + h.m_height)
+                    continue;
+
+                const auto* values = getData(*part) + (y - h.m_cropY) * h.m_width * nbChannels;
+                auto* target = row + h.m_cropX * nbChannels;
+                for(size_t k = 0; k < h.m_width * nbChannels; ++k)
+                    target[k] += values[k];
+            }
+            file.write(reinterpret_cast<const char*>(row), static_cast<std::streamsize>(rowSize * sizeof(*row)));
+        }
+    };
+
+    std::vector<float> sums(3 * header.m_width);
+    std::vector<uint32_t> samples(header.m_width);
+    assembleRows([](const MappedAccumulation& part){ return part.getSums(); }, 3, sums.data());
+    assembleRows([](const MappedAccumulation& part){ return part.getSamples(); }, 1, samples.data());
+
+    return replaceOutput(file, parts, output);
+}
+
+std::vector<unsigned char> tonemapAccumulation(const AccumulationHeader& header, const float* sums, const uint32_t* samples)
+{
+    std::vector<unsigned char> image(4 * header.getNbPixels());
+    getTonemapKernel()(reinterpret_cast<const glm::vec3*>(sums), samples, header.getNbPixels(), image.data());
+    return image;
+}
+
+} // io
+
+} // core
+
+} // miquella
@@ -0,0 +1,161 @@
+#include <miquella/core/lightTree.h>
+
+#include <algorithm>
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    // Largest float below 1, keeps the rescaled number in [0, 1)
+    const float oneMinusEpsilon = 0x1.fffffep-1f;
+}
+
+std::string to_string(LightSelection selection)
+{
+    switch(selection)
+    {
+        case LightSelection::UNIFORM:   return "UNIFORM";
+        case LightSelection::TREE:      return "TREE";
+        default: return "";
+    }
+}
+
+void LightTree::build(const std::vector<AABB>& boxes, const std::vector<float>& powers)
+{
+    clear();
+    if(boxes.empty())
+        return;
+
+    std::vector<uint32_t> lights(boxes.size());
+    for(uint32_t i = 0; i < lights.size(); ++i)
+        lights[i] = i;
+
+    m_nodes.reserve(2 * boxes.size() - 1);
+    m_lightPaths.resize(boxes.size(), 0);
+    _buildRecursive(boxes, powers, lights, 0, static_cast<uint32_t>(lights.size()), 0, 0);
+}
+
+uint32_t LightTree::_buildRecursive(const std::vector<AABB>& boxes, const std::vector<float>& powers, std::vector<uint32_t>& lights, uint32_t begin, uint32_t end, uint32_t depth, uint64_t path)
+{
+    uint32_t nodeIndex = static_cast<uint32_t>(m_nodes.size());
+    m_nodes.emplace_back();
+
+    AABB box;
+    AABB centroidBox;
+    float power = 0.f;
+    for(uint32_t i = begin; i < end; ++i)
+    {
+        box.extend(boxes[lights[i]]);
+        centroidBox.extend(boxes[lights[i]].centroid());
+        power += powers[lights[i]];
+    }
+    m_nodes[nodeIndex].m_box = box;
+    m_nodes[nodeIndex].m_power = power;
+
+    if(end - begin == 1)
+    {
+        m_nodes[nodeIndex].m_leaf = true;
+        m_nodes[nodeIndex].m_offset = lights[begin];
+        m_lightPaths[lights[begin]] = path;
+        return nodeIndex;
+    }
+
+    // Median split along the largest extent of the centroids keeps the tree
+    // balanced, so that the paths fit in 64 bits
+    int axis = centroidBox.longestAxis();
+    uint32_t mid = begin + (end - begin) / 2;
+    std::nth_element(lights.begin() + begin, lights.begin() + mid, lights.begin() + end, [&boxes, axis](uint32_t a, uint32_t b)
+    {
+        return boxes[a].centroid()[axis] < boxes[b].centroid()[axis];
+    });
+
+    _buildRecursive(boxes, powers, lights, begin, mid, depth + 1, path);
+    uint32_t secondChild = _buildRecursive(boxes, powers, lights, mid, end, depth + 1, path | (uint64_t(1) << depth));
+    m_nodes[nodeIndex].m_offset = secondChild;
+    return nodeIndex;
+}
+
+float LightTree::_importance(const LightTreeNode& node, const glm::vec3& p, const glm::vec3& n) const
+{
+    if(node.m_power <= 0.f)
+        return 0.f;
+
+    // No light of the node can be seen when the whole box is below the
+    // tangent plane: the corner the furthest along n is below it
+    const AABB& box = node.m_box;
+    glm::vec3 toCenter = box.centroid() - p;
+    glm::vec3 halfExtent = 0.5f * box.extent();
+    if(glm::dot(n, toCenter) + glm::dot(glm::abs(n), halfExtent) <= 0.f)
+        return 0.f;
+
+    // The squared distance is clamped by the squared half diagonal of the
+    // box, so that nodes containing the point do not get an unbounded weight
+    float distance2 = std::max(glm::dot(toCenter, toCenter), glm::dot(halfExtent, halfExtent));
+    return node.m_power / distance2;
+}
+
+bool LightTree::sample(const glm::vec3& p, const glm::vec3& n, float u, uint32_t& light, float& pmf) const
+{
+    if(m_nodes.empty())
+        return false;
+
+    uint32_t index = 0;
+    pmf = 1.f;
+    while(!m_nodes[index].isLeaf())
+    {
+        uint32_t first = index + 1;
+        uint32_t second = m_nodes[index].m_offset;
+        float importanceFirst = _importance(m_nodes[first], p, n);
+        float importanceSecond = _importance(m_nodes[second], p, n);
+        if(importanceFirst + importanceSecond <= 0.f)
+            return false;
+
+        // The same number is rescaled and reused at every level
+        float probabilityFirst = importanceFirst / (importanceFirst + importanceSecond);
+        if(u < probabilityFirst)
+        {
+            u = std::min(u / probabilityFirst, oneMinusEpsilon);
+            pmf *= probabilityFirst;
+            index = first;
+        }
+        else
+        {
+            u = std::min((u - probabilityFirst) / (1.f - probabilityFirst), oneMinusEpsilon);
+            pmf *= 1.f - probabilityFirst;
+            index = second;
+        }
+    }
+
+    light = m_nodes[index].m_offset;
+    return pmf > 0.f;
+}
+
+float LightTree::pmf(const glm::vec3& p, const glm::vec3& n, uint32_t light) const
+{
+    if(light >= m_lightPaths.size())
+        return 0.f;
+
+    uint64_t path = m_lightPaths[light];
+    uint32_t index = 0;
+    float result = 1.f;
+    for(uint32_t depth = 0; !m_nodes[index].isLeaf(); ++depth)
+    {
+        uint32_t first = index + 1;
+        uint32_t second = m_nodes[index].m_offset;
+        float importanceFirst = _importance(m_nodes[first], p, n);
+        float importanceSecond = _importance(m_nodes[second], p, n);
+        if(importanceFirst + importanceSecond <= 0.f)
+            return 0.f;
+
+        bool takeSecond = (path >> depth) & 1u;
+        result *= (takeSecond ? importanceSecond : importanceFirst) / (importanceFirst + importanceSecond);
+        index = takeSecond ? second : first;
+    }
+    return result;
+}
+
+} // core
+
+} // miquella
@@ -6,10 +6,10 @@ namespace miquella
 namespace core
 {
 
-bool Metal::scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out) const
+bool Metal::scatter(const Ray & incoming, const hitRecord& record, glm::vec3& color, Ray& out, Sampler& sampler) const
 {
     glm::vec3 reflected = _reflect(incoming.direction(), record.normal);
-    out = Ray(record.p, reflected + m_fuzz*randomUnitVec3());
+    out = Ray(record.p, reflected + m_fuzz*sampleUnitSphere(sampler.get2D()));
     color = m_albedo;
     return glm::dot(out.direction(), record.normal) > 0.f;
 }
@@ -1,15 +1,40 @@
 #include <miquella/core/rectangle.h>
 
+#include <cmath>
+
 namespace miquella {
 
 namespace core {
 
+namespace
+{
+    // Rectangles are sampled uniformly over their area, the density is
+    // converted to solid angle around origin
+    float rectanglePdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal, float area)
+    {
+        glm::vec3 toPoint = p - origin;
+        float distance2 = glm::dot(toPoint, toPoint);
+        float cosine = std::fabs(glm::dot(normal, toPoint)) / std::sqrt(distance2);
+        if(cosine <= 0.f || area <= 0.f)
+            return 0.f;
+        return distance2 / (cosine * area);
+    }
+
+    bool sampleRectangle(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal, float area, SurfaceSample& sample)
+    {
+        sample.p = p;
+        sample.normal = normal;
+        sample.pdf = rectanglePdf(origin, p, normal, area);
+        return sample.pdf > 0.f;
+    }
+}
+
 std::shared_ptr<Object> xyRectangle::clone()
 {
     return std::make_shared<xyRectangle>(m_x0, m_x1, m_y0, m_y1, m_z, m_material->clone());
 }
 
-bool xyRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& record)
+bool xyRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const
 {
     auto t = (m_z - r.origin().z) / r.direction().z;
     if (t < tmin || t > tmax)
@@ -22,12 +47,32 @@ bool xyRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& re
     record.t = t;
     auto normal = glm::vec3(0, 0, 1);
     record.setFaceNormal(r, normal);
-    record.material = m_material;
+    record.materialID = m_materialID;
     record.p = r.at(t);
     return true;
 }
 
-bool xzRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& record)
+AABB xyRectangle::boundingBox() const
+{
+    return AABB(glm::vec3(m_x0, m_y0, m_z - RECTANGLE_BOX_PADDING), glm::vec3(m_x1, m_y1, m_z + RECTANGLE_BOX_PADDING));
+}
+
+bool xyRectangle::sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const
+{
+    return sampleRectangle(origin, glm::vec3(m_x0 + u.x*(m_x1 - m_x0), m_y0 + u.y*(m_y1 - m_y0), m_z), glm::vec3(0.f, 0.f, 1.f), area(), sample);
+}
+
+float xyRectangle::pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const
+{
+    return rectanglePdf(origin, p, normal, area());
+}
+
+float xyRectangle::area() const
+{
+    return (m_x1 - m_x0) * (m_y1 - m_y0);
+}
+
+bool xzRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const
 {
     auto t = (m_y - r.origin().y) / r.direction().y;
     if (t < tmin || t > tmax)
@@ -40,7 +85,7 @@ bool xzRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& re
     record.t = t;
     auto normal = glm::vec3(0, 1, 0);
     record.setFaceNormal(r, normal);
-    record.material = m_material;
+    record.materialID = m_materialID;
     record.p = r.at(t);
     return true;
 }
@@ -50,7 +95,27 @@ std::shared_ptr<Object> xzRectangle::clone()
     return std::make_shared<xzRectangle>(m_x0, m_x1, m_z0, m_z1, m_y, m_material->clone());
 }
 
-bool yzRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& record)
+AABB xzRectangle::boundingBox() const
+{
+    return AABB(glm::vec3(m_x0, m_y - RECTANGLE_BOX_PADDING, m_z0), glm::vec3(m_x1, m_y + RECTANGLE_BOX_PADDING, m_z1));
+}
+
+bool xzRectangle::sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const
+{
+    return sampleRectangle(origin, glm::vec3(m_x0 + u.x*(m_x1 - m_x0), m_y, m_z0 + u.y*(m_z1 - m_z0)), glm::vec3(0.f, 1.f, 0.f), area(), sample);
+}
+
+float xzRectangle::pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const
+{
+    return rectanglePdf(origin, p, normal, area());
+}
+
+float xzRectangle::area() const
+{
+    return (m_x1 - m_x0) * (m_z1 - m_z0);
+}
+
+bool yzRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const
 {
     auto t = (m_x - r.origin().x) / r.direction().x;
     if (t < tmin || t > tmax)
@@ -63,7 +128,7 @@ bool yzRectangle::intersect(const Ray & r, float tmin, float tmax, hitRecord& re
     record.t = t;
     auto normal = glm::vec3(1, 0, 0);
     record.setFaceNormal(r, normal);
-    record.material = m_material;
+    record.materialID = m_materialID;
     record.p = r.at(t);
     return true;
 }
@@ -73,6 +138,26 @@ std::shared_ptr<Object> yzRectangle::clone()
     return std::make_shared<yzRectangle>(m_y0, m_y1, m_z0, m_z1, m_x, m_material->clone());
 }
 
+AABB yzRectangle::boundingBox() const
+{
+    return AABB(glm::vec3(m_x - RECTANGLE_BOX_PADDING, m_y0, m_z0), glm::vec3(m_x + RECTANGLE_BOX_PADDING, m_y1, m_z1));
+}
+
+bool yzRectangle::sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const
+{
+    return sampleRectangle(origin, glm::vec3(m_x, m_y0 + u.x*(m_y1 - m_y0), m_z0 + u.y*(m_z1 - m_z0)), glm::vec3(1.f, 0.f, 0.f), area(), sample);
+}
+
+float yzRectangle::pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const
+{
+    return rectanglePdf(origin, p, normal, area());
+}
+
+float yzRectangle::area() const
+{
+    return (m_y1 - m_y0) * (m_z1 - m_z0);
+}
+
 } // core
 
 } // miquella 
\ No newline at end of file
@@ -1,47 +1,444 @@
 #include <miquella/core/renderer.h>
 
+#include <limits>
+
 namespace miquella
 {
 
 namespace core
 {
 
+namespace
+{
+    // Weight of a sample of the strategy of density pdf, when combined with
+    // a strategy of density otherPdf (Veach, power heuristic with beta 2)
+    inline float powerHeuristic(float pdf, float otherPdf)
+    {
+        float p2 = pdf*pdf;
+        float o2 = otherPdf*otherPdf;
+        return p2 + o2 > 0.f ? p2 / (p2 + o2) : 0.f;
+    }
+}
+
 void Renderer::updateImageFromCamera()
 {
     assert(m_camera);
-    m_width = m_camera->getImageWidth();
-    m_height = m_camera->getImageHeight();
+    m_frameWidth = m_camera->getImageWidth();
+    m_frameHeight = m_camera->getImageHeight();
+    m_cropX = m_camera->getCropX();
+    m_cropY = m_camera->getCropY();
+    m_width = m_camera->getCropWidth();
+    m_height = m_camera->getCropHeight();
 
     m_image.resize(static_cast<size_t>(m_width * m_height * 4));
     memset(m_image.data(), 0, static_cast<size_t>(m_width * m_height * 4) * sizeof(unsigned char));
     m_imageAccumulated.resize(static_cast<size_t>(m_width * m_height));
     memset(m_imageAccumulated.data(), 0, static_cast<size_t>(m_width * m_height) * sizeof(glm::vec3));
+    m_nbSamplesAccumulated = 0;
+
+    auto nbPixels = static_cast<size_t>(m_width * m_height);
+    m_pixelSamples.assign(nbPixels, 0);
+    m_luminanceAccumulated.assign(nbPixels, 0.0);
+    m_luminanceSquaredAccumulated.assign(nbPixels, 0.0);
+    m_imageOddAccumulated.assign(nbPixels, glm::vec3(0.f, 0.f, 0.f));
+    m_pixelError.assign(nbPixels, 0.f);
+    m_pixelActive.assign(nbPixels, 1);
+    m_nbActivePixels = nbPixels;
+
+    // Emptied so that the recorded AOVs start again from 0
+    m_albedoAccumulated.clear();
+    m_normalAccumulated.clear();
+    m_depthAccumulated.clear();
+    m_objectIDs.clear();
+    _updateAOVBuffers();
+}
+
+std::string to_string(AOV aov)
+{
+    switch(aov)
+    {
+        case AOV::ALBEDO:       return "ALBEDO";
+        case AOV::NORMAL:       return "NORMAL";
+        case AOV::DEPTH:        return "DEPTH";
+        case AOV::OBJECT_ID:    return "OBJECT_ID";
+        case AOV::SAMPLE_COUNT: return "SAMPLE_COUNT";
+        default: return "";
+    }
+}
+
+void Renderer::setAOV(AOV aov, bool enabled)
+{
+    uint32_t bit = 1u << static_cast<uint32_t>(aov);
+    m_aovs = enabled ? (m_aovs | bit) : (m_aovs & ~bit);
+    _updateAOVBuffers();
+}
+
+void Renderer::setDenoising(DenoiseMode mode)
+{
+    m_denoiseMode = mode;
+    _updateAOVBuffers();
+}
+
+bool Renderer::_isAOVRecorded(AOV aov) const
+{
+    bool guide = aov == AOV::ALBEDO || aov == AOV::NORMAL || aov == AOV::DEPTH;
+    return isAOVEnabled(aov) || (guide && m_denoiseMode != DenoiseMode::OFF);
+}
+
+void Renderer::_updateAOVBuffers()
+{
+    auto update = [this](auto& buffer, AOV aov, auto value)
+    {
+        auto nbPixels = static_cast<size_t>(m_width * m_height);
+        if(!_isAOVRecorded(aov))
+        {
+            buffer.clear();
+            buffer.shrink_to_fit();
+        }
+        else if(buffer.size() != nbPixels)
+            buffer.assign(nbPixels, value);
+    };
+    update(m_albedoAccumulated, AOV::ALBEDO, glm::vec3(0.f, 0.f, 0.f));
+    update(m_normalAccumulated, AOV::NORMAL, glm::vec3(0.f, 0.f, 0.f));
+    update(m_depthAccumulated, AOV::DEPTH, 0.f);
+    update(m_objectIDs, AOV::OBJECT_ID, NO_OBJECT);
 }
 
-glm::vec3 Renderer::processRay(const Ray& r, int maxDepth, const std::shared_ptr<Scene> scene) const
+std::vector<float> Renderer::getAOV(AOV aov) const
 {
-    hitRecord rec;
+    std::vector<float> image;
+    if(!isAOVEnabled(aov))
+        return image;
 
-    if(maxDepth <= 0)
-        return glm::vec3(0.0, 0.0, 0.0);
+    auto nbPixels = static_cast<size_t>(m_width * m_height);
+    image.reserve(nbPixels * static_cast<size_t>(getNbChannels(aov)));
+    for(size_t index = 0; index < nbPixels; ++index)
+    {
+        auto n = static_cast<float>(std::max(m_pixelSamples[index], 1u));
+        switch(aov)
+        {
+            case AOV::ALBEDO:
+            case AOV::NORMAL:
+            {
+                glm::vec3 value = (aov == AOV::ALBEDO ? m_albedoAccumulated[index] : m_normalAccumulated[index]) / n;
+                image.insert(image.end(), { value.x, value.y, value.z });
+                break;
+            }
+            case AOV::DEPTH:
+                image.push_back(m_depthAccumulated[index] / n);
+                break;
+            case AOV::OBJECT_ID:
+                image.push_back(m_objectIDs[index] == NO_OBJECT ? -1.f : static_cast<float>(m_objectIDs[index]));
+                break;
+            case AOV::SAMPLE_COUNT:
+                image.push_back(static_cast<float>(m_pixelSamples[index]));
+                break;
+            default:
+                break;
+        }
+    }
+    return image;
+}
 
-    // Start at more than 0.0 to avoid self intersection
-    if(scene->intersect(r, 0.001f, std::numeric_limits<float>::max(), rec))
+bool Renderer::writeAOV(AOV aov, const std::string& path) const
+{
+    if(!isAOVEnabled(aov))
     {
+        std::cerr<<"ERROR: the AOV "<<to_string(aov)<<" is not enabled."<<std::endl;
+        return false;
+    }
+
+    std::ofstream file;
+    file.open(path, std::ofstream::binary);
+    return io::writePFM(file, m_width, m_height, getNbChannels(aov), getAOV(aov));
+}
+
+void Renderer::_fillAccumulationHeader(io::AccumulationHeader& header) const
+{
+    header.m_width = static_cast<uint32_t>(m_width);
+    header.m_height = static_cast<uint32_t>(m_height);
+    if(m_width != m_frameWidth || m_height != m_frameHeight)
+    {
+        header.m_frameWidth = static_cast<uint32_t>(m_frameWidth);
+        header.m_frameHeight = static_cast<uint32_t>(m_frameHeight);
+        header.m_cropX = static_cast<uint32_t>(m_cropX);
+        header.m_cropY = static_cast<uint32_t>(m_cropY);
+    }
+    header.m_nbSamples = m_nbSamplesAccumulated;
+    header.m_seed = m_seed;
+    header.m_firstSample = m_firstSample;
+}
+
+bool Renderer::writeAccumulation(const std::string& path, io::AccumulationHeader header) const
+{
+    _fillAccumulationHeader(header);
+    std::ofstream file;
+    file.open(path, std::ofstream::binary);
+    return io::writeAccumulation(file, header, reinterpret_cast<const float*>(m_imageAccumulated.data()), m_pixelSamples.data());
+}
+
+bool Renderer::encodeAccumulation(std::string& buffer, io::AccumulationHeader header) const
+{
+    _fillAccumulationHeader(header);
+    return io::encodeAccumulation(header, reinterpret_cast<const float*>(m_imageAccumulated.data()), m_pixelSamples.data(), buffer);
+}
+
+glm::vec3 Renderer::processRay(const Ray& r, int maxDepth, const CompiledScene& scene, Sampler& sampler, FirstHit* firstHit) const
+{
+    glm::vec3 radiance(0.f, 0.f, 0.f);
+    glm::vec3 throughput(1.f, 1.f, 1.f);
+    Ray ray = r;
+
+    bool sampleLights = m_nextEventEstimation && scene.getNbLights() > 0;
+
+    // Density of the direction of ray when it was scattered by a diffuse
+    // material while sampling the lights, 0 otherwise (camera, specular),
+    // and the normal at its origin
+    float scatterPdf = 0.f;
+    glm::vec3 scatterNormal;
+
+    for(int depth = 0; depth < maxDepth; ++depth)
+    {
+        sampler.setBounce(static_cast<uint32_t>(depth + 1));
+        hitRecord rec;
+
+        // Start at more than 0.0 to avoid self intersection
+        if(!scene.intersect(ray, 0.001f, std::numeric_limits<float>::max(), rec))
+        {
+            // Color for the background which serves as the source of light
+            glm::vec3 background = getBackground(ray);
+            radiance += throughput * background;
+            if(depth == 0 && firstHit)
+                *firstHit = { background, glm::vec3(0.f, 0.f, 0.f), 0.f, NO_OBJECT };
+            break;
+        }
+
+        const Material& material = scene.getMaterial(rec.materialID);
+        if(depth == 0 && firstHit)
+            *firstHit = { material.albedo(), rec.normal, glm::length(rec.p - ray.origin()), rec.objectID };
+        glm::vec3 emitted = material.emitted();
+        if(scatterPdf > 0.f && rec.lightID != NO_LIGHT && !nearZeroVec3(emitted))
+        {
+            // This light could also have been reached by light sampling
+            float lightPdf = scene.getLight(rec.lightID).pdf(ray.origin(), rec.p, rec.normal)
+                           * _lightSelectionPmf(scene, ray.origin(), scatterNormal, rec.lightID);
+            emitted *= powerHeuristic(scatterPdf, lightPdf);
+        }
+        radiance += throughput * emitted;
+
+        // The light sample stands for the light the next bounce could reach
+        bool lightSampled = sampleLights && !material.isSpecular();
+        if(lightSampled && depth + 1 < maxDepth)
+            radiance += throughput * _sampleLight(ray, rec, material, scene, sampler);
+
         miquella::core::Ray scatter;
         glm::vec3 attenuation;
-        glm::vec3 emitted = rec.material->emitted();
-        if(rec.material->scatter(r, rec, attenuation, scatter))
-            return emitted + attenuation * processRay(scatter, maxDepth-1, scene);
+        if(!material.scatter(ray, rec, attenuation, scatter, sampler))
+            break;
+        throughput *= attenuation;
+        scatterPdf = lightSampled ? material.pdf(ray, rec, scatter.direction()) : 0.f;
+        scatterNormal = rec.normal;
+
+        if(m_russianRoulette && depth + 1 >= m_russianRouletteMinDepth)
+        {
+            // Paths which can only contribute little are likely to stop
+            float survival = std::min(std::max({ throughput.x, throughput.y, throughput.z }), 0.95f);
+            if(sampler.get1D() >= survival)
+                break;
+            throughput /= survival;
+        }
+
+        ray = scatter;
+    }
+
+    return radiance;
+}
+
+glm::vec3 Renderer::_sampleLight(const Ray& incoming, const hitRecord& rec, const Material& material, const CompiledScene& scene, Sampler& sampler) const
+{
+    // The numbers are drawn before any early exit so the following
+    // dimensions do not depend on the outcome
+    float uLight = sampler.get1D();
+    glm::vec2 u = sampler.get2D();
+
+    uint32_t lightID;
+    float selectionPmf;
+    if(!_selectLight(scene, rec.p, rec.normal, uLight, lightID, selectionPmf))
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    const Object& light = scene.getLight(lightID);
+    SurfaceSample sample;
+    if(!light.sample(rec.p, u, sample))
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    glm::vec3 toLight = sample.p - rec.p;
+    float distance = glm::length(toLight);
+    if(distance <= 0.f)
+        return glm::vec3(0.f, 0.f, 0.f);
+    glm::vec3 direction = toLight / distance;
+
+    glm::vec3 f = material.evaluate(incoming, rec, direction);
+    if(nearZeroVec3(f))
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    // Shadow ray, stopped just before the light
+    hitRecord occluder;
+    if(scene.intersect(Ray(rec.p, direction), 0.001f, 0.999f*distance, occluder))
+        return glm::vec3(0.f, 0.f, 0.f);
+
+    float lightPdf = sample.pdf * selectionPmf;
+    float weight = powerHeuristic(lightPdf, material.pdf(incoming, rec, direction));
+    return f * scene.getMaterial(light.m_materialID).emitted() * (weight / lightPdf);
+}
+
+bool Renderer::_selectLight(const CompiledScene& scene, const glm::vec3& p, const glm::vec3& n, float u, uint32_t& lightID, float& pmf) const
+{
+    if(m_lightSelection == LightSelection::TREE)
+        return scene.getLightTree().sample(p, n, u, lightID, pmf);
+
+    uint32_t nbLights = scene.getNbLights();
+    lightID = std::min(static_cast<uint32_t>(u * static_cast<float>(nbLights)), nbLights - 1);
+    pmf = 1.f / static_cast<float>(nbLights);
+    return true;
+}
+
+float Renderer::_lightSelectionPmf(const CompiledScene& scene, const glm::vec3& p, const glm::vec3& n, uint32_t lightID) const
+{
+    if(m_lightSelection == LightSelection::TREE)
+        return scene.getLightTree().pmf(p, n, lightID);
+
+    return 1.f / static_cast<float>(scene.getNbLights());
+}
+
+void Renderer::_renderPixel(int i, int j, size_t spp, const CompiledScene& scene, Sampler& sampler)
+{
+    auto index = static_cast<size_t>(j*m_width + i);
+    if(!m_pixelActive[index])
+        return;
+
+    // Samples are numbered per pixel from the first frame, so each call
+    // draws new numbers and the numbers do not depend on the thread
+    size_t firstSample = m_firstSample + m_pixelSamples[index];
+    glm::vec3 color(0.f, 0.f, 0.f);
+    glm::vec3 oddColor(0.f, 0.f, 0.f);
+    double luminanceSum = 0.0;
+    double luminanceSquared = 0.0;
+    // The flags are read once per pixel, disabled AOVs cost a branch per sample
+    bool recordAlbedo = !m_albedoAccumulated.empty();
+    bool recordNormal = !m_normalAccumulated.empty();
+    bool recordDepth = !m_depthAccumulated.empty();
+    bool recordObject = !m_objectIDs.empty();
+    bool recordFirstHits = recordAlbedo || recordNormal || recordDepth || recordObject;
+    FirstHit firstHit;
+    for(size_t s = 0; s < spp; ++s)
+    {
+        miquella::core::Ray ray = _generateCameraRay(i, j, firstSample + s, sampler);
+        glm::vec3 sample = processRay(ray, m_maxDepth, scene, sampler, recordFirstHits ? &firstHit : nullptr);
+        color += sample;
+        if((firstSample + s) & 1)
+            oddColor += sample;
+        auto sampleLuminance = static_cast<double>(luminance(sample));
+        luminanceSum += sampleLuminance;
+        luminanceSquared += sampleLuminance * sampleLuminance;
+
+        if(recordAlbedo)
+            m_albedoAccumulated[index] += firstHit.m_albedo;
+        if(recordNormal)
+            m_normalAccumulated[index] += firstHit.m_normal;
+        if(recordDepth)
+            m_depthAccumulated[index] += firstHit.m_depth;
+        if(recordObject)
+            m_objectIDs[index] = firstHit.m_objectID;
+    }
+
+    m_imageAccumulated[index] += color;
+    m_imageOddAccumulated[index] += oddColor;
+    m_luminanceAccumulated[index] += luminanceSum;
+    m_luminanceSquaredAccumulated[index] += luminanceSquared;
+    m_pixelSamples[index] += static_cast<uint32_t>(spp);
+}
+
+void Renderer::_updateConvergence()
+{
+    if(!m_adaptiveSampling)
+        return;
+
+    // Pixels with too few samples for a reliable estimate are never converged
+    for(size_t index = 0; index < m_pixelError.size(); ++index)
+    {
+        if(m_pixelSamples[index] < m_adaptiveMinSamples)
+            m_pixelError[index] = std::numeric_limits<float>::infinity();
         else
-            return emitted;
+            m_pixelError[index] = _pixelDisplayError(index);
+    }
+
+    // A pixel keeps sampling while one of its neighbours is above the
+    // threshold: a pixel whose first samples all missed a rare bright path
+    // looks converged, its neighbours usually do not
+    m_nbActivePixels = 0;
+    for(int j = 0; j < m_height; ++j)
+    {
+        for(int i = 0; i < m_width; ++i)
+        {
+            float error = 0.f;
+            for(int y = std::max(j - 1, 0); y <= std::min(j + 1, m_height - 1); ++y)
+            {
+                for(int x = std::max(i - 1, 0); x <= std::min(i + 1, m_width - 1); ++x)
+                    error = std::max(error, m_pixelError[static_cast<size_t>(y*m_width + x)]);
+            }
+
+            bool active = error > m_adaptiveThreshold;
+            m_pixelActive[static_cast<size_t>(j*m_width + i)] = active ? 1 : 0;
+            m_nbActivePixels += active ? 1 : 0;
+        }
+    }
+}
+
+float Renderer::_pixelDisplayError(size_t index) const
+{
+    uint32_t nbSamples = m_pixelSamples[index];
+    if(nbSamples < 2)
+        return std::numeric_limits<float>::infinity();
+
+    // Standard error of the mean luminance, carried to the displayed value
+    // sqrt(L) by its derivative 1 / (2 sqrt(L))
+    const double minLuminance = 1e-4;
+    auto n = static_cast<double>(nbSamples);
+    double mean = m_luminanceAccumulated[index] / n;
+    double variance = std::max(m_luminanceSquaredAccumulated[index] / n - mean*mean, 0.0) * n / (n - 1.0);
+    return static_cast<float>(std::sqrt(variance / n) / (2.0 * std::sqrt(std::max(mean, minLuminance))));
+}
+
+float Renderer::estimateError() const
+{
+    auto display = [](const glm::vec3& color)
+    {
+        return glm::vec3(std::sqrt(std::clamp(color.x, 0.f, 1.f)), std::sqrt(std::clamp(color.y, 0.f, 1.f)), std::sqrt(std::clamp(color.z, 0.f, 1.f)));
+    };
+
+    double sum = 0.0;
+    size_t nbPixels = 0;
+    for(size_t index = 0; index < m_pixelSamples.size(); ++index)
+    {
+        uint32_t nbSamples = m_pixelSamples[index];
+        if(nbSamples < 2)
+            continue;
+
+        auto nbOdd = static_cast<float>(nbSamples / 2);
+        auto nbEven = static_cast<float>(nbSamples - nbSamples / 2);
+        glm::vec3 odd = m_imageOddAccumulated[index] / nbOdd;
+        glm::vec3 even = (m_imageAccumulated[index] - m_imageOddAccumulated[index]) / nbEven;
+        glm::vec3 diff = 0.5f * (display(even) - display(odd));
+        sum += static_cast<double>(glm::dot(diff, diff));
+        nbPixels++;
     }
 
-    // Color for the background which serves as the source of light
-    return getBackground(r);
+    if(nbPixels == 0)
+        return std::numeric_limits<float>::infinity();
+    return static_cast<float>(std::sqrt(sum / static_cast<double>(3 * nbPixels)));
 }
 
-void Renderer::render()
+void Renderer::render(size_t spp)
 {
     if(m_image.size() == 0 || m_image.size() != static_cast<size_t>(m_height*m_width*4))
     {
@@ -49,60 +446,124 @@ void Renderer::render()
         return;
     }
 
-    int maxDepth = 5;
+    // Compiled on the first frame, or after the scene was modified
+    auto scene = m_scene->getCompiledScene();
 
     auto startTime = std::chrono::steady_clock::now();
 
+    auto sampler = makeSampler(m_samplerType, m_seed);
+    m_nbSamplesAccumulated += spp;
     for (int j = m_height-1; j >= 0; --j)
     {
         for (int i = 0; i < m_width; ++i)
-        {
-
-            miquella::core::Ray ray = m_camera->generateRay(
-                        (static_cast<float>(i) + miquella::core::randomFloat()) / static_cast<float>(m_width - 1),
-                        (static_cast<float>(m_height - j - 1)  + miquella::core::randomFloat()) / static_cast<float>(m_height - 1)   // The camera (0,0) is bottom left, the texture is (0,0) is top left
-                        );
-
-            glm::vec3 color = processRay(ray, maxDepth);
+            _renderPixel(i, j, spp, *scene, *sampler);
+    }
+    _updateConvergence();
+    m_imageDirty = true;
+    if(m_denoiseMode == DenoiseMode::EVERY_RENDER)
+        denoise();
 
-            auto indexAcc = static_cast<size_t>(j*m_width + i);
-            m_imageAccumulated[indexAcc] += color;
+    auto endTime = std::chrono::steady_clock::now();
+    m_executionTime = static_cast<size_t>(std::chrono::duration<double, std::milli>(endTime - startTime).count());
+    std::cout<<"Frame "<< m_nbFrameAccumulated<<" ("<<spp<<" samples) computed in "<<m_executionTime<<" ms, "<<m_nbActivePixels<<" pixels active."<<std::endl;
 
-            // Gamma correction
-            auto scale = 1.f / static_cast<float>(m_nbFrameAccumulated+1);
-            auto r = sqrtf(m_imageAccumulated[indexAcc].x * scale);
-            auto g = sqrtf(m_imageAccumulated[indexAcc].y * scale);
-            auto b = sqrtf(m_imageAccumulated[indexAcc].z * scale);
+    m_nbFrameAccumulated++;
+}
 
+bool Renderer::_denoise(std::vector<unsigned char>& image)
+{
+    auto nbPixels = static_cast<size_t>(m_width * m_height);
+    if(m_albedoAccumulated.size() != nbPixels || m_normalAccumulated.size() != nbPixels || m_depthAccumulated.size() != nbPixels)
+    {
+        std::cerr<<"ERROR: denoising requires the first hits, enable it before rendering."<<std::endl;
+        return false;
+    }
 
+    auto startTime = std::chrono::steady_clock::now();
 
-            int ir = static_cast<int>(256.f * std::clamp(r, 0.0f, 0.999f));
-            int ig = static_cast<int>(256.f * std::clamp(g, 0.0f, 0.999f));
-            int ib = static_cast<int>(256.f * std::clamp(b, 0.0f, 0.999f));
+    if(m_denoiser.m_width != m_width || m_denoiser.m_height != m_height)
+        m_denoiser.resize(m_width, m_height);
 
-            auto index = static_cast<size_t>(j*m_width*4 + i*4);
-            m_image[index] = static_cast<unsigned char>(ir);
-            m_image[index+1] = static_cast<unsigned char>(ig);
-            m_image[index+2] = static_cast<unsigned char>(ib);
-            m_image[index+3] = static_cast<unsigned char>(255);
+    _parallelRows(m_height, [this](int y0, int y1)
+    {
+        for(auto index = static_cast<size_t>(y0*m_width); index < static_cast<size_t>(y1*m_width); ++index)
+        {
+            auto n = static_cast<float>(std::max(m_pixelSamples[index], 1u));
+            m_denoiser.setPixel(index, getPixelRadiance(index), m_albedoAccumulated[index] / n,
+                                m_normalAccumulated[index] / n, m_depthAccumulated[index] / n, _pixelDisplayError(index));
         }
+    });
+
+    for(int iteration = 0; iteration < m_denoiser.getNbIterations(); ++iteration)
+    {
+        _parallelRows(m_height, [this, iteration](int y0, int y1){ m_denoiser.filterRows(iteration, y0, y1); });
+        m_denoiser.endIteration();
     }
 
+    image.resize(4*nbPixels);
+    _parallelRows(m_height, [this, &image](int y0, int y1)
+    {
+        for(auto index = static_cast<size_t>(y0*m_width); index < static_cast<size_t>(y1*m_width); ++index)
+            _tonemapColor(m_denoiser.getPixel(index), &image[4*index]);
+    });
+
     auto endTime = std::chrono::steady_clock::now();
-    m_executionTime = static_cast<size_t>(std::chrono::duration<double, std::milli>(endTime - startTime).count());
-    std::cout<<"Sample "<< m_nbFrameAccumulated<<" computed in "<<m_executionTime<<" ms."<<std::endl;
+    m_denoiseTime = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+    return true;
+}
 
-    m_nbFrameAccumulated++;
+void Renderer::_updateImage()
+{
+    if(!m_imageDirty)
+        return;
+
+    _parallelRows(m_height, [this](int y0, int y1)
+    {
+        auto first = static_cast<size_t>(y0*m_width);
+        auto count = static_cast<size_t>((y1 - y0)*m_width);
+        m_tonemapKernel(m_imageAccumulated.data() + first, m_pixelSamples.data() + first, count, m_image.data() + 4*first);
+    });
+    m_imageDirty = false;
 }
 
-void Renderer::writeToPPM(const std::string& path) const
+const std::vector<unsigned char>& Renderer::_outputImage(std::vector<unsigned char>& denoised)
 {
+    // The displayed image keeps the noisy pixels, the next samples are
+    // added to them
+    if(m_denoiseMode == DenoiseMode::ON_WRITE)
+        _denoise(denoised);
+    if(!denoised.empty())
+        return denoised;
+
+    _updateImage();
+    return m_image;
+}
+
+void Renderer::writeToPPM(const std::string& path)
+{
+    std::vector<unsigned char> denoised;
     std::ofstream file;
     file.open(path, std::ofstream::binary);
-    io::writePPM(file, m_width, m_height, m_image);
+    io::writePPM(file, m_width, m_height, _outputImage(denoised));
     file.close();
 }
 
+void Renderer::encodePPM(std::string& buffer)
+{
+    std::vector<unsigned char> denoised;
+    io::encodePPM(m_width, m_height, _outputImage(denoised), buffer);
+}
+
+void Renderer::getOutputImage(std::vector<unsigned char>& image)
+{
+    std::vector<unsigned char> denoised;
+    const auto& output = _outputImage(denoised);
+    if(&output == &denoised)
+        image = std::move(denoised);
+    else
+        image = output;
+}
+
 } // core
 
 } // miquella
\ No newline at end of file
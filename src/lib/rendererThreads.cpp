@@ -1,105 +1,206 @@
 #include <miquella/core/rendererThreads.h>
 
+#include <bit>
+
 namespace miquella
 {
 
 namespace core
 {
 
-void RendererThreads::render()
+namespace
 {
-    if(m_image.size() == 0 || m_image.size() != static_cast<size_t>(m_height*m_width*4))
+    // Interleave the bits of x and y
+    uint64_t mortonIndex(uint32_t x, uint32_t y)
     {
-        std::cerr<<"ERROR: image resolution not initialized properly."<<std::endl;
-        return;
+        auto spread = [](uint64_t v)
+        {
+            v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+            v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+            v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+            v = (v | (v << 2)) & 0x3333333333333333ull;
+            v = (v | (v << 1)) & 0x5555555555555555ull;
+            return v;
+        };
+        return spread(x) | (spread(y) << 1);
     }
 
-    int maxDepth = 5;
+    // Distance of (x, y) along the Hilbert curve covering a n x n grid, n a power of 2
+    uint64_t hilbertIndex(uint32_t n, uint32_t x, uint32_t y)
+    {
+        uint64_t d = 0;
+        for(uint32_t s = n / 2; s > 0; s /= 2)
+        {
+            uint32_t rx = (x & s) > 0 ? 1 : 0;
+            uint32_t ry = (y & s) > 0 ? 1 : 0;
+            d += static_cast<uint64_t>(s) * s * ((3 * rx) ^ ry);
 
-    auto startTime = std::chrono::steady_clock::now();
+            // Rotate the quadrant
+            if(ry == 0)
+            {
+                if(rx == 1)
+                {
+                    x = s - 1 - (x & (s - 1));
+                    y = s - 1 - (y & (s - 1));
+                }
+                std::swap(x, y);
+            }
+        }
+        return d;
+    }
+}
 
-    //for (int j = m_height-1; j >= 0; --j)
+std::string to_string(TileOrder order)
+{
+    switch(order)
+    {
+        case TileOrder::ROW_MAJOR:  return "ROW_MAJOR";
+        case TileOrder::MORTON:     return "MORTON";
+        case TileOrder::HILBERT:    return "HILBERT";
+        default: return "";
+    }
+}
 
-    // Will not work with Ubuntu 18, gcc 7 and 8 too old, need 10 minimum
-    //std::for_each(std::execution::par_unseq, std::begin(m_heightIndexes), std::end(m_heightIndexes), [&](int j))
+std::string to_string(Scheduling scheduling)
+{
+    switch(scheduling)
+    {
+        case Scheduling::COLUMNS:   return "COLUMNS";
+        case Scheduling::TILES:     return "TILES";
+        default: return "";
+    }
+}
 
-    //int nbTasks = 6;
+void RendererThreads::_updateTiles()
+{
+    m_tiles.clear();
+    for(int y = 0; y < m_height; y += m_tileSize)
+    {
+        for(int x = 0; x < m_width; x += m_tileSize)
+            m_tiles.push_back({ x, y, std::min(x + m_tileSize, m_width), std::min(y + m_tileSize, m_height) });
+    }
+
+    if(m_tileOrder == TileOrder::ROW_MAJOR)
+        return;
 
-    // TODO: document the parallelization method, the difference between the pool size and the number of task,
-    // and how are the tasks sliced from the image.
+    // The curves are defined on a square power of 2 grid of tiles, the
+    // positions outside of the image are skipped.
+    auto nbTilesX = static_cast<uint32_t>((m_width + m_tileSize - 1) / m_tileSize);
+    auto nbTilesY = static_cast<uint32_t>((m_height + m_tileSize - 1) / m_tileSize);
+    uint32_t gridSize = std::bit_ceil(std::max({ nbTilesX, nbTilesY, 1u }));
 
-    spdlog::trace("Number of threads: {}, number of blocks: {}", m_nbThreads, m_nbBlocks);
+    auto curveIndex = [this, gridSize](const Tile& tile)
+    {
+        auto x = static_cast<uint32_t>(tile.m_x0 / m_tileSize);
+        auto y = static_cast<uint32_t>(tile.m_y0 / m_tileSize);
+        return m_tileOrder == TileOrder::MORTON ? mortonIndex(x, y) : hilbertIndex(gridSize, x, y);
+    };
+    std::sort(m_tiles.begin(), m_tiles.end(), [&curveIndex](const Tile& a, const Tile& b)
+    {
+        return curveIndex(a) < curveIndex(b);
+    });
+}
 
-    auto loop = [this, maxDepth](const int start, const int end)
+void RendererThreads::_renderColumns(size_t spp, const CompiledScene& scene)
+{
+    // Original scheme kept for comparison: block b renders the columns i
+    // with i % m_nbBlocks == b. Neighbour columns belong to different
+    // threads, which share the cache lines of the image buffers.
+    auto loop = [this, spp, &scene](const int start, const int end)
     {
         (void)end;
-        auto scene = m_scene->clone();
-        //auto scene = m_scene;
         auto startTask = std::chrono::high_resolution_clock::now();
-        //spdlog::trace("Block starting from {} to {}", start, end);
-#define LOAD_BALANCE 1
-#if LOAD_BALANCE 
-        for(int i = 0; i < m_width; ++i)
+        auto sampler = makeSampler(m_samplerType, m_seed);
+        for(int i = start; i < m_width; i += static_cast<int>(m_nbBlocks))
         {
-            if (i % static_cast<int>(m_nbBlocks) != start) continue; 
-#else 
-        for (int i = start; i < end; ++i)
-        {
-#endif
             for(int j = 0; j < m_height; j++)
-            {
-
-                miquella::core::Ray ray = m_camera->generateRay(
-                            (static_cast<float>(i) + miquella::core::randomFloat()) / static_cast<float>(m_width - 1),
-                            (static_cast<float>(m_height - j - 1)  + miquella::core::randomFloat()) / static_cast<float>(m_height - 1)   // The camera (0,0) is bottom left, the texture is (0,0) is top left
-                            );
-
-                glm::vec3 color = processRay(ray, maxDepth, scene);
-
-                auto indexAcc = static_cast<size_t>(j*m_width + i);
-                m_imageAccumulated[indexAcc] += color;
-
-                // Gamma correction
-                auto scale = 1.f / static_cast<float>(m_nbFrameAccumulated+1);
-                auto r = sqrtf(m_imageAccumulated[indexAcc].x * scale);
-                auto g = sqrtf(m_imageAccumulated[indexAcc].y * scale);
-                auto b = sqrtf(m_imageAccumulated[indexAcc].z * scale);
-
-
+                _renderPixel(i, j, spp, scene, *sampler);
+        }
+        auto endTask = std::chrono::high_resolution_clock::now();
+        auto taskDuration = std::chrono::duration<double, std::milli>(endTask-startTask);
+        spdlog::trace("[Frame {}] Task completed in {} ms.", m_nbFrameAccumulated, taskDuration.count());
+    };
 
-                int ir = static_cast<int>(256.f * std::clamp(r, 0.0f, 0.999f));
-                int ig = static_cast<int>(256.f * std::clamp(g, 0.0f, 0.999f));
-                int ib = static_cast<int>(256.f * std::clamp(b, 0.0f, 0.999f));
+    BS::multi_future<void> loopFuture = m_pool.submit_blocks(0, static_cast<int>(m_nbBlocks), loop, static_cast<size_t>(m_nbBlocks));
+    loopFuture.wait();
+}
 
-                auto index = static_cast<size_t>(j*m_width*4 + i*4);
-                m_image[index] = static_cast<unsigned char>(ir);
-                m_image[index+1] = static_cast<unsigned char>(ig);
-                m_image[index+2] = static_cast<unsigned char>(ib);
-                m_image[index+3] = static_cast<unsigned char>(255);
+void RendererThreads::_renderTiles(size_t spp, const CompiledScene& scene)
+{
+    // One task per thread. Each task takes the next tile from the shared
+    // counter until none is left, so fast threads pick up the tiles the
+    // slow ones did not reach and all threads finish at about the same time.
+    std::atomic<size_t> nextTile = 0;
+    auto worker = [this, spp, &scene, &nextTile](const uint32_t task)
+    {
+        auto startTask = std::chrono::high_resolution_clock::now();
+        size_t nbTilesRendered = 0;
+        auto sampler = makeSampler(m_samplerType, m_seed);
+        for(size_t t = nextTile.fetch_add(1, std::memory_order_relaxed); t < m_tiles.size(); t = nextTile.fetch_add(1, std::memory_order_relaxed))
+        {
+            const Tile& tile = m_tiles[t];
+            for(int j = tile.m_y0; j < tile.m_y1; ++j)
+            {
+                for(int i = tile.m_x0; i < tile.m_x1; ++i)
+                    _renderPixel(i, j, spp, scene, *sampler);
             }
+            nbTilesRendered++;
         }
         auto endTask = std::chrono::high_resolution_clock::now();
         auto taskDuration = std::chrono::duration<double, std::milli>(endTask-startTask);
-        //std::cout<<"[Sample "<< m_nbFrameAccumulated<<"] Task completed in "<<taskDuration.count()<<" ms."<<std::endl;
-        spdlog::trace("[Sample {}] Task completed in {} ms.", m_nbFrameAccumulated, taskDuration.count());
+        spdlog::trace("[Frame {}] Task {} rendered {} tiles in {} ms.", m_nbFrameAccumulated, task, nbTilesRendered, taskDuration.count());
     };
 
-#if LOAD_BALANCE 
-    BS::multi_future<void> loopFuture = m_pool.submit_blocks(0, static_cast<int>(m_nbBlocks), loop, static_cast<size_t>(m_nbBlocks));
-#else
-    BS::multi_future<void> loopFuture = m_pool.submit_blocks(0, m_width, loop, static_cast<size_t>(nbTasks));
-#endif
-    
+    BS::multi_future<void> loopFuture = m_pool.submit_sequence(0u, m_nbThreads, worker);
     loopFuture.wait();
+}
+
+void RendererThreads::_parallelRows(int nbRows, const std::function<void(int, int)>& task)
+{
+    BS::multi_future<void> rowsFuture = m_pool.submit_blocks(0, nbRows, task, static_cast<size_t>(m_nbThreads));
+    rowsFuture.wait();
+}
+
+void RendererThreads::render(size_t spp)
+{
+    if(m_image.size() == 0 || m_image.size() != static_cast<size_t>(m_height*m_width*4))
+    {
+        std::cerr<<"ERROR: image resolution not initialized properly."<<std::endl;
+        return;
+    }
+
+    // Compiled on the first frame, or after the scene was modified. The
+    // compiled scene is read only and shared by all the tasks.
+    auto compiledScene = m_scene->getCompiledScene();
+    const CompiledScene& scene = *compiledScene;
+
+    auto startTime = std::chrono::steady_clock::now();
+
+    // Will not work with Ubuntu 18, gcc 7 and 8 too old, need 10 minimum
+    //std::for_each(std::execution::par_unseq, std::begin(m_heightIndexes), std::end(m_heightIndexes), [&](int j))
+
+    spdlog::trace("Number of threads: {}, number of blocks: {}, scheduling: {}", m_nbThreads, m_nbBlocks, to_string(m_scheduling));
+
+    // All the samples of the call are traced before a pixel is written back
+    // to the image, the threads synchronize once per call.
+    m_nbSamplesAccumulated += spp;
+    if(m_scheduling == Scheduling::COLUMNS)
+        _renderColumns(spp, scene);
+    else
+        _renderTiles(spp, scene);
+    _updateConvergence();
+    m_imageDirty = true;
+    if(m_denoiseMode == DenoiseMode::EVERY_RENDER)
+        denoise();
 
     auto endTime = std::chrono::steady_clock::now();
     m_executionTime = static_cast<size_t>(std::chrono::duration<double, std::milli>(endTime - startTime).count());
     m_totalExecutionAccumulated += m_executionTime;
     //std::cout<<"Sample "<< m_nbFrameAccumulated<<" computed in "<<m_executionTime<<" ms, accumulated average " << m_totalExecutionAccumulated / (m_nbFrameAccumulated)<<std::endl;
-    spdlog::trace("Sample {} computed in {} ms, accumulated average {} ms.", m_nbFrameAccumulated, m_executionTime, m_totalExecutionAccumulated / (m_nbFrameAccumulated));
+    spdlog::trace("Frame {} ({} samples) computed in {} ms, accumulated average {} ms, {} pixels active.", m_nbFrameAccumulated, spp, m_executionTime, m_totalExecutionAccumulated / (m_nbFrameAccumulated), m_nbActivePixels);
     m_nbFrameAccumulated++;
 }
 
 } // core
 
-} // miquella
\ No newline at end of file
+} // miquella
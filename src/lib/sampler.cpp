@@ -0,0 +1,322 @@
+#include <miquella/core/sampler.h>
+
+#include <vector>
+#include <cmath>
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    // Integer hash (Wellons, "lowbias32")
+    inline uint32_t hash(uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7FEB352Du;
+        x ^= x >> 15;
+        x *= 0x846CA68Bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    inline uint32_t hashCombine(uint32_t seed, uint32_t value)
+    {
+        return hash(seed ^ (value + 0x9E3779B9u + (seed << 6) + (seed >> 2)));
+    }
+
+    inline uint32_t reverseBits(uint32_t x)
+    {
+        x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+        x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+        x = ((x >> 4) & 0x0F0F0F0Fu) | ((x & 0x0F0F0F0Fu) << 4);
+        x = ((x >> 8) & 0x00FF00FFu) | ((x & 0x00FF00FFu) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Owen scrambling of the bits of x, in the reversed bit order used by
+    // the permutation of Laine and Karras
+    inline uint32_t nestedUniformScramble(uint32_t x, uint32_t seed)
+    {
+        x = reverseBits(x);
+        x += seed;
+        x ^= x * 0x6C50B47Cu;
+        x ^= x * 0xB82F1E52u;
+        x ^= x * 0xC7AFE638u;
+        x ^= x * 0x8D22F6E6u;
+        return reverseBits(x);
+    }
+
+    // Second Sobol dimension (x + 1 polynomial). The direction numbers are
+    // combined one byte of the index at a time: m_table[k][b] is the xor of
+    // the direction numbers of the bits set in the byte b of rank k.
+    struct SobolTable
+    {
+        constexpr SobolTable() : m_table()
+        {
+            uint32_t directions[32] = {};
+            directions[0] = 0x80000000u;
+            for(int i = 1; i < 32; ++i)
+                directions[i] = directions[i - 1] ^ (directions[i - 1] >> 1);
+
+            for(int k = 0; k < 4; ++k)
+            {
+                for(uint32_t b = 0; b < 256; ++b)
+                {
+                    uint32_t value = 0;
+                    for(int bit = 0; bit < 8; ++bit)
+                    {
+                        if(b & (1u << bit))
+                            value ^= directions[8*k + bit];
+                    }
+                    m_table[k][b] = value;
+                }
+            }
+        }
+        uint32_t m_table[4][256];
+    };
+    constexpr SobolTable sobolTable;
+
+    // First dimension: van der Corput sequence. Second dimension: Sobol.
+    inline uint32_t sobol(uint32_t index, int dimension)
+    {
+        if(dimension == 0)
+            return reverseBits(index);
+
+        return sobolTable.m_table[0][index & 0xFFu] ^ sobolTable.m_table[1][(index >> 8) & 0xFFu]
+             ^ sobolTable.m_table[2][(index >> 16) & 0xFFu] ^ sobolTable.m_table[3][index >> 24];
+    }
+
+    // Point of an Owen scrambled Sobol sequence, one sequence per seed.
+    // The index is shuffled as well so that the sequences of different
+    // seeds are not correlated (Burley 2020).
+    inline uint32_t owenSobol1D(uint32_t index, uint32_t seed)
+    {
+        index = nestedUniformScramble(index, seed);
+        return nestedUniformScramble(sobol(index, 0), hashCombine(seed, 0));
+    }
+
+    inline void owenSobol2D(uint32_t index, uint32_t seed, uint32_t& x, uint32_t& y)
+    {
+        index = nestedUniformScramble(index, seed);
+        x = nestedUniformScramble(sobol(index, 0), hashCombine(seed, 0));
+        y = nestedUniformScramble(sobol(index, 1), hashCombine(seed, 1));
+    }
+
+    std::vector<uint32_t> buildBlueNoiseMask()
+    {
+        // Void and cluster: the energy of a pixel is the sum of a gaussian
+        // centered on each point of the pattern, wrapping around the mask.
+        // Points are added in the largest void (lowest energy) and removed
+        // from the tightest cluster (highest energy), the order of insertion
+        // gives the rank of each pixel.
+        const int n = static_cast<int>(blueNoiseMaskSize);
+        const int size = n*n;
+        const float sigma = 1.5f;
+
+        std::vector<float> kernel(static_cast<size_t>(size));
+        for(int dy = 0; dy < n; ++dy)
+        {
+            for(int dx = 0; dx < n; ++dx)
+            {
+                auto x = static_cast<float>(std::min(dx, n - dx));
+                auto y = static_cast<float>(std::min(dy, n - dy));
+                kernel[static_cast<size_t>(dy*n + dx)] = std::exp(-(x*x + y*y) / (2.f*sigma*sigma));
+            }
+        }
+
+        std::vector<uint8_t> pattern(static_cast<size_t>(size), 0);
+        std::vector<float> energy(static_cast<size_t>(size), 0.f);
+        auto update = [&](std::vector<uint8_t>& p, std::vector<float>& e, int index, bool add)
+        {
+            p[static_cast<size_t>(index)] = add ? 1 : 0;
+            const float sign = add ? 1.f : -1.f;
+            const int px = index % n;
+            const int py = index / n;
+            for(int dy = 0; dy < n; ++dy)
+            {
+                const int row = ((py + dy) % n) * n;
+                for(int dx = 0; dx < n; ++dx)
+                    e[static_cast<size_t>(row + (px + dx) % n)] += sign * kernel[static_cast<size_t>(dy*n + dx)];
+            }
+        };
+        auto extremum = [&](const std::vector<uint8_t>& p, const std::vector<float>& e, bool tightestCluster)
+        {
+            int best = -1;
+            for(int i = 0; i < size; ++i)
+            {
+                const auto ui = static_cast<size_t>(i);
+                if(p[ui] != (tightestCluster ? 1 : 0))
+                    continue;
+                if(best < 0 || (tightestCluster ? e[ui] > e[static_cast<size_t>(best)] : e[ui] < e[static_cast<size_t>(best)]))
+                    best = i;
+            }
+            return best;
+        };
+
+        // Initial pattern: 10% of random pixels, then relaxed until the
+        // tightest cluster is also the largest void
+        PCG32 rng(0x626C7565u);
+        int nbInitialPoints = size / 10;
+        for(int added = 0; added < nbInitialPoints;)
+        {
+            auto index = static_cast<int>(rng.nextUInt() % static_cast<uint32_t>(size));
+            if(pattern[static_cast<size_t>(index)])
+                continue;
+            update(pattern, energy, index, true);
+            ++added;
+        }
+        for(int iteration = 0; iteration < size; ++iteration)
+        {
+            int cluster = extremum(pattern, energy, true);
+            update(pattern, energy, cluster, false);
+            int maxVoid = extremum(pattern, energy, false);
+            update(pattern, energy, maxVoid, true);
+            if(maxVoid == cluster)
+                break;
+        }
+
+        std::vector<int> ranks(static_cast<size_t>(size), 0);
+
+        // Ranks of the initial points, by removing the tightest clusters
+        auto removalPattern = pattern;
+        auto removalEnergy = energy;
+        for(int rank = nbInitialPoints - 1; rank >= 0; --rank)
+        {
+            int cluster = extremum(removalPattern, removalEnergy, true);
+            update(removalPattern, removalEnergy, cluster, false);
+            ranks[static_cast<size_t>(cluster)] = rank;
+        }
+
+        // Ranks of the other pixels, by filling the largest voids
+        for(int rank = nbInitialPoints; rank < size; ++rank)
+        {
+            int maxVoid = extremum(pattern, energy, false);
+            update(pattern, energy, maxVoid, true);
+            ranks[static_cast<size_t>(maxVoid)] = rank;
+        }
+
+        // Center of each of the size intervals of [0, 2^32)
+        std::vector<uint32_t> mask(static_cast<size_t>(size));
+        const uint32_t step = static_cast<uint32_t>((uint64_t(1) << 32) / static_cast<uint64_t>(size));
+        for(size_t i = 0; i < mask.size(); ++i)
+            mask[i] = static_cast<uint32_t>(ranks[i]) * step + step / 2;
+        return mask;
+    }
+}
+
+std::string to_string(SamplerType type)
+{
+    switch(type)
+    {
+        case SamplerType::INDEPENDENT:  return "INDEPENDENT";
+        case SamplerType::SOBOL:        return "SOBOL";
+        case SamplerType::BLUE_NOISE:   return "BLUE_NOISE";
+        default: return "";
+    }
+}
+
+void IndependentSampler::startPixelSample(uint32_t x, uint32_t y, uint32_t sample)
+{
+    m_rng = PixelRNG((y << 16) ^ x, sample, m_seed);
+    Sampler::startPixelSample(x, y, sample);
+}
+
+void IndependentSampler::setBounce(uint32_t bounce)
+{
+    m_rng.setBounce(bounce);
+    Sampler::setBounce(bounce);
+}
+
+glm::vec2 IndependentSampler::get2D()
+{
+    float u = m_rng.nextFloat();
+    float v = m_rng.nextFloat();
+    return glm::vec2(u, v);
+}
+
+std::unique_ptr<Sampler> IndependentSampler::clone() const
+{
+    return std::make_unique<IndependentSampler>(m_seed);
+}
+
+uint32_t SobolSampler::_dimensionSeed()
+{
+    uint32_t seed = hashCombine(hashCombine(m_seed, (m_y << 16) ^ m_x), m_bounce);
+    return hashCombine(seed, m_dimension++);
+}
+
+float SobolSampler::get1D()
+{
+    return uintToFloat(owenSobol1D(m_sample, _dimensionSeed()));
+}
+
+glm::vec2 SobolSampler::get2D()
+{
+    uint32_t x, y;
+    owenSobol2D(m_sample, _dimensionSeed(), x, y);
+    return glm::vec2(uintToFloat(x), uintToFloat(y));
+}
+
+std::unique_ptr<Sampler> SobolSampler::clone() const
+{
+    return std::make_unique<SobolSampler>(m_seed);
+}
+
+BlueNoiseSampler::BlueNoiseSampler(uint32_t seed) :
+    Sampler(seed),
+    m_mask(getBlueNoiseMask())
+{
+}
+
+uint32_t BlueNoiseSampler::_maskValue(uint32_t dimensionSeed) const
+{
+    const uint32_t mask = blueNoiseMaskSize - 1;
+    uint32_t x = (m_x + dimensionSeed) & mask;
+    uint32_t y = (m_y + (dimensionSeed >> 8)) & mask;
+    return m_mask[y*blueNoiseMaskSize + x];
+}
+
+float BlueNoiseSampler::get1D()
+{
+    // Fixed point arithmetic: the overflow of the sum is the modulo 1
+    uint32_t seed = hashCombine(hashCombine(m_seed, m_bounce), m_dimension++);
+    return uintToFloat(owenSobol1D(m_sample, seed) + _maskValue(seed));
+}
+
+glm::vec2 BlueNoiseSampler::get2D()
+{
+    uint32_t seed = hashCombine(hashCombine(m_seed, m_bounce), m_dimension++);
+    uint32_t x, y;
+    owenSobol2D(m_sample, seed, x, y);
+    return glm::vec2(uintToFloat(x + _maskValue(seed)), uintToFloat(y + _maskValue(hash(seed))));
+}
+
+std::unique_ptr<Sampler> BlueNoiseSampler::clone() const
+{
+    return std::make_unique<BlueNoiseSampler>(m_seed);
+}
+
+std::unique_ptr<Sampler> makeSampler(SamplerType type, uint32_t seed)
+{
+    switch(type)
+    {
+        case SamplerType::SOBOL:
+            return std::make_unique<SobolSampler>(seed);
+        case SamplerType::BLUE_NOISE:
+            return std::make_unique<BlueNoiseSampler>(seed);
+        case SamplerType::INDEPENDENT:
+        default:
+            return std::make_unique<IndependentSampler>(seed);
+    }
+}
+
+const uint32_t* getBlueNoiseMask()
+{
+    static const std::vector<uint32_t> mask = buildBlueNoiseMask();
+    return mask.data();
+}
+
+} // core
+
+} // miquella
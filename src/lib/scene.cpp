@@ -1,47 +1,102 @@
 #include <miquella/core/scene.h>
 
+#include <algorithm>
+
 namespace miquella {
 
 namespace core {
 
+std::string to_string(AccelerationStructure accel)
+{
+    switch(accel)
+    {
+        case AccelerationStructure::LINEAR:     return "LINEAR";
+        case AccelerationStructure::BVH:        return "BVH";
+        case AccelerationStructure::WIDE_BVH_4: return "WIDE_BVH_4";
+        case AccelerationStructure::WIDE_BVH_8: return "WIDE_BVH_8";
+        case AccelerationStructure::AUTO:       return "AUTO";
+        default: return "";
+    }
+}
+
 void Scene::addObject(std::shared_ptr<Object> obj)
 {
+    obj->m_materialID = addMaterial(obj->m_material);
     m_objects.push_back(obj);
 
     if(obj->isLightSource())
         m_lights.push_back(obj);
+
+    m_compiledScene.reset();
+}
+
+uint32_t Scene::addMaterial(std::shared_ptr<Material> material)
+{
+    // Scenes share materials between objects, keep a single entry for each
+    auto it = std::find(m_materials.begin(), m_materials.end(), material);
+    if(it != m_materials.end())
+        return static_cast<uint32_t>(it - m_materials.begin());
+
+    m_materials.push_back(material);
+    return static_cast<uint32_t>(m_materials.size() - 1);
 }
 
-bool Scene::intersect(const Ray & r, float tmin, float tmax, hitRecord& record)
+bool Scene::setMaterial(const std::shared_ptr<Object>& obj, std::shared_ptr<Material> material)
 {
-    hitRecord localRecord;
-    bool hitFound = false;
-    float currentMax = tmax;
-    for(auto & obj : m_objects)
+    if(std::find(m_objects.begin(), m_objects.end(), obj) == m_objects.end())
+        return false;
+
+    obj->m_material = material;
+    obj->m_materialID = addMaterial(material);
+
+    // The object may have become a light or stopped being one
+    m_lights.clear();
+    for(auto & object : m_objects)
     {
-        if(obj->intersect(r, tmin, currentMax, localRecord))
-        {
-            hitFound = true;
-            currentMax = localRecord.t;
-            record = localRecord;
-        }
+        if(object->isLightSource())
+            m_lights.push_back(object);
     }
 
-    return hitFound;
+    m_compiledScene.reset();
+    return true;
+}
+
+std::shared_ptr<const CompiledScene> Scene::getCompiledScene()
+{
+    if(!m_compiledScene)
+        m_compiledScene = std::make_shared<CompiledScene>(*this);
+
+    return m_compiledScene;
 }
 
 std::shared_ptr<Scene> Scene::clone() 
 {
     auto copy = std::make_shared<Scene>();
+    for (auto& material : m_materials)
+        copy->m_materials.push_back(material ? material->clone() : nullptr);
+
+    // Cloned objects point to the cloned material table
+    auto cloneObject = [&copy](const std::shared_ptr<Object>& obj)
+    {
+        auto objCopy = obj->clone();
+        objCopy->m_materialID = obj->m_materialID;
+        objCopy->m_material = copy->m_materials[obj->m_materialID];
+        return objCopy;
+    };
+
+    // The lights are the cloned emitting objects, not separate copies
     for (auto& obj : m_objects)
-        copy->m_objects.push_back(obj->clone());
+    {
+        copy->m_objects.push_back(cloneObject(obj));
+        if(copy->m_objects.back()->isLightSource())
+            copy->m_lights.push_back(copy->m_objects.back());
+    }
 
-    for (auto& light : m_lights)
-        copy->m_lights.push_back(light->clone());
+    copy->m_accelerationStructure = m_accelerationStructure;
 
     return copy;
 }
 
 } // core
 
-} // miquella
\ No newline at end of file
+} // miquella
@@ -16,6 +16,7 @@ std::string to_string(SceneID id)
         case SceneID::SCENE_DIELECTRIC:         return "SCENE_DIELECTRIC";
         case SceneID::SCENE_EMPTY_CORNEL:       return "SCENE_EMPTY_CORNEL";
         case SceneID::SCENE_SPHERE_CORNEL:      return "SCENE_SPHERE_CORNEL";
+        case SceneID::SCENE_MANY_LIGHTS:        return "SCENE_MANY_LIGHTS";
         default: return "";
     }
 }
@@ -355,6 +356,59 @@ std::tuple<std::shared_ptr<miquella::core::Scene>, std::shared_ptr<miquella::cor
     return { scene, camera, miquella::core::Background::BLACK };
 }
 
+std::tuple<std::shared_ptr<miquella::core::Scene>, std::shared_ptr<miquella::core::Camera>, miquella::core::Background > SceneFactory::createManyLights(uint32_t nbLights) const
+{
+    // Same scene from one call to the next for a given number of lights
+    seedRandom(0);
+    std::shared_ptr<miquella::core::Scene> scene = std::make_shared<miquella::core::Scene>();
+
+    auto groundMat = std::make_shared<miquella::core::Lambertian>(glm::vec3(0.5f, 0.5f, 0.5f));
+    auto groundSphere = std::make_shared<miquella::core::Sphere>(glm::vec3(0,-1000.f,0), 1000.f, groundMat);
+    scene->addObject(groundSphere);
+
+    for(int i = -1; i <= 1; ++i)
+    {
+        auto mat = std::make_shared<miquella::core::Lambertian>(glm::vec3(0.7f, 0.3f + 0.2f*static_cast<float>(i + 1), 0.3f));
+        auto sphere = std::make_shared<miquella::core::Sphere>(glm::vec3(4.f*static_cast<float>(i), 1.5f, 0.f), 1.5f, mat);
+        scene->addObject(sphere);
+    }
+
+    // The lights are spread over a square whose area grows with their number,
+    // so that each point is mostly lit by its neighbours. They float above
+    // the field of view of the camera: the noise of the image comes from the
+    // lighting, not from the lights seen directly.
+    const float halfSize = 2.f * std::sqrt(static_cast<float>(nbLights));
+    for(uint32_t i = 0; i < nbLights; ++i)
+    {
+        auto x = miquella::core::randomFloat(-halfSize, halfSize);
+        auto z = miquella::core::randomFloat(-halfSize, halfSize);
+        auto y = miquella::core::randomFloat(3.5f, 5.f);
+
+        // A few bright lights among many dim ones
+        auto intensity = miquella::core::randomFloat(0.f, 1.f) < 0.1f ? 200.f : 20.f;
+        glm::vec3 color(miquella::core::randomFloat(0.2f, 1.0f), miquella::core::randomFloat(0.2f, 1.0f), miquella::core::randomFloat(0.2f, 1.0f));
+
+        auto mat = std::make_shared<miquella::core::DiffuseLight>(intensity * color);
+        auto light = std::make_shared<miquella::core::Sphere>(glm::vec3(x, y, z), 0.15f, mat);
+        scene->addObject(light);
+    }
+
+    const auto aspectRatio = 16.0f / 9.0f;
+    glm::vec3 lookFrom = {0.f, 2.5f, 12.f};
+    glm::vec3 lookAt = {0.f, 0.f, 6.f};
+    std::shared_ptr<miquella::core::LookAtCamera> camera = std::make_shared<miquella::core::LookAtCamera>(
+                lookFrom,
+                lookAt,
+                glm::vec3{0.f, 1.f, 0.f},
+                40.f,
+                aspectRatio,
+                0.f,
+                glm::distance(lookFrom, lookAt),
+                600);
+
+    return { scene, camera, miquella::core::Background::BLACK };
+}
+
 } // core 
 
 } // miquella
\ No newline at end of file
@@ -4,13 +4,12 @@ namespace miquella {
 
 namespace core {
 
-bool Sphere::intersect(const Ray & r, float tmin, float tmax, hitRecord& record)
+bool Sphere::intersect(const Ray & r, float tmin, float tmax, hitRecord& record) const
 {
     glm::vec3 oc = r.origin() - m_center;
-    //auto a = r.direction().length_squared();
-    auto a = glm::length(r.direction()) * glm::length(r.direction());
+    auto a = glm::dot(r.direction(), r.direction());
     auto half_b = glm::dot(oc, r.direction());
-    auto c = glm::length(oc) * glm::length(oc)- m_r*m_r;
+    auto c = glm::dot(oc, oc) - m_r*m_r;
 
     auto discriminant = half_b*half_b - a*c;
     if (discriminant < 0) return false;
@@ -29,11 +28,67 @@ bool Sphere::intersect(const Ray & r, float tmin, float tmax, hitRecord& record)
     record.p = r.at(record.t);
     auto normal = (record.p - m_center) / m_r;
     record.setFaceNormal(r, normal);
-    record.material = m_material;
+    record.materialID = m_materialID;
 
     return true;
 }
 
+bool Sphere::sample(const glm::vec3& origin, const glm::vec2& u, SurfaceSample& sample) const
+{
+    glm::vec3 toCenter = m_center - origin;
+    float distance2 = glm::dot(toCenter, toCenter);
+    if(distance2 <= m_r*m_r)
+    {
+        sample.normal = sampleUnitSphere(u);
+        sample.p = m_center + m_r*sample.normal;
+        sample.pdf = pdf(origin, sample.p, sample.normal);
+        return sample.pdf > 0.f;
+    }
+
+    // Direction in the cone around the center, then the nearest point of
+    // the sphere along it (Physically Based Rendering, 3rd ed, 14.2.2)
+    float distance = std::sqrt(distance2);
+    float sinThetaMax2 = m_r*m_r / distance2;
+    float cosThetaMax = std::sqrt(std::max(0.f, 1.f - sinThetaMax2));
+    float cosTheta = 1.f - u.x*(1.f - cosThetaMax);
+    float sinTheta2 = std::max(0.f, 1.f - cosTheta*cosTheta);
+    float phi = 2.f*pi*u.y;
+
+    glm::vec3 w = toCenter / distance;
+    glm::vec3 a = std::fabs(w.x) > 0.9f ? glm::vec3(0.f, 1.f, 0.f) : glm::vec3(1.f, 0.f, 0.f);
+    glm::vec3 v = glm::normalize(glm::cross(w, a));
+    glm::vec3 t = glm::cross(w, v);
+    glm::vec3 direction = std::sqrt(sinTheta2)*(std::cos(phi)*t + std::sin(phi)*v) + cosTheta*w;
+
+    float hitDistance = distance*cosTheta - std::sqrt(std::max(0.f, m_r*m_r - distance2*sinTheta2));
+    sample.p = origin + hitDistance*direction;
+    sample.normal = (sample.p - m_center) / m_r;
+    sample.pdf = pdf(origin, sample.p, sample.normal);
+    return true;
+}
+
+float Sphere::pdf(const glm::vec3& origin, const glm::vec3& p, const glm::vec3& normal) const
+{
+    glm::vec3 toCenter = m_center - origin;
+    float distance2 = glm::dot(toCenter, toCenter);
+    if(distance2 <= m_r*m_r)
+    {
+        // Area density converted to solid angle
+        glm::vec3 toPoint = p - origin;
+        float pointDistance2 = glm::dot(toPoint, toPoint);
+        float cosine = std::fabs(glm::dot(normal, toPoint)) / std::sqrt(pointDistance2);
+        if(cosine <= 0.f)
+            return 0.f;
+        return pointDistance2 / (cosine * area());
+    }
+
+    // 1 - cos(thetaMax), written to stay accurate for small cones
+    float sinThetaMax2 = m_r*m_r / distance2;
+    float cosThetaMax = std::sqrt(std::max(0.f, 1.f - sinThetaMax2));
+    float coneSolidAngle = 2.f*pi*sinThetaMax2 / (1.f + cosThetaMax);
+    return 1.f / coneSolidAngle;
+}
+
 } // core
 
 } // miquella
\ No newline at end of file
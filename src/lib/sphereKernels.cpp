@@ -0,0 +1,268 @@
+#include <miquella/core/sphereKernels.h>
+#include <miquella/core/compiledScene.h>
+#include <miquella/core/cpuFeatures.h>
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#ifdef MQ_ARCH_X86_64
+#include <immintrin.h>
+#endif
+
+namespace miquella {
+
+namespace core {
+
+std::string to_string(SphereKernelISA isa)
+{
+    switch(isa)
+    {
+        case SphereKernelISA::SCALAR:   return "SCALAR";
+        case SphereKernelISA::AVX2:     return "AVX2";
+        case SphereKernelISA::AVX512:   return "AVX512";
+        case SphereKernelISA::AUTO:     return "AUTO";
+        default: return "";
+    }
+}
+
+bool intersectSpheresScalar(const SphereArray& spheres, uint32_t begin, uint32_t end, const Ray& r, float tmin, float tmax, uint32_t& index, float& t)
+{
+    const float a = glm::dot(r.m_dir, r.m_dir);
+    float bestT = tmax;
+    bool hitFound = false;
+    for(uint32_t i = begin; i < end; ++i)
+    {
+        glm::vec3 oc = r.m_orig - glm::vec3(spheres.m_centerX[i], spheres.m_centerY[i], spheres.m_centerZ[i]);
+        auto halfB = glm::dot(oc, r.m_dir);
+        auto c = glm::dot(oc, oc) - spheres.m_radius[i]*spheres.m_radius[i];
+
+        auto discriminant = halfB*halfB - a*c;
+        if (discriminant < 0) continue;
+        auto sqrtd = std::sqrt(discriminant);
+
+        // Find the nearest root that lies in the acceptable range.
+        auto root = (-halfB - sqrtd) / a;
+        if (root < tmin || bestT < root)
+        {
+            root = (-halfB + sqrtd) / a;
+            if (root < tmin || bestT < root)
+                continue;
+        }
+
+        // Keep the first sphere found at a given distance
+        if(hitFound && root >= bestT)
+            continue;
+
+        bestT = root;
+        index = i;
+        hitFound = true;
+    }
+    if(hitFound)
+        t = bestT;
+    return hitFound;
+}
+
+#ifdef MQ_ARCH_X86_64
+
+namespace
+{
+    // Closest hit among the per lane results, lowest index on ties. Lanes
+    // without hit hold a negative index.
+    bool reduceLanes(const float* lanesT, const int* lanesIndex, int nbLanes, uint32_t& index, float& t)
+    {
+        bool hitFound = false;
+        for(int lane = 0; lane < nbLanes; ++lane)
+        {
+            if(lanesIndex[lane] < 0)
+                continue;
+            auto laneIndex = static_cast<uint32_t>(lanesIndex[lane]);
+            if(!hitFound || lanesT[lane] < t || (lanesT[lane] == t && laneIndex < index))
+            {
+                t = lanesT[lane];
+                index = laneIndex;
+                hitFound = true;
+            }
+        }
+        return hitFound;
+    }
+
+    MQ_TARGET("avx2,fma")
+    bool intersectSpheresAVX2(const SphereArray& spheres, uint32_t begin, uint32_t end, const Ray& r, float tmin, float tmax, uint32_t& index, float& t)
+    {
+        const __m256 ox = _mm256_set1_ps(r.m_orig.x);
+        const __m256 oy = _mm256_set1_ps(r.m_orig.y);
+        const __m256 oz = _mm256_set1_ps(r.m_orig.z);
+        const __m256 dx = _mm256_set1_ps(r.m_dir.x);
+        const __m256 dy = _mm256_set1_ps(r.m_dir.y);
+        const __m256 dz = _mm256_set1_ps(r.m_dir.z);
+        const __m256 invA = _mm256_set1_ps(1.f / glm::dot(r.m_dir, r.m_dir));
+        const __m256 a = _mm256_set1_ps(glm::dot(r.m_dir, r.m_dir));
+        const __m256 vtmin = _mm256_set1_ps(tmin);
+        const __m256 inf = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+        const __m256i laneOffsets = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+        __m256 bestT = _mm256_set1_ps(tmax);
+        __m256i bestIndex = _mm256_set1_epi32(-1);
+
+        for(uint32_t i = begin; i < end; i += 8)
+        {
+            // Lanes past the end are loaded as zero and masked out of the result
+            uint32_t remaining = end - i;
+            __m256i loadMask = _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(std::min(remaining, 8u))), laneOffsets);
+
+            __m256 cx = _mm256_maskload_ps(&spheres.m_centerX[i], loadMask);
+            __m256 cy = _mm256_maskload_ps(&spheres.m_centerY[i], loadMask);
+            __m256 cz = _mm256_maskload_ps(&spheres.m_centerZ[i], loadMask);
+            __m256 radius = _mm256_maskload_ps(&spheres.m_radius[i], loadMask);
+
+            __m256 ocx = _mm256_sub_ps(ox, cx);
+            __m256 ocy = _mm256_sub_ps(oy, cy);
+            __m256 ocz = _mm256_sub_ps(oz, cz);
+
+            __m256 halfB = _mm256_fmadd_ps(ocx, dx, _mm256_fmadd_ps(ocy, dy, _mm256_mul_ps(ocz, dz)));
+            __m256 c = _mm256_fmsub_ps(ocx, ocx, _mm256_fmsub_ps(radius, radius, _mm256_fmadd_ps(ocy, ocy, _mm256_mul_ps(ocz, ocz))));
+            __m256 discriminant = _mm256_fmsub_ps(halfB, halfB, _mm256_mul_ps(a, c));
+            __m256 valid = _mm256_and_ps(_mm256_castsi256_ps(loadMask), _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ));
+            if(_mm256_testz_ps(valid, valid))
+                continue;
+
+            __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+            __m256 nearRoot = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(_mm256_setzero_ps(), halfB), sqrtd), invA);
+            __m256 farRoot = _mm256_mul_ps(_mm256_sub_ps(sqrtd, halfB), invA);
+
+            // Nearest root in range, the far root is only used if the near one is not
+            __m256 nearValid = _mm256_and_ps(_mm256_cmp_ps(nearRoot, vtmin, _CMP_GE_OQ), _mm256_cmp_ps(nearRoot, bestT, _CMP_LE_OQ));
+            __m256 farValid = _mm256_and_ps(_mm256_cmp_ps(farRoot, vtmin, _CMP_GE_OQ), _mm256_cmp_ps(farRoot, bestT, _CMP_LE_OQ));
+            __m256 root = _mm256_blendv_ps(_mm256_blendv_ps(inf, farRoot, farValid), nearRoot, nearValid);
+            valid = _mm256_and_ps(valid, _mm256_or_ps(nearValid, farValid));
+
+            // Strictly closer than the lane's best, or equal to tmax on a lane without hit yet
+            __m256 closer = _mm256_and_ps(valid, _mm256_cmp_ps(root, bestT, _CMP_LT_OQ));
+            closer = _mm256_or_ps(closer, _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(root, bestT, _CMP_EQ_OQ), _mm256_castsi256_ps(_mm256_cmpeq_epi32(bestIndex, _mm256_set1_epi32(-1))))));
+
+            bestT = _mm256_blendv_ps(bestT, root, closer);
+            __m256i indices = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(i)), laneOffsets);
+            bestIndex = _mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(bestIndex), _mm256_castsi256_ps(indices), closer));
+        }
+
+        alignas(32) float lanesT[8];
+        alignas(32) int lanesIndex[8];
+        _mm256_store_ps(lanesT, bestT);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanesIndex), bestIndex);
+
+        return reduceLanes(lanesT, lanesIndex, 8, index, t);
+    }
+
+    MQ_TARGET("avx512f")
+    bool intersectSpheresAVX512(const SphereArray& spheres, uint32_t begin, uint32_t end, const Ray& r, float tmin, float tmax, uint32_t& index, float& t)
+    {
+        const __m512 ox = _mm512_set1_ps(r.m_orig.x);
+        const __m512 oy = _mm512_set1_ps(r.m_orig.y);
+        const __m512 oz = _mm512_set1_ps(r.m_orig.z);
+        const __m512 dx = _mm512_set1_ps(r.m_dir.x);
+        const __m512 dy = _mm512_set1_ps(r.m_dir.y);
+        const __m512 dz = _mm512_set1_ps(r.m_dir.z);
+        const __m512 invA = _mm512_set1_ps(1.f / glm::dot(r.m_dir, r.m_dir));
+        const __m512 a = _mm512_set1_ps(glm::dot(r.m_dir, r.m_dir));
+        const __m512 vtmin = _mm512_set1_ps(tmin);
+        const __m512i laneOffsets = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+        __m512 bestT = _mm512_set1_ps(tmax);
+        __m512i bestIndex = _mm512_set1_epi32(-1);
+
+        for(uint32_t i = begin; i < end; i += 16)
+        {
+            uint32_t remaining = end - i;
+            __mmask16 loadMask = remaining >= 16 ? static_cast<__mmask16>(0xFFFF) : static_cast<__mmask16>((1u << remaining) - 1u);
+
+            __m512 cx = _mm512_maskz_loadu_ps(loadMask, &spheres.m_centerX[i]);
+            __m512 cy = _mm512_maskz_loadu_ps(loadMask, &spheres.m_centerY[i]);
+            __m512 cz = _mm512_maskz_loadu_ps(loadMask, &spheres.m_centerZ[i]);
+            __m512 radius = _mm512_maskz_loadu_ps(loadMask, &spheres.m_radius[i]);
+
+            __m512 ocx = _mm512_sub_ps(ox, cx);
+            __m512 ocy = _mm512_sub_ps(oy, cy);
+            __m512 ocz = _mm512_sub_ps(oz, cz);
+
+            __m512 halfB = _mm512_fmadd_ps(ocx, dx, _mm512_fmadd_ps(ocy, dy, _mm512_mul_ps(ocz, dz)));
+            __m512 c = _mm512_fmsub_ps(ocx, ocx, _mm512_fmsub_ps(radius, radius, _mm512_fmadd_ps(ocy, ocy, _mm512_mul_ps(ocz, ocz))));
+            __m512 discriminant = _mm512_fmsub_ps(halfB, halfB, _mm512_mul_ps(a, c));
+            __mmask16 valid = _mm512_mask_cmp_ps_mask(loadMask, discriminant, _mm512_setzero_ps(), _CMP_GE_OQ);
+            if(valid == 0)
+                continue;
+
+            __m512 sqrtd = _mm512_maskz_sqrt_ps(valid, discriminant);
+            __m512 nearRoot = _mm512_mul_ps(_mm512_sub_ps(_mm512_sub_ps(_mm512_setzero_ps(), halfB), sqrtd), invA);
+            __m512 farRoot = _mm512_mul_ps(_mm512_sub_ps(sqrtd, halfB), invA);
+
+            __mmask16 nearValid = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(nearRoot, vtmin, _CMP_GE_OQ), nearRoot, bestT, _CMP_LE_OQ);
+            __mmask16 farValid = _mm512_mask_cmp_ps_mask(_mm512_cmp_ps_mask(farRoot, vtmin, _CMP_GE_OQ), farRoot, bestT, _CMP_LE_OQ);
+            __m512 root = _mm512_mask_blend_ps(nearValid, farRoot, nearRoot);
+            __mmask16 accepted = valid & (nearValid | farValid);
+
+            // Strictly closer than the lane's best, or equal to tmax on a lane without hit yet
+            __mmask16 closer = _mm512_mask_cmp_ps_mask(accepted, root, bestT, _CMP_LT_OQ);
+            __mmask16 firstHit = _mm512_mask_cmpeq_epi32_mask(accepted, bestIndex, _mm512_set1_epi32(-1));
+            closer = _mm512_kor(closer, _mm512_mask_cmp_ps_mask(firstHit, root, bestT, _CMP_EQ_OQ));
+
+            bestT = _mm512_mask_blend_ps(closer, bestT, root);
+            __m512i indices = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(i)), laneOffsets);
+            bestIndex = _mm512_mask_blend_epi32(closer, bestIndex, indices);
+        }
+
+        alignas(64) float lanesT[16];
+        alignas(64) int lanesIndex[16];
+        _mm512_store_ps(lanesT, bestT);
+        _mm512_store_si512(lanesIndex, bestIndex);
+
+        return reduceLanes(lanesT, lanesIndex, 16, index, t);
+    }
+}
+
+#endif
+
+SphereKernelISA resolveSphereKernelISA(SphereKernelISA isa)
+{
+#ifdef MQ_ARCH_X86_64
+    const auto& features = cpuFeatures();
+    bool hasAVX2 = features.avx2 && features.fma;
+    bool hasAVX512 = features.avx512f;
+
+    if(isa == SphereKernelISA::AUTO)
+        return hasAVX512 ? SphereKernelISA::AVX512 : (hasAVX2 ? SphereKernelISA::AVX2 : SphereKernelISA::SCALAR);
+    if(isa == SphereKernelISA::AVX512 && hasAVX512)
+        return SphereKernelISA::AVX512;
+    if(isa == SphereKernelISA::AVX2 && hasAVX2)
+        return SphereKernelISA::AVX2;
+#else
+    (void)isa;
+#endif
+    return SphereKernelISA::SCALAR;
+}
+
+uint32_t getSphereKernelWidth(SphereKernelISA isa)
+{
+    switch(resolveSphereKernelISA(isa))
+    {
+        case SphereKernelISA::AVX2:     return 8;
+        case SphereKernelISA::AVX512:   return 16;
+        default: return 1;
+    }
+}
+
+SphereKernel getSphereKernel(SphereKernelISA isa)
+{
+    switch(resolveSphereKernelISA(isa))
+    {
+#ifdef MQ_ARCH_X86_64
+        case SphereKernelISA::AVX2:     return intersectSpheresAVX2;
+        case SphereKernelISA::AVX512:   return intersectSpheresAVX512;
+#endif
+        default: return intersectSpheresScalar;
+    }
+}
+
+} // core
+
+} // miquella
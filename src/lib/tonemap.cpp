@@ -0,0 +1,162 @@
+#include <miquella/core/tonemap.h>
+#include <miquella/core/cpuFeatures.h>
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef MQ_ARCH_X86_64
+#include <immintrin.h>
+#endif
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    // Largest displayed value, keeps the quantized value below 256
+    const float maxDisplayValue = 0.999f;
+
+    inline unsigned char quantize(float value)
+    {
+        return static_cast<unsigned char>(static_cast<int>(256.f * std::min(std::sqrt(std::max(value, 0.f)), maxDisplayValue)));
+    }
+
+#ifdef MQ_ARCH_X86_64
+
+    // One pixel in the 4 lanes (r, g, b, unused) of v, divided by the number
+    // of samples n, converted to 0-255 integers with 255 in the unused lane
+    MQ_TARGET("sse4.1") inline __m128i quantizePixelSSE41(__m128 v, __m128 n)
+    {
+        v = _mm_div_ps(v, n);
+        v = _mm_min_ps(_mm_sqrt_ps(_mm_max_ps(v, _mm_setzero_ps())), _mm_set1_ps(maxDisplayValue));
+        __m128i quantized = _mm_cvttps_epi32(_mm_mul_ps(v, _mm_set1_ps(256.f)));
+        return _mm_blend_epi16(quantized, _mm_set1_epi32(255), 0xC0);
+    }
+
+    MQ_TARGET("sse4.1") void tonemapSSE41(const glm::vec3* accumulated, const uint32_t* samples, size_t count, unsigned char* rgba)
+    {
+        const auto* radiance = reinterpret_cast<const float*>(accumulated);
+        size_t i = 0;
+
+        // Each pixel is loaded with the red of the next one, the last pixel
+        // is left to the scalar loop so that the loads stay in the buffer
+        for(; i + 5 <= count; i += 4)
+        {
+            __m128i nbSamples = _mm_max_epu32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(samples + i)), _mm_set1_epi32(1));
+            __m128 n = _mm_cvtepi32_ps(nbSamples);
+
+            __m128i p0 = quantizePixelSSE41(_mm_loadu_ps(radiance + 3*i), _mm_shuffle_ps(n, n, _MM_SHUFFLE(0, 0, 0, 0)));
+            __m128i p1 = quantizePixelSSE41(_mm_loadu_ps(radiance + 3*i + 3), _mm_shuffle_ps(n, n, _MM_SHUFFLE(1, 1, 1, 1)));
+            __m128i p2 = quantizePixelSSE41(_mm_loadu_ps(radiance + 3*i + 6), _mm_shuffle_ps(n, n, _MM_SHUFFLE(2, 2, 2, 2)));
+            __m128i p3 = quantizePixelSSE41(_mm_loadu_ps(radiance + 3*i + 9), _mm_shuffle_ps(n, n, _MM_SHUFFLE(3, 3, 3, 3)));
+
+            // 32 to 16 to 8 bits, the values are already in [0, 255]
+            __m128i packed = _mm_packus_epi16(_mm_packus_epi32(p0, p1), _mm_packus_epi32(p2, p3));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(rgba + 4*i), packed);
+        }
+
+        tonemapScalar(accumulated + i, samples + i, count - i, rgba + 4*i);
+    }
+
+    // Two pixels per register, one per 128 bits lane
+    MQ_TARGET("avx2,fma") inline __m256i quantizePixelsAVX2(const float* radiance, __m256 n)
+    {
+        __m256 v = _mm256_set_m128(_mm_loadu_ps(radiance + 3), _mm_loadu_ps(radiance));
+        v = _mm256_div_ps(v, n);
+        v = _mm256_min_ps(_mm256_sqrt_ps(_mm256_max_ps(v, _mm256_setzero_ps())), _mm256_set1_ps(maxDisplayValue));
+        __m256i quantized = _mm256_cvttps_epi32(_mm256_mul_ps(v, _mm256_set1_ps(256.f)));
+        return _mm256_blend_epi32(quantized, _mm256_set1_epi32(255), 0x88);
+    }
+
+    MQ_TARGET("avx2,fma") void tonemapAVX2(const glm::vec3* accumulated, const uint32_t* samples, size_t count, unsigned char* rgba)
+    {
+        const auto* radiance = reinterpret_cast<const float*>(accumulated);
+        const __m256i pair0 = _mm256_setr_epi32(0, 0, 0, 0, 1, 1, 1, 1);
+        const __m256i pair1 = _mm256_setr_epi32(2, 2, 2, 2, 3, 3, 3, 3);
+        const __m256i pair2 = _mm256_setr_epi32(4, 4, 4, 4, 5, 5, 5, 5);
+        const __m256i pair3 = _mm256_setr_epi32(6, 6, 6, 6, 7, 7, 7, 7);
+        const __m256i pixelOrder = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+        size_t i = 0;
+        for(; i + 9 <= count; i += 8)
+        {
+            __m256i nbSamples = _mm256_max_epu32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(samples + i)), _mm256_set1_epi32(1));
+            __m256 n = _mm256_cvtepi32_ps(nbSamples);
+
+            const float* pixels = radiance + 3*i;
+            __m256i p01 = quantizePixelsAVX2(pixels, _mm256_permutevar8x32_ps(n, pair0));
+            __m256i p23 = quantizePixelsAVX2(pixels + 6, _mm256_permutevar8x32_ps(n, pair1));
+            __m256i p45 = quantizePixelsAVX2(pixels + 12, _mm256_permutevar8x32_ps(n, pair2));
+            __m256i p67 = quantizePixelsAVX2(pixels + 18, _mm256_permutevar8x32_ps(n, pair3));
+
+            // The packs work within each 128 bits lane: the pixels come out
+            // as 0 2 4 6 | 1 3 5 7 and are put back in order
+            __m256i packed = _mm256_packus_epi16(_mm256_packus_epi32(p01, p23), _mm256_packus_epi32(p45, p67));
+            packed = _mm256_permutevar8x32_epi32(packed, pixelOrder);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(rgba + 4*i), packed);
+        }
+
+        tonemapScalar(accumulated + i, samples + i, count - i, rgba + 4*i);
+    }
+
+#endif
+}
+
+std::string to_string(TonemapISA isa)
+{
+    switch(isa)
+    {
+        case TonemapISA::SCALAR:    return "SCALAR";
+        case TonemapISA::SSE41:     return "SSE41";
+        case TonemapISA::AVX2:      return "AVX2";
+        case TonemapISA::AUTO:      return "AUTO";
+        default: return "";
+    }
+}
+
+void tonemapScalar(const glm::vec3* accumulated, const uint32_t* samples, size_t count, unsigned char* rgba)
+{
+    for(size_t i = 0; i < count; ++i)
+    {
+        auto n = static_cast<float>(std::max(samples[i], 1u));
+        rgba[4*i] = quantize(accumulated[i].x / n);
+        rgba[4*i+1] = quantize(accumulated[i].y / n);
+        rgba[4*i+2] = quantize(accumulated[i].z / n);
+        rgba[4*i+3] = static_cast<unsigned char>(255);
+    }
+}
+
+TonemapISA resolveTonemapISA(TonemapISA isa)
+{
+#ifdef MQ_ARCH_X86_64
+    const auto& features = cpuFeatures();
+    bool hasAVX2 = features.avx2 && features.fma;
+    bool hasSSE41 = features.sse41;
+
+    if(isa == TonemapISA::AUTO)
+        return hasAVX2 ? TonemapISA::AVX2 : (hasSSE41 ? TonemapISA::SSE41 : TonemapISA::SCALAR);
+    if(isa == TonemapISA::AVX2 && hasAVX2)
+        return TonemapISA::AVX2;
+    if(isa == TonemapISA::SSE41 && hasSSE41)
+        return TonemapISA::SSE41;
+#else
+    (void)isa;
+#endif
+    return TonemapISA::SCALAR;
+}
+
+TonemapKernel getTonemapKernel(TonemapISA isa)
+{
+    switch(resolveTonemapISA(isa))
+    {
+#ifdef MQ_ARCH_X86_64
+        case TonemapISA::SSE41:     return tonemapSSE41;
+        case TonemapISA::AVX2:      return tonemapAVX2;
+#endif
+        default: return tonemapScalar;
+    }
+}
+
+} // core
+
+} // miquella
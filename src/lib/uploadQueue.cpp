@@ -0,0 +1,93 @@
+#include <miquella/http/uploadQueue.h>
+
+#include <chrono>
+
+namespace miquella 
+{
+
+namespace http 
+{
+
+UploadQueue::UploadQueue(size_t maxPending) : m_maxPending(maxPending)
+{
+    if(m_maxPending > 0)
+        m_thread = std::thread([this]{ _run(); });
+}
+
+UploadQueue::~UploadQueue()
+{
+    finish();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_changed.notify_all();
+    if(m_thread.joinable())
+        m_thread.join();
+}
+
+void UploadQueue::push(Upload upload)
+{
+    if(!m_running)
+        return;
+
+    if(m_maxPending == 0)
+    {
+        if(!upload())
+            m_running = false;
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_changed.wait(lock, [this]{ return m_pending.size() < m_maxPending || !m_running; });
+        if(m_running)
+            m_pending.push_back(std::move(upload));
+    }
+    m_changed.notify_all();
+    m_waitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void UploadQueue::finish()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_changed.wait(lock, [this]{ return m_pending.empty() && !m_uploading; });
+}
+
+void UploadQueue::_run()
+{
+    while(true)
+    {
+        Upload upload;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_changed.wait(lock, [this]{ return !m_pending.empty() || m_stop; });
+            if(m_pending.empty())
+                return;
+
+            upload = std::move(m_pending.front());
+            m_pending.pop_front();
+            m_uploading = true;
+        }
+        m_changed.notify_all();
+
+        // The reply of the controller is only known here, once it says to
+        // stop the next snapshots are not sent
+        bool keepRunning = m_running && upload();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_uploading = false;
+            if(!keepRunning)
+            {
+                m_running = false;
+                m_pending.clear();
+            }
+        }
+        m_changed.notify_all();
+    }
+}
+
+} // http
+
+} // miquella
@@ -0,0 +1,178 @@
+#include <miquella/core/wideBvh.h>
+#include <miquella/core/cpuFeatures.h>
+
+#ifdef MQ_ARCH_X86_64
+#include <immintrin.h>
+#endif
+
+namespace miquella {
+
+namespace core {
+
+namespace
+{
+    // Portable version of the node test, used when no vector unit is available
+    template<uint32_t W>
+    uint32_t intersectWideNodeScalar(const WideBVHNode<W>& node, const WideRay& ray, float tmin, float tmax, float* tEntry)
+    {
+        uint32_t mask = 0;
+        for(uint32_t c = 0; c < W; ++c)
+        {
+            float tNear = tmin;
+            float tFar = tmax;
+            for(uint32_t a = 0; a < 3; ++a)
+            {
+                tNear = std::max(tNear, node.m_bounds[ray.m_nearRow[a]][c] * ray.m_invDir[a] - ray.m_originScaled[a]);
+                tFar = std::min(tFar, node.m_bounds[ray.m_farRow[a]][c] * ray.m_invDir[a] - ray.m_originScaled[a]);
+            }
+            tEntry[c] = tNear;
+            if(tNear <= tFar)
+                mask |= 1u << c;
+        }
+        return mask;
+    }
+
+#ifdef MQ_ARCH_X86_64
+    MQ_TARGET("avx2,fma")
+    uint32_t intersectWideNode8AVX2(const WideBVHNode<8>& node, const WideRay& ray, float tmin, float tmax, float* tEntry)
+    {
+        __m256 tNear = _mm256_set1_ps(tmin);
+        __m256 tFar = _mm256_set1_ps(tmax);
+        for(uint32_t a = 0; a < 3; ++a)
+        {
+            const __m256 invDir = _mm256_set1_ps(ray.m_invDir[a]);
+            const __m256 originScaled = _mm256_set1_ps(ray.m_originScaled[a]);
+            const __m256 nearPlane = _mm256_load_ps(node.m_bounds[ray.m_nearRow[a]]);
+            const __m256 farPlane = _mm256_load_ps(node.m_bounds[ray.m_farRow[a]]);
+            tNear = _mm256_max_ps(tNear, _mm256_fmsub_ps(nearPlane, invDir, originScaled));
+            tFar = _mm256_min_ps(tFar, _mm256_fmsub_ps(farPlane, invDir, originScaled));
+        }
+        _mm256_store_ps(tEntry, tNear);
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ)));
+    }
+#endif
+}
+
+uint32_t intersectWideNode4(const WideBVHNode<4>& node, const WideRay& ray, float tmin, float tmax, float* tEntry)
+{
+#ifdef MQ_ARCH_X86_64
+    // SSE is part of the x86-64 baseline, no runtime check required
+    __m128 tNear = _mm_set1_ps(tmin);
+    __m128 tFar = _mm_set1_ps(tmax);
+    for(uint32_t a = 0; a < 3; ++a)
+    {
+        const __m128 invDir = _mm_set1_ps(ray.m_invDir[a]);
+        const __m128 originScaled = _mm_set1_ps(ray.m_originScaled[a]);
+        const __m128 nearPlane = _mm_load_ps(node.m_bounds[ray.m_nearRow[a]]);
+        const __m128 farPlane = _mm_load_ps(node.m_bounds[ray.m_farRow[a]]);
+        tNear = _mm_max_ps(tNear, _mm_sub_ps(_mm_mul_ps(nearPlane, invDir), originScaled));
+        tFar = _mm_min_ps(tFar, _mm_sub_ps(_mm_mul_ps(farPlane, invDir), originScaled));
+    }
+    _mm_store_ps(tEntry, tNear);
+    return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(tNear, tFar)));
+#else
+    return intersectWideNodeScalar<4>(node, ray, tmin, tmax, tEntry);
+#endif
+}
+
+uint32_t intersectWideNode8(const WideBVHNode<8>& node, const WideRay& ray, float tmin, float tmax, float* tEntry)
+{
+#ifdef MQ_ARCH_X86_64
+    if(cpuFeatures().avx2 && cpuFeatures().fma)
+        return intersectWideNode8AVX2(node, ray, tmin, tmax, tEntry);
+#endif
+    return intersectWideNodeScalar<8>(node, ray, tmin, tmax, tEntry);
+}
+
+void WideBVH::build(const BVH& bvh, uint32_t width)
+{
+    clear();
+
+    if(width == 0)
+        width = cpuFeatures().avx2 && cpuFeatures().fma ? 8 : 4;
+    m_width = width == 8 ? 8 : 4;
+
+    if(bvh.isEmpty())
+        return;
+
+    m_primitiveIndices = bvh.m_primitiveIndices;
+    if(m_width == 8)
+    {
+        m_nodes8.reserve(bvh.m_nodes.size() / 4 + 1);
+        _collapse<8>(bvh, 0, m_nodes8);
+    }
+    else
+    {
+        m_nodes4.reserve(bvh.m_nodes.size() / 2 + 1);
+        _collapse<4>(bvh, 0, m_nodes4);
+    }
+}
+
+template<uint32_t W>
+uint32_t WideBVH::_collapse(const BVH& bvh, uint32_t binaryIndex, std::vector<WideBVHNode<W>>& nodes)
+{
+    // Gather up to W descendants of the binary node by repeatedly opening the
+    // interior node with the largest surface area.
+    uint32_t children[W];
+    uint32_t nbChildren = 1;
+    children[0] = binaryIndex;
+
+    while(nbChildren < W)
+    {
+        int largest = -1;
+        float largestArea = -1.f;
+        for(uint32_t c = 0; c < nbChildren; ++c)
+        {
+            const BVHNode& candidate = bvh.m_nodes[children[c]];
+            if(!candidate.isLeaf() && candidate.m_box.surfaceArea() > largestArea)
+            {
+                largestArea = candidate.m_box.surfaceArea();
+                largest = static_cast<int>(c);
+            }
+        }
+        if(largest < 0)
+            break;
+
+        uint32_t opened = children[largest];
+        children[largest] = opened + 1;
+        children[nbChildren++] = bvh.m_nodes[opened].m_offset;
+    }
+
+    uint32_t nodeIndex = static_cast<uint32_t>(nodes.size());
+    nodes.emplace_back();
+
+    const AABB empty;
+    for(uint32_t c = 0; c < W; ++c)
+    {
+        const AABB& box = c < nbChildren ? bvh.m_nodes[children[c]].m_box : empty;
+        for(int a = 0; a < 3; ++a)
+        {
+            nodes[nodeIndex].m_bounds[a][c] = box.m_min[a];
+            nodes[nodeIndex].m_bounds[a + 3][c] = box.m_max[a];
+        }
+        nodes[nodeIndex].m_child[c] = 0;
+        nodes[nodeIndex].m_count[c] = 0;
+    }
+
+    for(uint32_t c = 0; c < nbChildren; ++c)
+    {
+        const BVHNode& child = bvh.m_nodes[children[c]];
+        if(child.isLeaf())
+        {
+            nodes[nodeIndex].m_child[c] = child.m_offset;
+            nodes[nodeIndex].m_count[c] = child.m_count;
+        }
+        else
+        {
+            // nodes may be reallocated by the recursion, do not keep references
+            uint32_t childIndex = _collapse<W>(bvh, children[c], nodes);
+            nodes[nodeIndex].m_child[c] = childIndex;
+        }
+    }
+
+    return nodeIndex;
+}
+
+} // core
+
+} // miquella
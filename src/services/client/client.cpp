@@ -82,13 +82,13 @@ struct JobSatus
 
 };
 
-std::string submitRenderingRequest(const std::string& server,
-                            int port,
+std::string submitRenderingRequest(miquella::http::ControllerClient& controller,
                             miquella::core::SceneID sceneID,
                             int nSamples,
-                            int freqOutput)
+                            int freqOutput,
+                            float noiseThreshold)
 {
-    auto [statusCode, text] = miquella::http::submitJob(server, port, sceneID, nSamples, freqOutput);
+    auto [statusCode, text] = controller.submitJob(sceneID, nSamples, freqOutput, noiseThreshold);
 
     if (statusCode != 200)
     {
@@ -102,11 +102,10 @@ std::string submitRenderingRequest(const std::string& server,
     }
 }
 
-std::tuple<std::string, int, std::string> lastSampleRequest(const std::string& server,
-                            int port,
+std::tuple<std::string, int, std::string> lastSampleRequest(miquella::http::ControllerClient& controller,
                             const std::string& jobID)
 {
-    auto [statusCode, text] = miquella::http::requestLastLocalSample(server, port, jobID);
+    auto [statusCode, text] = controller.requestLastLocalSample(jobID);
 
     if (statusCode != 200)
     {
@@ -136,11 +135,10 @@ std::tuple<std::string, int, std::string> lastSampleRequest(const std::string& s
     }
 }
 
-std::tuple<std::string, int, std::string> lastRemoteSampleRequest(const std::string& server,
-                            int port,
+std::tuple<std::string, int, std::string> lastRemoteSampleRequest(miquella::http::ControllerClient& controller,
                             const std::string& jobID)
 {
-    auto [statusCode, text, header] = miquella::http::requestLastRemoteSample(server, port, jobID);
+    auto [statusCode, text, header] = controller.requestLastRemoteSample(jobID);
 
     if (statusCode != 200)
     {
@@ -165,10 +163,10 @@ std::tuple<std::string, int, std::string> lastRemoteSampleRequest(const std::str
     
 }
 
-bool fullListOfJobsRequest(const std::string& server, int port, std::vector<JobSatus>& jobList)
+// Reply of ControllerClient::requestListJobs()
+bool parseListOfJobs(const miquella::http::ControllerClient::Reply& reply, std::vector<JobSatus>& jobList)
 {
-    // Create an HTTP request.
-    auto [statusCode, text] = miquella::http::requestListJobs(server, port);
+    const auto& [statusCode, text] = reply;
 
     if (statusCode != 200)
     {
@@ -187,9 +185,9 @@ bool fullListOfJobsRequest(const std::string& server, int port, std::vector<JobS
     return true;
 }
 
-bool cancelJobRequest(const std::string& server, int port, const std::string& jobID)
+bool cancelJobRequest(miquella::http::ControllerClient& controller, const std::string& jobID)
 {
-    auto [statusCode, text] = miquella::http::requestCancelJob(server, port, jobID);
+    auto [statusCode, text] = controller.requestCancelJob(jobID);
 
     if (statusCode != 200)
     {
@@ -211,10 +209,10 @@ bool cancelJobRequest(const std::string& server, int port, const std::string& jo
     }
 }
 
-bool removeJobRequest(const std::string& server, int port, std::string& jobID)
+bool removeJobRequest(miquella::http::ControllerClient& controller, std::string& jobID)
 {
     // Create an HTTP request.
-    auto [statusCode, text] = miquella::http::requestRemoveJob(server, port, jobID);
+    auto [statusCode, text] = controller.requestRemoveJob(jobID);
 
     if (statusCode != 200)
     {
@@ -371,8 +369,10 @@ int main(int argc, char** argv)
     bool ret = false;
     int maxSamples = 1000;
     int freqOutput = 50;
+    float noiseThreshold = 0.f;
     std::string serverURL = "http://localhost";
     int port = 8000;
+    miquella::http::ControllerClient controller(serverURL, port);
     std::string jobID;
     int lastSample = 0;
     bool autoRetrieve = false;
@@ -383,6 +383,7 @@ int main(int argc, char** argv)
     bool remote = true;
 
     std::vector<JobSatus> jobs;
+    std::future<miquella::http::ControllerClient::Reply> jobListReply;
     std::vector<std::string> sceneNames;
     for(uint8_t i = 0; i < static_cast<uint8_t>(miquella::core::SceneID::MAX_NB_SCENE); ++i )
         sceneNames.push_back(miquella::core::to_string(miquella::core::SceneID(i)));
@@ -483,7 +484,7 @@ int main(int argc, char** argv)
                         std::string buttonLabel = "Cancel##cancelid" + std::to_string(i);
                         if (ImGui::Button(buttonLabel.c_str()))
                         {
-                            auto check = cancelJobRequest(serverURL, port, jobs[i].jobID);
+                            auto check = cancelJobRequest(controller, jobs[i].jobID);
 
                             // Cancel as well the auto retrieve if it was the same jobID
                             // Doing it here so that it does't require to parse the job table 
@@ -500,7 +501,7 @@ int main(int argc, char** argv)
                         std::string buttonLabel = "Remove##removeid" + std::to_string(i);
                         if (ImGui::Button(buttonLabel.c_str()))
                         {
-                            auto check = removeJobRequest(serverURL, port, jobs[i].jobID);
+                            auto check = removeJobRequest(controller, jobs[i].jobID);
 
                             // Cancel as well the auto retrieve if it was the same jobID
                             // Doing it here so that it does't require to parse the job table 
@@ -562,6 +563,15 @@ int main(int argc, char** argv)
                 ImGui::PopItemWidth();
             }
 
+            // Noise threshold, the job stops before the total number of samples once reached
+            {
+                ImGui::Text("Noise threshold (0: off)");
+                ImGui::SameLine();
+                ImGui::PushItemWidth(-1); // so we dont have a label
+                ret |= ImGui::InputFloat("threshold",  &noiseThreshold, 0.001f, 0.01f, "%.4f");
+                ImGui::PopItemWidth();
+            }
+
             // Server
             {
                 ImGui::Text("Server adress");
@@ -578,15 +588,16 @@ int main(int argc, char** argv)
                 ImGui::PushItemWidth(-1); // so we dont have a label
                 ret |= ImGui::InputInt("port",  &port);
                 ImGui::PopItemWidth();
+                controller.setController(serverURL, port);
             }
 
             if (ImGui::Button("Submit"))
             {
-                jobID = submitRenderingRequest(serverURL,
-                            port,
+                jobID = submitRenderingRequest(controller,
                             miquella::core::SceneID(sceneIDInt),
                             maxSamples,
-                            freqOutput);
+                            freqOutput,
+                            noiseThreshold);
             }
 
             // Job ID info
@@ -621,7 +632,7 @@ int main(int argc, char** argv)
             {
                 if(remote)
                 {
-                    auto [ content, sample, status ] = lastRemoteSampleRequest(serverURL, port, jobID);
+                    auto [ content, sample, status ] = lastRemoteSampleRequest(controller, jobID);
                     lastSample = sample;
                     jobStatus = status;
                     if(sample > 0)
@@ -633,7 +644,7 @@ int main(int argc, char** argv)
                 }
                 else 
                 {
-                    auto [ filePath, sample, status ] = lastSampleRequest(serverURL, port, jobID);
+                    auto [ filePath, sample, status ] = lastSampleRequest(controller, jobID);
                     lastSample = sample;
                     jobStatus = status;
                     if(filePath.size() > 0)
@@ -666,7 +677,7 @@ int main(int argc, char** argv)
             {
                 if(remote)
                 {
-                    auto [ content, sample, status ] = lastRemoteSampleRequest(serverURL, port, jobID);
+                    auto [ content, sample, status ] = lastRemoteSampleRequest(controller, jobID);
                     lastSample = sample;
                     jobStatus = status;
                     if(sample > 0)
@@ -678,7 +689,7 @@ int main(int argc, char** argv)
                 }
                 else
                 {
-                    auto [ filePath, sample, status ] = lastSampleRequest(serverURL, port, jobID);
+                    auto [ filePath, sample, status ] = lastSampleRequest(controller, jobID);
                     lastSample = sample;
                     jobStatus = status;
 
@@ -702,13 +713,16 @@ int main(int argc, char** argv)
             }
         }
 
-        // Retrieve the job list
+        // Retrieve the job list. The request runs in the background, the
+        // list is updated on the first frame after the reply arrives.
         auto now = std::chrono::system_clock::now();
         auto timeElapsed = std::chrono::duration<double>(now - lastJoblistRetrieve);
-        if(timeElapsed.count() > static_cast<double>(refreshRate))
+        if(!jobListReply.valid() && timeElapsed.count() > static_cast<double>(refreshRate))
+            jobListReply = controller.requestListJobsAsync();
+        if(jobListReply.valid() && jobListReply.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
         {
             jobs.clear();
-            if(fullListOfJobsRequest(serverURL, port, jobs))
+            if(parseListOfJobs(jobListReply.get(), jobs))
             {
                 spdlog::debug("Received a list of {} jobs.", jobs.size());
             }
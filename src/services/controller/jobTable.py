@@ -1,4 +1,4 @@
-from typing import List
+from typing import List, Optional
 from sqlalchemy import String, create_engine, PickleType, select, update
 from sqlalchemy.orm import DeclarativeBase, Mapped, mapped_column, Session 
 from sqlalchemy.ext.mutable import MutableList
@@ -17,8 +17,17 @@ class Job(Base):
     sceneID: Mapped[int]
     nSamples: Mapped[int]
     freqOutout: Mapped[int]
+    # Optional rendering settings, None lets the server use its command line value
+    maxDepth: Mapped[Optional[int]]
+    russianRoulette: Mapped[Optional[bool]]
+    sampler: Mapped[Optional[int]]
+    nextEventEstimation: Mapped[Optional[bool]]
+    noiseThreshold: Mapped[Optional[float]]
+    denoise: Mapped[Optional[bool]]
+    aovs: Mapped[Optional[str]]
     samples: Mapped[list[int]] = mapped_column(MutableList.as_mutable(PickleType))
     images:Mapped[list[str]] = mapped_column(MutableList.as_mutable(PickleType))
+    noiseLevels:Mapped[list[float]] = mapped_column(MutableList.as_mutable(PickleType))
     status: Mapped[str]
 
     def __repr__(self) -> str:
@@ -31,6 +40,19 @@ class Job(Base):
         result["nSamples"] = self.nSamples
         result["freqOutput"] = self.freqOutout
 
+        # Only the settings given with the job are sent
+        optionalSettings = {
+            "maxDepth": self.maxDepth,
+            "russianRoulette": self.russianRoulette,
+            "sampler": self.sampler,
+            "nextEventEstimation": self.nextEventEstimation,
+            "noiseThreshold": self.noiseThreshold,
+            "denoise": self.denoise,
+            "aovs": self.aovs}
+        for name, value in optionalSettings.items():
+            if value is not None:
+                result[name] = value
+
         return result
 
     def toJobStatusDict(self) -> dict:
@@ -39,12 +61,15 @@ class Job(Base):
         result["sceneID"] = self.sceneID
         result["nSamples"] = self.nSamples
         result["freqOutput"] = self.freqOutout
+        result["noiseThreshold"] = self.noiseThreshold
         if len(self.samples) == 0:
             result["lastSample"] = 0
             result["lastImage"] = ""
+            result["lastNoiseLevel"] = -1.0
         else:
             result["lastSample"] = self.samples[-1]
             result["lastImage"] = self.images[-1]
+            result["lastNoiseLevel"] = self.noiseLevels[-1]
         result["status"] = self.status
 
         return result
@@ -64,14 +89,22 @@ class JobDatabase:
         # Open a session which will stay open as long as the oject stays alive
         self.session = Session(self.engine)
 
-    def addJob(self, sceneID:int=3, nSamples:int=1000, freqOutput:int=50) -> str:
+    def addJob(self, sceneID:int=3, nSamples:int=1000, freqOutput:int=50, maxDepth:Optional[int]=None, russianRoulette:Optional[bool]=None, sampler:Optional[int]=None, nextEventEstimation:Optional[bool]=None, noiseThreshold:Optional[float]=None, denoise:Optional[bool]=None, aovs:Optional[str]=None) -> str:
         newJob = Job()
         newJob.jobID = str(uuid.uuid4())
         newJob.sceneID = sceneID
         newJob.nSamples = nSamples
         newJob.freqOutout = freqOutput
+        newJob.maxDepth = maxDepth
+        newJob.russianRoulette = russianRoulette
+        newJob.sampler = sampler
+        newJob.nextEventEstimation = nextEventEstimation
+        newJob.noiseThreshold = noiseThreshold
+        newJob.denoise = denoise
+        newJob.aovs = aovs
         newJob.samples = []
         newJob.images = []
+        newJob.noiseLevels = []
         newJob.status = "PENDING"
         self.session.add_all([newJob])
         self.session.commit()
@@ -96,7 +129,7 @@ class JobDatabase:
             # Sending the job to the server
             return firstJob[0].toJobRequestDict()
         
-    def addSampleToJob(self, jobID:str, filePath:str, lastSample:int) -> dict:
+    def addSampleToJob(self, jobID:str, filePath:str, lastSample:int, noiseLevel:float=-1.0, completed:bool=False) -> dict:
         # Select the job
         stmt = select(Job).where(Job.jobID == jobID)
         jobs = self.session.execute(stmt)
@@ -113,8 +146,10 @@ class JobDatabase:
         
         firstJob[0].samples.append(lastSample)
         firstJob[0].images.append(filePath)
+        firstJob[0].noiseLevels.append(noiseLevel)
 
-        if lastSample == firstJob[0].nSamples:
+        # A job with a noise threshold can complete before nSamples
+        if completed or lastSample == firstJob[0].nSamples:
             firstJob[0].status = "COMPLETED"
         self.session.commit()
 
@@ -201,6 +236,7 @@ class JobDatabase:
             result = {
                 "lastSample" : firstJob[0].samples[-1],
                 "image" : firstJob[0].images[-1],
+                "noiseLevel" : firstJob[0].noiseLevels[-1],
                 "status" : firstJob[0].status
             }
         return result
@@ -10,6 +10,7 @@ from jobTable import JobDatabase
 
 import uvicorn
 import os
+from typing import Optional
 
 ################################ DATABASE ###################################
 database = JobDatabase(databasePath="sqlite://", echo=False, createDatabase=True)
@@ -28,13 +29,14 @@ SAMPLE_FOLDER = os.path.join(CONTROLLER_FOLDER, "samples")
 
 
 @app.post("/submitJob")
-async def create_rendering_job(sceneID : int = 3, nSamples : int = 1000, freqOutput : int = 50):
+async def create_rendering_job(sceneID : int = 3, nSamples : int = 1000, freqOutput : int = 50, maxDepth : Optional[int] = None, russianRoulette : Optional[bool] = None, sampler : Optional[int] = None, nextEventEstimation : Optional[bool] = None, noiseThreshold : Optional[float] = None, denoise : Optional[bool] = None, aovs : Optional[str] = None):
     '''
-        Send a query to perform a rendering task.
+        Send a query to perform a rendering task. The rendering settings
+        left out are chosen by the server which renders the job.
     '''
     
     # Add the job to the databse
-    jobID = database.addJob(sceneID=sceneID, nSamples=nSamples, freqOutput=freqOutput)
+    jobID = database.addJob(sceneID=sceneID, nSamples=nSamples, freqOutput=freqOutput, maxDepth=maxDepth, russianRoulette=russianRoulette, sampler=sampler, nextEventEstimation=nextEventEstimation, noiseThreshold=noiseThreshold, denoise=denoise, aovs=aovs)
 
     return Response(content=jobID, media_type="text/html")
 
@@ -49,12 +51,12 @@ async def provision_job():
 
 
 @app.post("/updateLocalJobExec")
-async def updateLocalJobExec(jobID : str, filePath : str, lastSample : int):
+async def updateLocalJobExec(jobID : str, filePath : str, lastSample : int, noiseLevel : float = -1.0, completed : bool = False):
     '''
         Update the runningJobDB with the last output done by a worker.
     '''
 
-    result = database.addSampleToJob(jobID=jobID, filePath=filePath, lastSample=lastSample)
+    result = database.addSampleToJob(jobID=jobID, filePath=filePath, lastSample=lastSample, noiseLevel=noiseLevel, completed=completed)
     return JSONResponse(content=result)
 
 @app.post("/cancelJob")
@@ -97,6 +99,8 @@ async def requestLastRemoteSample(jobID : str):
     # Convert the result to str 
     if "lastSample" in result:
         result["lastSample"] = str(result["lastSample"])
+    if "noiseLevel" in result:
+        result["noiseLevel"] = str(result["noiseLevel"])
     if "image" in result and result["image"] != "":
         return FileResponse(path=result["image"], headers=result)
     else:
@@ -107,7 +111,7 @@ async def parse_body(request: Request):
     return data
 
 @app.post("/updateRemoteJobExec")
-async def updateRemoteJobExec(file: UploadFile, jobID: str = Form(...), lastSample: str = Form(...)):
+async def updateRemoteJobExec(file: UploadFile, jobID: str = Form(...), lastSample: str = Form(...), noiseLevel: str = Form("-1"), completed: str = Form("false")):
     '''
         Upload a sample image and store it locally. The file is then 
         move to a local folder which is saved in the database.
@@ -129,7 +133,7 @@ async def updateRemoteJobExec(file: UploadFile, jobID: str = Form(...), lastSamp
         f.write(contents)
         f.close()
 
-    result = database.addSampleToJob(jobID=jobID, filePath=filePath, lastSample=int(lastSample))
+    result = database.addSampleToJob(jobID=jobID, filePath=filePath, lastSample=int(lastSample), noiseLevel=float(noiseLevel), completed=(completed == "true"))
     return result
 
 @app.get("/requestListAllJobs")
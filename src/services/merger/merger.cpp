@@ -0,0 +1,66 @@
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <lyra/lyra.hpp>
+#include <spdlog/spdlog.h>
+
+#include <miquella/core/io/accumulation.h>
+#include <miquella/core/io/ppm.h>
+
+// Add the accumulation files written by the workers of a job into one file,
+// or stitch crops of the image, and optionally write the resulting image.
+int main(int argc, char** argv)
+{
+    std::vector<std::string> inputs;
+    std::string output;
+    std::string ppmPath;
+    bool assemble = false;
+
+    auto cli = lyra::cli()
+        | lyra::opt( output, "output" )
+            ["-o"]["--output"]
+            ("Accumulation file receiving the sum of the inputs.").required()
+        | lyra::opt( ppmPath, "ppm" )
+            ["--ppm"]
+            ("Also write the merged image as a PPM file.")
+        | lyra::opt( assemble )
+            ["--assemble"]
+            ("The inputs are crops of the image, possibly of different windows.")
+        | lyra::arg( inputs, "inputs" )
+            ("Accumulation files to merge.").cardinality(1, 0);
+
+    auto result = cli.parse( { argc, argv } );
+    if ( !result )
+    {
+        spdlog::critical("Unable to parse the command line: {}.", result.errorMessage());
+        exit(1);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool merged = assemble ? miquella::core::io::assembleAccumulations(inputs, output) : miquella::core::io::mergeAccumulations(inputs, output);
+    if(!merged)
+    {
+        spdlog::critical("Unable to merge the accumulation files.");
+        exit(1);
+    }
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    spdlog::info("Merged {} files into {} in {:.1f} ms.", inputs.size(), output, duration);
+
+    if(!ppmPath.empty())
+    {
+        miquella::core::io::AccumulationHeader header;
+        std::vector<float> sums;
+        std::vector<uint32_t> samples;
+        std::ifstream file(output, std::ifstream::binary);
+        if(!miquella::core::io::readAccumulation(file, header, sums, samples))
+            exit(1);
+
+        std::ofstream ppm(ppmPath, std::ofstream::binary);
+        miquella::core::io::writePPM(ppm, static_cast<int>(header.m_width), static_cast<int>(header.m_height), miquella::core::io::tonemapAccumulation(header, sums.data(), samples.data()));
+        spdlog::info("Image written to {}.", ppmPath);
+    }
+
+    return 0;
+}
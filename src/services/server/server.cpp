@@ -1,9 +1,12 @@
+#include <algorithm>
 #include <iostream>
 #include <chrono>
 #include <thread>
 #include <fstream>
 #include <filesystem>
 #include <map>
+#include <sstream>
+#include <vector>
 
 #include <glbinding/gl/gl.h>
 #include <glbinding/glbinding.h>
@@ -24,6 +27,7 @@
 #include <miquella/core/sceneFactory.h>
 
 #include <miquella/http/http.h>
+#include <miquella/http/uploadQueue.h>
 
 #include <nlohmann/json.hpp>
 using json = nlohmann::json;
@@ -42,89 +46,279 @@ using json = nlohmann::json;
 
 using namespace gl;
 
+// AOVs named in a comma separated list, with the names of to_string(AOV)
+std::vector<miquella::core::AOV> parseAOVs(const std::string& list)
+{
+    std::vector<miquella::core::AOV> aovs;
+    std::stringstream stream(list);
+    std::string name;
+    while(std::getline(stream, name, ','))
+    {
+        if(name.empty())
+            continue;
+
+        bool found = false;
+        for(uint8_t i = 0; i < static_cast<uint8_t>(miquella::core::AOV::MAX_NB_AOV); ++i)
+        {
+            auto aov = miquella::core::AOV(i);
+            if(name.compare(miquella::core::to_string(aov)) == 0)
+            {
+                aovs.push_back(aov);
+                found = true;
+            }
+        }
+        if(!found)
+            spdlog::warn("Unknown AOV {}, ignored.", name);
+    }
+    return aovs;
+}
+
+// Status of the job returned by the controller after an upload, false when
+// the worker must stop rendering it
+bool isJobRunning(long returnCode, const std::string& text, const std::string& controller)
+{
+    if(returnCode != 200)
+    {
+        spdlog::debug("Update {} server return code: {}", controller, returnCode);
+        return true;
+    }
+
+    json data = json::parse(text);
+    if(data.count("status") == 0)
+    {
+        spdlog::warn("Unable to parse the status when sending a sample update to the {} controller. Response: {}", controller, text);
+    }
+    else if(data["status"].get<std::string>().compare("RUNNING") != 0)
+    {
+        spdlog::info("Job status changed to {}, stopping the job loop.", data["status"].get<std::string>());
+        return false;
+    }
+    return true;
+}
+
+bool writeBuffer(const std::filesystem::path& path, const std::string& buffer)
+{
+    std::ofstream file(path, std::ofstream::binary);
+    file.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    return static_cast<bool>(file);
+}
+
+// Part of a job shared with other workers: the maxSamples samples starting
+// at m_firstSample, in the crop window of the image when its size is not 0
+struct JobPart
+{
+    int m_partID = -1;      // -1 when the worker renders the whole job
+    size_t m_firstSample = 0;
+    uint32_t m_seed = 0;
+    int m_cropX = 0;
+    int m_cropY = 0;
+    int m_cropWidth = 0;
+    int m_cropHeight = 0;
+};
+
+// The worker rendering a part of a job uploads its float accumulation
+// instead of an image. The uploads to a remote controller are encoded in
+// memory, they are only written to disk with keepFiles.
+// Each checkpoint is copied on the render thread and encoded, written and
+// sent by the upload queue while the next samples are rendered, unless
+// syncUpload is set. A reply of the controller cancelling the job stops the
+// rendering after the current call to render().
 void runRenderer(
                 size_t sceneID, 
                 bool remote,
                 size_t maxSamples,
                 size_t outputFrequency,
                 const std::string& jobID,
-                const std::string& serverURL,
-                int port,
-                int nbThreads)
+                miquella::http::ControllerClient& controller,
+                int nbThreads,
+                int maxDepth,
+                bool russianRoulette,
+                miquella::core::SamplerType sampler,
+                bool nextEventEstimation,
+                float noiseThreshold,
+                bool denoise,
+                const std::vector<miquella::core::AOV>& aovs,
+                const JobPart& part,
+                bool keepFiles,
+                bool syncUpload)
 {
     miquella::core::SceneFactory sceneFactory;
     auto [ scene, camera, background ] = sceneFactory.createScene(miquella::core::SceneID(sceneID));
     
+    bool splitJob = part.m_partID >= 0;
+    camera->setCropWindow(part.m_cropX, part.m_cropY, part.m_cropWidth, part.m_cropHeight);
     miquella::core::RendererThreads renderer(scene, camera, static_cast<uint32_t>(nbThreads));
     //renderer.setScene(scene);
     //renderer.setCamera(camera);
     renderer.setBackground(background);
+    renderer.setMaxDepth(maxDepth);
+    renderer.setRussianRoulette(russianRoulette);
+    renderer.setSampler(sampler);
+    renderer.setNextEventEstimation(nextEventEstimation);
+    renderer.setSeed(part.m_seed);
+    renderer.setFirstSample(part.m_firstSample);
+    // Only the written images are denoised, the accumulation stays noisy.
+    // The parts of a split job are assembled by the controller, which makes
+    // the image.
+    renderer.setDenoising(denoise && !splitJob ? miquella::core::DenoiseMode::ON_WRITE : miquella::core::DenoiseMode::OFF);
+    if(!splitJob)
+    {
+        for(auto aov : aovs)
+            renderer.setAOV(aov, true);
+    }
     //renderer.setNbThreads(nbThreads);
 
-    for(size_t i = 1; i <= maxSamples; ++i)
+    // The error estimate is too optimistic with few samples per pixel
+    const size_t minSamplesForThreshold = 64;
+
+    // The local controller reads the files written by the worker
+    bool writeFiles = keepFiles || !remote;
+
+    // Last accumulation of the part written to disk, only used by the
+    // uploads, which run one after the other
+    std::filesystem::path lastPartPath;
+    size_t lastPartSample = 0;
+
+    // At most 2 checkpoints wait for the network, the render thread blocks
+    // on the next one
+    miquella::http::UploadQueue uploads(syncUpload ? 0 : 2);
+
+    size_t i = 0;
+    while(i < maxSamples && uploads.isRunning())
     {
-        // Compute the image
-        renderer.render();
+        // Compute all the samples up to the next output in a single call
+        size_t spp = std::min(outputFrequency - i % outputFrequency, maxSamples - i);
+        renderer.render(spp);
+        i += spp;
 
-        if(i % outputFrequency == 0)
-        {
-            std::stringstream fileName;
-            fileName<<"scene"<<sceneID<<"_sample"<<i<<".ppm";
-            std::filesystem::path sampleImage(fileName.str());
-            auto absPath = std::filesystem::absolute(sampleImage);
-            renderer.writeToPPM(absPath.string());
-            spdlog::debug("Sample {} saved to file {}.", i, absPath.string());
+        if(!uploads.isRunning())
+            break;
 
-            // Manual method with cppRestsdk, didn't work
-            // source: https://stackoverflow.com/questions/56497375/cpprestsdk-how-to-post-multipart-data
-            // Switching to CPR
-            if(remote)
+        if(i % outputFrequency == 0 || i == maxSamples)
+        {
+            if(splitJob)
             {
-                auto [returnCode, text] = miquella::http::uploadJobToRemoteController(serverURL, port, absPath, jobID, i);
-                if(returnCode == 200)
-                {
-                    json data = json::parse(text);
-                    if(data.count("status") == 0)
-                    {
-                        spdlog::warn("Unable to parse the status when sending a sample update to the local controller. Response: {}", text);
-                    }
-                    else if(data["status"].get<std::string>().compare("RUNNING") != 0)
-                    {
-                        spdlog::info("Job status changed to {}, stopping the job loop.", data["status"].get<std::string>());
-                        break;
-                    }
-                }
-                else 
+                // The error of a part says little about the error of the
+                // job, the part always computes all its samples
+                bool completed = i == maxSamples;
+
+                std::stringstream fileName;
+                fileName<<"scene"<<sceneID<<"_part"<<part.m_partID<<"_sample"<<i<<".mqa";
+                auto absPath = std::filesystem::absolute(std::filesystem::path(fileName.str()));
+
+                miquella::core::io::AccumulationHeader header;
+                header.m_sceneID = static_cast<uint32_t>(sceneID);
+                header.m_jobID = jobID;
+                // The header fails the same way at every checkpoint, the
+                // part is abandoned rather than never completed
+                std::string buffer;
+                if(!renderer.encodeAccumulation(buffer, header))
                 {
-                    spdlog::debug("Update remote server return code: {}", returnCode);
+                    spdlog::error("Unable to encode the accumulation of part {} of job {}, abandoning the job.", part.m_partID, jobID);
+                    break;
                 }
-            }
-            else 
-            {
-                // Notify the controller that we have a new sample image
-                auto [ returnCode, text ] = miquella::http::uploadJobToLocalController(absPath, jobID, i);
-                if(returnCode == 200)
+
+                auto partID = static_cast<size_t>(part.m_partID);
+                uploads.push([=, &controller, &lastPartPath, &lastPartSample, buffer = std::move(buffer)]
                 {
-                    json data = json::parse(text);
-                    if(data.count("status") == 0)
+                    bool written = writeFiles && writeBuffer(absPath, buffer);
+                    if(written)
                     {
-                        spdlog::warn("Unable to parse the status when sending a sample update to the local controller. Response: {}", text);
+                        spdlog::debug("Sample {} of part {} saved to file {}.", i, partID, absPath.string());
+                        lastPartPath = absPath;
+                        lastPartSample = i;
                     }
-                    else if(data["status"].get<std::string>().compare("RUNNING") != 0)
+                    else if(writeFiles)
+                        spdlog::warn("Unable to write the accumulation of part {} of job {}.", partID, jobID);
+
+                    // The remote controller receives the accumulation from
+                    // memory, the file is only a copy
+                    if(remote)
                     {
-                        spdlog::info("Job status changed to {}, stopping the job loop.", data["status"].get<std::string>());
-                        break;
+                        auto [returnCode, text] = controller.uploadPartBufferToRemoteController(buffer, jobID, partID, i, completed);
+                        return isJobRunning(returnCode, text, "remote");
                     }
-                }
-                else 
+
+                    // The local controller must still learn that the part is
+                    // completed, with the last file written
+                    if(!written && !completed)
+                        return true;
+                    if(!written && lastPartPath.empty())
+                    {
+                        spdlog::error("No accumulation of part {} of job {} could be written, abandoning the job.", partID, jobID);
+                        return false;
+                    }
+                    auto [returnCode, text] = controller.uploadPartToLocalController(lastPartPath.string(), jobID, partID, lastPartSample, completed);
+                    return isJobRunning(returnCode, text, "local");
+                });
+                continue;
+            }
+
+            // With a noise threshold, the job is completed as soon as the
+            // estimated error of the image is below it
+            float error = renderer.estimateError();
+            bool converged = noiseThreshold > 0.f && i >= minSamplesForThreshold && error < noiseThreshold;
+            bool completed = converged || i == maxSamples;
+            spdlog::debug("Sample {} of job {}, estimated error {}.", i, jobID, error);
+            if(converged)
+                spdlog::info("Job {} reached the error {} after {} samples, below the threshold {}.", jobID, error, i, noiseThreshold);
+
+            std::stringstream fileName;
+            fileName<<"scene"<<sceneID<<"_sample"<<i<<".ppm";
+            std::filesystem::path sampleImage(fileName.str());
+            auto absPath = std::filesystem::absolute(sampleImage);
+            std::vector<unsigned char> image;
+            renderer.getOutputImage(image);
+            if(denoise)
+                spdlog::debug("Sample {} denoised in {} ms.", i, renderer.getDenoiseTime());
+
+            // The AOVs are written next to the image, as float images
+            for(auto aov : aovs)
+            {
+                std::stringstream aovName;
+                aovName<<"scene"<<sceneID<<"_sample"<<i<<"_"<<miquella::core::to_string(aov)<<".pfm";
+                auto aovPath = std::filesystem::absolute(std::filesystem::path(aovName.str()));
+                if(renderer.writeAOV(aov, aovPath.string()))
+                    spdlog::debug("AOV {} of sample {} saved to file {}.", miquella::core::to_string(aov), i, aovPath.string());
+            }
+
+            int width = renderer.getImageWidth();
+            int height = renderer.getImageHeight();
+            uploads.push([=, &controller, image = std::move(image)]
+            {
+                std::string buffer;
+                miquella::core::io::encodePPM(width, height, image, buffer);
+                if(writeFiles && !writeBuffer(absPath, buffer))
+                    spdlog::warn("Unable to write the sample {} to file {}.", i, absPath.string());
+                else if(writeFiles)
+                    spdlog::debug("Sample {} saved to file {}.", i, absPath.string());
+
+                // Manual method with cppRestsdk, didn't work
+                // source: https://stackoverflow.com/questions/56497375/cpprestsdk-how-to-post-multipart-data
+                // Switching to CPR
+                if(remote)
                 {
-                    spdlog::debug("Update local server return code: {}", returnCode);
+                    auto [returnCode, text] = controller.uploadJobBufferToRemoteController(buffer, sampleImage.string(), jobID, i, error, completed);
+                    return isJobRunning(returnCode, text, "remote");
                 }
-            }
+
+                // Notify the controller that we have a new sample image
+                auto [ returnCode, text ] = controller.uploadJobToLocalController(absPath, jobID, i, error, completed);
+                return isJobRunning(returnCode, text, "local");
+            });
+
+            if(converged)
+                break;
         }
     }
+
+    // The last checkpoint of the job is sent before the next job is requested
+    uploads.finish();
+    if(uploads.getWaitTime() > 0.0)
+        spdlog::debug("Job {} waited {} ms for the upload queue.", jobID, uploads.getWaitTime());
 }
 
+
 int main(int argc, char** argv)
 {
 
@@ -138,11 +332,20 @@ int main(int argc, char** argv)
     std::string serverURL = "http://localhost";
     int port = 8000;
     int nbThreads = 1;
+    int maxDepth = 5;
+    bool russianRoulette = false;
+    size_t samplerID = 0;
+    bool nextEventEstimation = false;
+    float noiseThreshold = 0.f;
+    bool denoise = false;
+    std::string aovList;
+    bool keepFiles = false;
+    bool syncUpload = false;
 
     auto cli = lyra::cli()
         | lyra::opt( sceneID, "sceneid" )
             ["--scene-id"]
-            ("0: 3 balls, 1: random balls, 2: rectangle light, 3: RaytracingOneWeekend, 4: Lambertien test, 5: Dieletric test, 6: Empty cornel, 7: Glass cornel")
+            ("0: 3 balls, 1: random balls, 2: rectangle light, 3: RaytracingOneWeekend, 4: Lambertien test, 5: Dieletric test, 6: Empty cornel, 7: Glass cornel, 8: Many lights")
         | lyra::opt( maxSamples, "maxsamples" )
             ["--maxSamples"]
             ("Total number of samples to generate on the image.")
@@ -163,7 +366,34 @@ int main(int argc, char** argv)
             ("Port to use to contact the controller.")
         | lyra::opt( nbThreads, "nthreads" )
             ["--nthreads"]
-            ("Number of threads to use by the renderer.");
+            ("Number of threads to use by the renderer.")
+        | lyra::opt( maxDepth, "maxdepth" )
+            ["--max-depth"]
+            ("Maximum number of bounces of a path, used when the job does not specify it.")
+        | lyra::opt( russianRoulette )
+            ["--russian-roulette"]
+            ("Terminate low contribution paths early, used when the job does not specify it.")
+        | lyra::opt( samplerID, "samplerid" )
+            ["--sampler"]
+            ("0: independent, 1: Sobol, 2: blue noise. Used when the job does not specify it.")
+        | lyra::opt( nextEventEstimation )
+            ["--nee"]
+            ("Sample the lights at each diffuse bounce, used when the job does not specify it.")
+        | lyra::opt( noiseThreshold, "threshold" )
+            ["--noise-threshold"]
+            ("Stop a job once the estimated RMSE of its image is below this value, 0 to always compute all the samples. Used when the job does not specify it.")
+        | lyra::opt( denoise )
+            ["--denoise"]
+            ("Denoise the images sent to the controller, guided by the albedo, normal and depth of the first hits. Used when the job does not specify it.")
+        | lyra::opt( aovList, "aovs" )
+            ["--aovs"]
+            ("Comma separated AOVs written as PFM images with each output image: ALBEDO, NORMAL, DEPTH, OBJECT_ID, SAMPLE_COUNT. Used when the job does not specify it.")
+        | lyra::opt( keepFiles )
+            ["--keep-files"]
+            ("Also write the images sent to a remote controller to disk. They are always written for the local controller.")
+        | lyra::opt( syncUpload )
+            ["--sync-upload"]
+            ("Stop rendering while a checkpoint is encoded and sent to the controller, instead of sending it in the background.");
 
     auto result = cli.parse( { argc, argv } );
     if ( !result )
@@ -178,6 +408,12 @@ int main(int argc, char** argv)
         exit(1);
     }
 
+    if(miquella::core::SamplerType(samplerID) >= miquella::core::SamplerType::MAX_NB_SAMPLER)
+    {
+        spdlog::critical("Sampler ID does not exist ({}).", samplerID);
+        exit(1);
+    }
+
     // Setting up the logging level
     std::map<std::string, spdlog::level::level_enum> loglvlTable {
         {"info", spdlog::level::info},
@@ -199,11 +435,15 @@ int main(int argc, char** argv)
     srand(static_cast<unsigned int>(time(nullptr)));
 
     // ---------------------- Ray tracing time ----------------------------------
+
+    // The connections to the controller are kept open between the uploads
+    // and the jobs
+    miquella::http::ControllerClient controller(serverURL, port);
     
     while(1)
     {
 
-        auto [ returnCode, text ] = miquella::http::requestJob(serverURL, port);
+        auto [ returnCode, text ] = controller.requestJob();
 
         if(returnCode != 200)
         {
@@ -226,11 +466,38 @@ int main(int argc, char** argv)
             sceneID = data.at("sceneID").get<size_t>();
             maxSamples = data.at("nSamples").get<size_t>();
             outputFrequency = data.at("freqOutput").get<size_t>();
-            spdlog::info("Rendering job {} received from the controller.", jobID);
+
+            // Optional per job settings, the command line values are the defaults
+            int jobMaxDepth = data.value("maxDepth", maxDepth);
+            bool jobRussianRoulette = data.value("russianRoulette", russianRoulette);
+            bool jobNextEventEstimation = data.value("nextEventEstimation", nextEventEstimation);
+            float jobNoiseThreshold = data.value("noiseThreshold", noiseThreshold);
+            bool jobDenoise = data.value("denoise", denoise);
+            auto jobAOVs = parseAOVs(data.value("aovs", aovList));
+            size_t jobSamplerID = data.value("sampler", samplerID);
+
+            // Part of a job split across several workers
+            JobPart part;
+            part.m_partID = data.value("partID", -1);
+            part.m_firstSample = data.value("firstSample", size_t(0));
+            part.m_seed = data.value("seed", 0u);
+            part.m_cropX = data.value("cropX", 0);
+            part.m_cropY = data.value("cropY", 0);
+            part.m_cropWidth = data.value("cropWidth", 0);
+            part.m_cropHeight = data.value("cropHeight", 0);
+            if(miquella::core::SamplerType(jobSamplerID) >= miquella::core::SamplerType::MAX_NB_SAMPLER)
+            {
+                spdlog::warn("Sampler ID {} of job {} does not exist, using the independent sampler.", jobSamplerID, jobID);
+                jobSamplerID = 0;
+            }
+            if(part.m_partID >= 0)
+                spdlog::info("Rendering samples {} to {} of job {}, crop {}x{} at ({}, {}), received from the controller.", part.m_firstSample, part.m_firstSample + maxSamples - 1, jobID, part.m_cropWidth, part.m_cropHeight, part.m_cropX, part.m_cropY);
+            else
+                spdlog::info("Rendering job {} received from the controller.", jobID);
 
             auto start = std::chrono::steady_clock::now();
             // Rendering the scene
-            runRenderer(sceneID, remote, maxSamples, outputFrequency, jobID, serverURL, port, nbThreads);
+            runRenderer(sceneID, remote, maxSamples, outputFrequency, jobID, controller, nbThreads, jobMaxDepth, jobRussianRoulette, miquella::core::SamplerType(jobSamplerID), jobNextEventEstimation, jobNoiseThreshold, jobDenoise, jobAOVs, part, keepFiles, syncUpload);
             auto end = std::chrono::steady_clock::now();
             std::chrono::duration<double> elapsed(end - start);
 
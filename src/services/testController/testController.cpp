@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <cpprest/http_listener.h>
+
+#include <lyra/lyra.hpp>
+#include <spdlog/spdlog.h>
+
+#include <miquella/core/sceneFactory.h>
+#include <miquella/core/io/accumulation.h>
+#include <miquella/core/io/ppm.h>
+
+#include <nlohmann/json.hpp>
+using json = nlohmann::json;
+
+using namespace web::http;
+using namespace web::http::experimental::listener;
+
+// Stand-in for the controller, serving a single job split in parts, sample
+// ranges of crop windows, to run several servers on one host and check the
+// assembled result end to end:
+//
+//   MiquellaTestController --maxSamples 1024 --range-size 256 --crops 2 --exit-when-done &
+//   for i in 1 2 3 4 5 6 7 8; do MiquellaServer -r & done
+//
+// The servers receive the parts through /requestJob and upload their
+// accumulation files. The controller assembles the last file of each part.
+
+struct Part
+{
+    size_t m_firstSample = 0;
+    size_t m_nbSamples = 0;
+    int m_cropX = 0;
+    int m_cropY = 0;
+    int m_cropWidth = 0;            // 0 for the whole image
+    int m_cropHeight = 0;
+    std::string m_status = "PENDING";
+    size_t m_lastSample = 0;        // Samples computed, from the start of the part
+    std::string m_filePath;         // Last accumulation received
+};
+
+struct Job
+{
+    std::string m_jobID;
+    size_t m_sceneID = 0;
+    size_t m_nbSamples = 0;
+    size_t m_freqOutput = 0;
+    uint32_t m_seed = 0;
+    size_t m_samplerID = 0;
+    int m_maxDepth = 5;
+    bool m_russianRoulette = false;
+    bool m_nextEventEstimation = false;
+    std::vector<Part> m_parts;
+    std::string m_status = "PENDING";
+    std::chrono::steady_clock::time_point m_start;
+};
+
+class TestController
+{
+public:
+    TestController(Job job, const std::filesystem::path& folder) : m_job(std::move(job)), m_folder(folder){}
+
+    void handle(http_request request);
+
+    // Block until the job is completed or canceled
+    void wait()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_done.wait(lock, [this]{ return m_job.m_status == "COMPLETED" || m_job.m_status == "CANCELED"; });
+    }
+
+protected:
+    json _requestJob();
+    json _updatePart(const std::string& jobID, size_t partID, size_t lastSample, bool completed, const std::string& filePath);
+    json _listJobs() const;
+
+    // Whole image from the last accumulations of the parts, in the file output
+    bool _assemble(const std::filesystem::path& output) const;
+
+    Job m_job;
+    std::filesystem::path m_folder;
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    std::atomic<size_t> m_nbUploads = 0;  // Names of the files being received
+};
+
+namespace
+{
+    bool getParameter(const std::map<utility::string_t, utility::string_t>& query, const std::string& name, std::string& value)
+    {
+        auto it = query.find(name);
+        if(it == query.end())
+            return false;
+        value = web::uri::decode(it->second);
+        return true;
+    }
+
+    std::string makeJobID()
+    {
+        std::random_device device;
+        std::stringstream id;
+        id<<std::hex<<device()<<device();
+        return id.str();
+    }
+}
+
+void TestController::handle(http_request request)
+{
+    auto path = web::uri::decode(request.relative_uri().path());
+    auto query = web::uri::split_query(request.relative_uri().query());
+
+    std::string jobID, partID, lastSample, completed, filePath;
+    bool isPartUpdate = getParameter(query, "jobID", jobID) && getParameter(query, "partID", partID) && getParameter(query, "lastSample", lastSample);
+    getParameter(query, "completed", completed);
+
+    if(path == "/requestJob" && request.method() == methods::POST)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        request.reply(status_codes::OK, _requestJob().dump(), "application/json");
+    }
+    else if(path == "/updateRemotePartExec" && request.method() == methods::POST && isPartUpdate)
+    {
+        // The last file of the part may be mapped by _assemble(), the upload
+        // is written to its own file and replaces it under the lock
+        auto content = request.extract_vector().get();
+        auto partPath = m_folder / (jobID + "_part" + partID + ".mqa");
+        auto uploadPath = m_folder / (jobID + "_part" + partID + "_upload" + std::to_string(m_nbUploads++) + ".mqa");
+        std::ofstream file(uploadPath, std::ofstream::binary);
+        file.write(reinterpret_cast<const char*>(content.data()), static_cast<std::streamsize>(content.size()));
+        file.close();
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::error_code error;
+        std::filesystem::rename(uploadPath, partPath, error);
+        if(error)
+        {
+            spdlog::error("Unable to replace the accumulation of part {}: {}.", partID, error.message());
+            std::filesystem::remove(uploadPath, error);
+            request.reply(status_codes::InternalError, json({{"error", "Unable to store the accumulation."}}).dump(), "application/json");
+            return;
+        }
+        auto result = _updatePart(jobID, std::stoul(partID), std::stoul(lastSample), completed == "true", partPath.string());
+        request.reply(status_codes::OK, result.dump(), "application/json");
+    }
+    else if(path == "/updateLocalPartExec" && request.method() == methods::POST && isPartUpdate && getParameter(query, "filePath", filePath))
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto result = _updatePart(jobID, std::stoul(partID), std::stoul(lastSample), completed == "true", filePath);
+        request.reply(status_codes::OK, result.dump(), "application/json");
+    }
+    else if(path == "/requestJobAccumulation" && request.method() == methods::GET)
+    {
+        // Parts received so far, the image of a running job improves at
+        // each request
+        auto mergedPath = m_folder / (m_job.m_jobID + "_preview.mqa");
+        // The preview file is shared by the requests, it is read before
+        // another request rewrites it
+        std::vector<unsigned char> content;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(jobID != m_job.m_jobID || !_assemble(mergedPath))
+            {
+                request.reply(status_codes::NotFound, json({{"error", "No accumulation for this job."}}).dump(), "application/json");
+                return;
+            }
+
+            std::ifstream file(mergedPath, std::ifstream::binary | std::ifstream::ate);
+            content.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            file.read(reinterpret_cast<char*>(content.data()), static_cast<std::streamsize>(content.size()));
+        }
+        http_response response(status_codes::OK);
+        response.set_body(std::move(content));
+        request.reply(response);
+    }
+    else if(path == "/cancelJob" && request.method() == methods::POST)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(jobID != m_job.m_jobID)
+        {
+            request.reply(status_codes::OK, json({{"error", "Job does not exist."}}).dump(), "application/json");
+            return;
+        }
+        m_job.m_status = "CANCELED";
+        m_done.notify_all();
+        request.reply(status_codes::OK, json({{"status", "CANCELED"}}).dump(), "application/json");
+    }
+    else if(path == "/requestListAllJobs" && request.method() == methods::GET)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        request.reply(status_codes::OK, _listJobs().dump(), "application/json");
+    }
+    else
+    {
+        request.reply(status_codes::NotFound);
+    }
+}
+
+json TestController::_requestJob()
+{
+    if(m_job.m_status != "PENDING" && m_job.m_status != "RUNNING")
+        return json::object();
+
+    for(size_t p = 0; p < m_job.m_parts.size(); ++p)
+    {
+        auto& part = m_job.m_parts[p];
+        if(part.m_status != "PENDING")
+            continue;
+
+        if(m_job.m_status == "PENDING")
+            m_job.m_start = std::chrono::steady_clock::now();
+        part.m_status = "RUNNING";
+        m_job.m_status = "RUNNING";
+        spdlog::info("Part {} of job {} sent to a server.", p, m_job.m_jobID);
+
+        json result;
+        result["jobID"] = m_job.m_jobID;
+        result["sceneID"] = m_job.m_sceneID;
+        result["nSamples"] = part.m_nbSamples;
+        result["freqOutput"] = m_job.m_freqOutput;
+        result["maxDepth"] = m_job.m_maxDepth;
+        result["russianRoulette"] = m_job.m_russianRoulette;
+        result["sampler"] = m_job.m_samplerID;
+        result["nextEventEstimation"] = m_job.m_nextEventEstimation;
+        result["partID"] = p;
+        result["firstSample"] = part.m_firstSample;
+        result["seed"] = m_job.m_seed;
+        result["cropX"] = part.m_cropX;
+        result["cropY"] = part.m_cropY;
+        result["cropWidth"] = part.m_cropWidth;
+        result["cropHeight"] = part.m_cropHeight;
+        return result;
+    }
+
+    // All the parts are sent
+    return json::object();
+}
+
+json TestController::_updatePart(const std::string& jobID, size_t partID, size_t lastSample, bool completed, const std::string& filePath)
+{
+    if(jobID != m_job.m_jobID || partID >= m_job.m_parts.size())
+        return {{"status", "REMOVED"}};
+    if(m_job.m_status != "RUNNING")
+        return {{"status", m_job.m_status}};
+
+    auto& part = m_job.m_parts[partID];
+    part.m_lastSample = lastSample;
+    part.m_filePath = filePath;
+    spdlog::debug("Part {} of job {} at sample {}.", partID, jobID, lastSample);
+    if(!completed && lastSample != part.m_nbSamples)
+        return {{"status", "RUNNING"}};
+
+    part.m_status = "COMPLETED";
+    bool jobCompleted = std::all_of(m_job.m_parts.begin(), m_job.m_parts.end(), [](const Part& p){ return p.m_status == "COMPLETED"; });
+    if(!jobCompleted)
+        return {{"status", "RUNNING"}};
+
+    std::chrono::duration<double> elapsed(std::chrono::steady_clock::now() - m_job.m_start);
+    auto mergedPath = m_folder / (m_job.m_jobID + ".mqa");
+    auto start = std::chrono::steady_clock::now();
+    if(_assemble(mergedPath))
+    {
+        auto mergeTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        miquella::core::io::AccumulationHeader header;
+        std::vector<float> sums;
+        std::vector<uint32_t> samples;
+        std::ifstream file(mergedPath, std::ifstream::binary);
+        if(miquella::core::io::readAccumulation(file, header, sums, samples))
+        {
+            auto imagePath = m_folder / (m_job.m_jobID + ".ppm");
+            std::ofstream image(imagePath, std::ofstream::binary);
+            miquella::core::io::writePPM(image, static_cast<int>(header.m_width), static_cast<int>(header.m_height), miquella::core::io::tonemapAccumulation(header, sums.data(), samples.data()));
+            spdlog::info("Job {} completed in {}s, {} parts assembled in {} ms into {}.", jobID, elapsed.count(), m_job.m_parts.size(), mergeTime, imagePath.string());
+        }
+    }
+    else
+        spdlog::error("Unable to assemble the parts of job {}.", jobID);
+
+    m_job.m_status = "COMPLETED";
+    m_done.notify_all();
+    return {{"status", m_job.m_status}};
+}
+
+json TestController::_listJobs() const
+{
+    json job;
+    job["jobID"] = m_job.m_jobID;
+    job["sceneID"] = m_job.m_sceneID;
+    job["nSamples"] = m_job.m_nbSamples;
+    job["freqOutput"] = m_job.m_freqOutput;
+    job["status"] = m_job.m_status;
+    size_t nbCompleted = 0;
+    for(const auto& part : m_job.m_parts)
+    {
+        if(part.m_status == "COMPLETED")
+            nbCompleted++;
+    }
+    job["nParts"] = m_job.m_parts.size();
+    job["nCompletedParts"] = nbCompleted;
+
+    json result;
+    result["jobs"] = json::array({job});
+    return result;
+}
+
+bool TestController::_assemble(const std::filesystem::path& output) const
+{
+    std::vector<std::string> inputs;
+    for(const auto& part : m_job.m_parts)
+    {
+        if(!part.m_filePath.empty())
+            inputs.push_back(part.m_filePath);
+    }
+    return !inputs.empty() && miquella::core::io::assembleAccumulations(inputs, output.string());
+}
+
+int main(int argc, char** argv)
+{
+    Job job;
+    job.m_sceneID = 3;
+    job.m_nbSamples = 1000;
+    job.m_freqOutput = 50;
+    size_t rangeSize = 250;
+    int nbCrops = 1;
+    int port = 8000;
+    std::string folder = ".";
+    bool exitWhenDone = false;
+    std::string loglvl = "info";
+
+    auto cli = lyra::cli()
+        | lyra::opt( job.m_sceneID, "sceneid" )
+            ["--scene-id"]
+            ("Scene of the job, see MiquellaServer --help.")
+        | lyra::opt( job.m_nbSamples, "maxsamples" )
+            ["--maxSamples"]
+            ("Total number of samples of the job.")
+        | lyra::opt( job.m_freqOutput, "freq" )
+            ["--freq"]
+            ("Number of samples between two uploads of a part.")
+        | lyra::opt( rangeSize, "rangesize" )
+            ["--range-size"]
+            ("Number of samples of each part.")
+        | lyra::opt( nbCrops, "crops" )
+            ["--crops"]
+            ("Number of horizontal bands of the image, rendered separately.")
+        | lyra::opt( job.m_seed, "seed" )
+            ["--seed"]
+            ("Seed of the job, shared by all the parts.")
+        | lyra::opt( job.m_samplerID, "samplerid" )
+            ["--sampler"]
+            ("0: independent, 1: Sobol, 2: blue noise.")
+        | lyra::opt( job.m_maxDepth, "maxdepth" )
+            ["--max-depth"]
+            ("Maximum number of bounces of a path.")
+        | lyra::opt( job.m_nextEventEstimation )
+            ["--nee"]
+            ("Sample the lights at each diffuse bounce.")
+        | lyra::opt( port, "port" )
+            ["-p"]["--port"]
+            ("Port to listen to.")
+        | lyra::opt( folder, "folder" )
+            ["--output"]
+            ("Folder receiving the uploaded parts and the assembled image.")
+        | lyra::opt( exitWhenDone )
+            ["--exit-when-done"]
+            ("Stop once the job is completed or canceled.")
+        | lyra::opt( loglvl, "loglvl")
+            ["--loglvl"]
+            ("Log level to apply. info (default), warn, critical, debug");
+
+    auto result = cli.parse( { argc, argv } );
+    if ( !result )
+    {
+        spdlog::critical("Unable to parse the command line: {}.", result.errorMessage());
+        exit(1);
+    }
+
+    if(miquella::core::SceneID(job.m_sceneID) >= miquella::core::SceneID::MAX_NB_SCENE || job.m_nbSamples == 0 || rangeSize == 0 || job.m_freqOutput == 0 || nbCrops < 1)
+    {
+        spdlog::critical("Invalid job: scene {}, {} samples, ranges of {} samples, {} crops, output every {} samples.", job.m_sceneID, job.m_nbSamples, rangeSize, nbCrops, job.m_freqOutput);
+        exit(1);
+    }
+    if(loglvl == "debug")
+        spdlog::set_level(spdlog::level::debug);
+
+    job.m_jobID = makeJobID();
+
+    // The size of the image is only known by the scene
+    miquella::core::SceneFactory sceneFactory;
+    auto camera = std::get<1>(sceneFactory.createScene(miquella::core::SceneID(job.m_sceneID)));
+    int width = camera->getImageWidth();
+    int height = camera->getImageHeight();
+    nbCrops = std::min(nbCrops, height);
+
+    for(int c = 0; c < nbCrops; ++c)
+    {
+        for(size_t first = 0; first < job.m_nbSamples; first += rangeSize)
+        {
+            Part part;
+            part.m_firstSample = first;
+            part.m_nbSamples = std::min(rangeSize, job.m_nbSamples - first);
+            if(nbCrops > 1)
+            {
+                part.m_cropY = c * height / nbCrops;
+                part.m_cropWidth = width;
+                part.m_cropHeight = (c + 1) * height / nbCrops - part.m_cropY;
+            }
+            job.m_parts.push_back(part);
+        }
+    }
+    spdlog::info("Job {}: {} samples of scene {} in {} parts.", job.m_jobID, job.m_nbSamples, job.m_sceneID, job.m_parts.size());
+
+    std::filesystem::create_directories(folder);
+    TestController controller(std::move(job), std::filesystem::absolute(folder));
+
+    http_listener listener("http://0.0.0.0:" + std::to_string(port));
+    listener.support([&controller](http_request request){ controller.handle(request); });
+    listener.open().wait();
+    spdlog::info("Listening on port {}.", port);
+
+    if(exitWhenDone)
+        controller.wait();
+    else
+    {
+        spdlog::info("Press enter to stop the controller.");
+        std::string line;
+        std::getline(std::cin, line);
+    }
+
+    listener.close().wait();
+    return 0;
+}